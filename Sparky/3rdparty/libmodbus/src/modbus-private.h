@@ -27,6 +27,7 @@
 # include <time.h>
 typedef int ssize_t;
 #endif
+#include <stdio.h>
 #include <sys/types.h>
 #include <config.h>
 
@@ -54,9 +55,22 @@ MODBUS_BEGIN_DECLS
 typedef enum {
     _MODBUS_BACKEND_TYPE_RTU=0,
     _MODBUS_BACKEND_TYPE_TCP, 
-    _MODBUS_BACKEND_TYPE_ASCII
+    _MODBUS_BACKEND_TYPE_ASCII,
+    _MODBUS_BACKEND_TYPE_REPLAY
 } modbus_backend_type_t;
 
+/* Capture file, all fields little endian:
+ * - header: magic (8), version (2), backend type (2), reserved (4)
+ * - records: time in us since the start of the capture (8), length (2),
+ *   direction (1), reserved (1), then the bytes as sent or received */
+#define _MODBUS_CAPTURE_MAGIC           "MBCAP\r\n\032"
+#define _MODBUS_CAPTURE_MAGIC_LENGTH    8
+#define _MODBUS_CAPTURE_VERSION         1
+#define _MODBUS_CAPTURE_HEADER_LENGTH   16
+#define _MODBUS_CAPTURE_RECORD_LENGTH   12
+#define _MODBUS_CAPTURE_TX              0
+#define _MODBUS_CAPTURE_RX              1
+
 /*
  *  ---------- Request     Indication ----------
  *  | Client | ---------------------->| Server |
@@ -103,8 +117,11 @@ typedef struct _modbus_backend {
 } modbus_backend_t;
 
 struct _modbus {
-    /* Slave address */
+    /* Slave address, the serial number of an extended one */
     int slave;
+    /* Bytes of serial number after the slave byte of an extended frame,
+       0 for a standard slave (see modbus_set_extended_slave) */
+    int extended_length;
     /* Socket or file descriptor */
     int s;
     int debug;
@@ -117,11 +134,23 @@ struct _modbus {
     void *backend_data;
     modbus_monitor_add_item_fnc_t monitor_add_item;
     modbus_monitor_raw_data_fnc_t monitor_raw_data;
+    modbus_monitor_transaction_fnc_t monitor_transaction;
+    /* Request waiting for its confirmation, timed for monitor_transaction */
+    modbus_transaction_t transaction;
+    int transaction_pending;
+    /* Raw traffic capture, see modbus_set_capture() */
+    FILE *capture;
+    uint64_t capture_origin;
 };
 
+/* Serial number of an extended frame, big endian after MODBUS_EXTENDED_ADDRESS */
+#define _MODBUS_EXTENDED_SLAVE(msg) \
+    (int)(((uint32_t)(msg)[1] << 24) | ((uint32_t)(msg)[2] << 16) | ((uint32_t)(msg)[3] << 8) | (uint32_t)(msg)[4])
+
 void _modbus_init_common(modbus_t *ctx);
 void _error_print(modbus_t *ctx, const char *context);
 int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type);
+uint64_t _modbus_time_us(void);
 
 #ifndef HAVE_STRLCPY
 size_t strlcpy(char *dest, const char *src, size_t dest_size);
@@ -0,0 +1,411 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Serves a capture written by modbus_set_capture() in place of a serial
+ * port. Framing is the RTU one, only the transport is replaced: a request
+ * is matched against the next recorded request with the same bytes and
+ * the bytes received after it are handed back, either with their recorded
+ * delay or at once. A request the capture does not hold is never answered
+ * and times out like on a silent bus. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "modbus-private.h"
+
+#include "modbus-replay.h"
+#include "modbus-rtu.h"
+#include "modbus-rtu-private.h"
+
+/* The framing is borrowed from the RTU backend */
+extern const modbus_backend_t _modbus_rtu_backend;
+
+typedef struct _modbus_replay_record {
+    uint64_t t;
+    int direction;
+    int length;
+    const uint8_t *data;
+} modbus_replay_record_t;
+
+typedef struct _modbus_replay {
+    char *path;
+    int speed;
+    uint8_t *buffer;
+    modbus_replay_record_t *records;
+    int nb_records;
+    /* Next record to match a request against */
+    int next;
+    /* Received chunk being served, -1 when the bus is silent */
+    int rx;
+    int rx_offset;
+    /* Recorded time of the matched request and replay time it was sent */
+    uint64_t tx_t;
+    uint64_t tx_sent;
+} modbus_replay_t;
+
+static void _modbus_replay_sleep_us(uint64_t us)
+{
+#if defined(_WIN32)
+    Sleep((DWORD)((us + 999) / 1000));
+#else
+    struct timespec request, remaining;
+    request.tv_sec = us / 1000000;
+    request.tv_nsec = (us % 1000000) * 1000;
+    while (nanosleep(&request, &remaining) == -1 && errno == EINTR) {
+        request = remaining;
+    }
+#endif
+}
+
+static uint64_t _modbus_replay_get(const uint8_t *p, int size)
+{
+    uint64_t value = 0;
+    int i;
+
+    for (i = size - 1; i >= 0; i--)
+        value = (value << 8) | p[i];
+
+    return value;
+}
+
+static int _modbus_set_slave(modbus_t *ctx, int slave)
+{
+    return _modbus_rtu_backend.set_slave(ctx, slave);
+}
+
+static int _modbus_replay_build_request_basis(modbus_t *ctx, int function,
+                                              int addr, int nb, uint8_t *req)
+{
+    return _modbus_rtu_backend.build_request_basis(ctx, function, addr, nb, req);
+}
+
+static int _modbus_replay_build_response_basis(sft_t *sft, uint8_t *rsp)
+{
+    return _modbus_rtu_backend.build_response_basis(sft, rsp);
+}
+
+static int _modbus_replay_prepare_response_tid(const uint8_t *req, int *req_length)
+{
+    return _modbus_rtu_backend.prepare_response_tid(req, req_length);
+}
+
+static int _modbus_replay_send_msg_pre(uint8_t *req, int req_length)
+{
+    return _modbus_rtu_backend.send_msg_pre(req, req_length);
+}
+
+static ssize_t _modbus_replay_send(modbus_t *ctx, const uint8_t *req, int req_length)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+    int i;
+
+    ctx_replay->rx = -1;
+    ctx_replay->rx_offset = 0;
+
+    for (i = ctx_replay->next; i < ctx_replay->nb_records; i++) {
+        const modbus_replay_record_t *record = &ctx_replay->records[i];
+
+        if (record->direction == _MODBUS_CAPTURE_TX &&
+            record->length == req_length &&
+            memcmp(record->data, req, req_length) == 0) {
+            ctx_replay->next = i + 1;
+            ctx_replay->tx_t = record->t;
+            ctx_replay->tx_sent = _modbus_time_us();
+            if (i + 1 < ctx_replay->nb_records &&
+                ctx_replay->records[i + 1].direction == _MODBUS_CAPTURE_RX) {
+                ctx_replay->rx = i + 1;
+            }
+            break;
+        }
+    }
+
+    if (ctx->debug && ctx_replay->rx == -1) {
+        fprintf(stderr, "No recorded response to this request\n");
+    }
+
+    return req_length;
+}
+
+static int _modbus_replay_receive(modbus_t *ctx, uint8_t *req)
+{
+    return _modbus_receive_msg(ctx, req, MSG_INDICATION);
+}
+
+static ssize_t _modbus_replay_recv(modbus_t *ctx, uint8_t *rsp, int rsp_length)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+    const modbus_replay_record_t *record;
+    int length;
+
+    if (ctx_replay->rx == -1) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    record = &ctx_replay->records[ctx_replay->rx];
+    length = record->length - ctx_replay->rx_offset;
+    if (length > rsp_length)
+        length = rsp_length;
+
+    memcpy(rsp, record->data + ctx_replay->rx_offset, length);
+    ctx_replay->rx_offset += length;
+
+    /* Move on to the next chunk received before the next request */
+    if (ctx_replay->rx_offset == record->length) {
+        ctx_replay->rx_offset = 0;
+        ctx_replay->rx++;
+        if (ctx_replay->rx >= ctx_replay->nb_records ||
+            ctx_replay->records[ctx_replay->rx].direction != _MODBUS_CAPTURE_RX) {
+            ctx_replay->rx = -1;
+        }
+    }
+
+    return length;
+}
+
+static int _modbus_replay_flush(modbus_t *ctx)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+
+    ctx_replay->rx = -1;
+    ctx_replay->rx_offset = 0;
+
+    return 0;
+}
+
+static int _modbus_replay_check_integrity(modbus_t *ctx, uint8_t *msg,
+                                          const int msg_length)
+{
+    int error_recovery = ctx->error_recovery;
+    int rc;
+
+    /* The RTU check would flush a serial port on a bad CRC */
+    ctx->error_recovery &= ~MODBUS_ERROR_RECOVERY_PROTOCOL;
+    rc = _modbus_rtu_backend.check_integrity(ctx, msg, msg_length);
+    ctx->error_recovery = error_recovery;
+
+    if (rc == -1 && (error_recovery & MODBUS_ERROR_RECOVERY_PROTOCOL)) {
+        _modbus_replay_flush(ctx);
+    }
+
+    return rc;
+}
+
+static int _modbus_replay_pre_check_confirmation(modbus_t *ctx, const uint8_t *req,
+                                                 const uint8_t *rsp, int rsp_length)
+{
+    return _modbus_rtu_backend.pre_check_confirmation(ctx, req, rsp, rsp_length);
+}
+
+/* Loads the whole capture and indexes its records */
+static int _modbus_replay_connect(modbus_t *ctx)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+    FILE *file;
+    long size;
+    long offset;
+    int nb_records;
+
+    if (ctx->debug) {
+        printf("Replaying %s\n", ctx_replay->path);
+    }
+
+    file = fopen(ctx_replay->path, "rb");
+    if (file == NULL)
+        return -1;
+
+    if (fseek(file, 0, SEEK_END) == -1 || (size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) == -1) {
+        int saved_errno = errno;
+        fclose(file);
+        errno = saved_errno;
+        return -1;
+    }
+
+    free(ctx_replay->buffer);
+    ctx_replay->buffer = (uint8_t *) malloc(size > 0 ? size : 1);
+    if (fread(ctx_replay->buffer, 1, size, file) != (size_t)size) {
+        fclose(file);
+        errno = EIO;
+        return -1;
+    }
+    fclose(file);
+
+    if (size < _MODBUS_CAPTURE_HEADER_LENGTH ||
+        memcmp(ctx_replay->buffer, _MODBUS_CAPTURE_MAGIC, _MODBUS_CAPTURE_MAGIC_LENGTH) != 0 ||
+        _modbus_replay_get(ctx_replay->buffer + 8, 2) != _MODBUS_CAPTURE_VERSION ||
+        _modbus_replay_get(ctx_replay->buffer + 10, 2) != _MODBUS_BACKEND_TYPE_RTU) {
+        if (ctx->debug) {
+            fprintf(stderr, "ERROR %s is not an RTU capture\n", ctx_replay->path);
+        }
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* A record cut short by the end of the capture is dropped */
+    nb_records = 0;
+    offset = _MODBUS_CAPTURE_HEADER_LENGTH;
+    while (offset + _MODBUS_CAPTURE_RECORD_LENGTH <= size) {
+        int length = (int)_modbus_replay_get(ctx_replay->buffer + offset + 8, 2);
+        if (offset + _MODBUS_CAPTURE_RECORD_LENGTH + length > size)
+            break;
+        offset += _MODBUS_CAPTURE_RECORD_LENGTH + length;
+        nb_records++;
+    }
+
+    free(ctx_replay->records);
+    ctx_replay->records = (modbus_replay_record_t *)
+        malloc((nb_records > 0 ? nb_records : 1) * sizeof(modbus_replay_record_t));
+    ctx_replay->nb_records = nb_records;
+
+    offset = _MODBUS_CAPTURE_HEADER_LENGTH;
+    for (nb_records = 0; nb_records < ctx_replay->nb_records; nb_records++) {
+        modbus_replay_record_t *record = &ctx_replay->records[nb_records];
+        const uint8_t *p = ctx_replay->buffer + offset;
+
+        record->t = _modbus_replay_get(p, 8);
+        record->length = (int)_modbus_replay_get(p + 8, 2);
+        record->direction = p[10];
+        record->data = p + _MODBUS_CAPTURE_RECORD_LENGTH;
+        offset += _MODBUS_CAPTURE_RECORD_LENGTH + record->length;
+    }
+
+    ctx_replay->next = 0;
+    ctx_replay->rx = -1;
+    ctx_replay->rx_offset = 0;
+
+    /* No descriptor behind it, only marks the context as connected */
+    ctx->s = 0;
+
+    return 0;
+}
+
+static void _modbus_replay_close(modbus_t *ctx)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+
+    free(ctx_replay->records);
+    free(ctx_replay->buffer);
+    ctx_replay->records = NULL;
+    ctx_replay->buffer = NULL;
+    ctx_replay->nb_records = 0;
+    ctx->s = -1;
+}
+
+static int _modbus_replay_select(modbus_t *ctx, fd_set *rset,
+                                 struct timeval *tv, int length_to_read)
+{
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+    uint64_t timeout = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    uint64_t due;
+    uint64_t now;
+
+    if (ctx_replay->speed == MODBUS_REPLAY_FAST) {
+        if (ctx_replay->rx == -1) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        return 1;
+    }
+
+    if (ctx_replay->rx == -1) {
+        _modbus_replay_sleep_us(timeout);
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    /* The chunk arrives as long after the request as it did on the wire */
+    due = ctx_replay->tx_sent + (ctx_replay->records[ctx_replay->rx].t - ctx_replay->tx_t);
+    now = _modbus_time_us();
+    if (due > now) {
+        if (due - now > timeout) {
+            _modbus_replay_sleep_us(timeout);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        _modbus_replay_sleep_us(due - now);
+    }
+
+    return 1;
+}
+
+static void _modbus_replay_free(modbus_t *ctx) {
+    modbus_replay_t *ctx_replay = ctx->backend_data;
+
+    free(ctx_replay->records);
+    free(ctx_replay->buffer);
+    free(ctx_replay->path);
+    free(ctx->backend_data);
+    free(ctx);
+}
+
+const modbus_backend_t _modbus_replay_backend = {
+    _MODBUS_BACKEND_TYPE_REPLAY,
+    _MODBUS_RTU_HEADER_LENGTH,
+    _MODBUS_RTU_CHECKSUM_LENGTH,
+    MODBUS_RTU_MAX_ADU_LENGTH,
+    _modbus_set_slave,
+    _modbus_replay_build_request_basis,
+    _modbus_replay_build_response_basis,
+    _modbus_replay_prepare_response_tid,
+    _modbus_replay_send_msg_pre,
+    _modbus_replay_send,
+    _modbus_replay_receive,
+    _modbus_replay_recv,
+    _modbus_replay_check_integrity,
+    _modbus_replay_pre_check_confirmation,
+    _modbus_replay_connect,
+    _modbus_replay_close,
+    _modbus_replay_flush,
+    _modbus_replay_select,
+    _modbus_replay_free
+};
+
+modbus_t* modbus_new_replay(const char *path, int speed)
+{
+    modbus_t *ctx;
+    modbus_replay_t *ctx_replay;
+
+    if (path == NULL || (*path) == 0 ||
+        (speed != MODBUS_REPLAY_TIMED && speed != MODBUS_REPLAY_FAST)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ctx = (modbus_t *) malloc(sizeof(modbus_t));
+    _modbus_init_common(ctx);
+    ctx->backend = &_modbus_replay_backend;
+    ctx->backend_data = (modbus_replay_t *) malloc(sizeof(modbus_replay_t));
+    ctx_replay = (modbus_replay_t *)ctx->backend_data;
+    memset(ctx_replay, 0, sizeof(modbus_replay_t));
+
+    ctx_replay->path = (char *) malloc((strlen(path) + 1) * sizeof(char));
+    strcpy(ctx_replay->path, path);
+    ctx_replay->speed = speed;
+    ctx_replay->rx = -1;
+
+    return ctx;
+}
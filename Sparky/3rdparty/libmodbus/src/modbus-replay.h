@@ -0,0 +1,33 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef MODBUS_REPLAY_H
+#define MODBUS_REPLAY_H
+
+#include "modbus.h"
+
+MODBUS_BEGIN_DECLS
+
+/* Responses come back after the delay they had on the wire */
+#define MODBUS_REPLAY_TIMED   0
+/* Responses are available at once and missing ones time out at once */
+#define MODBUS_REPLAY_FAST    1
+
+MODBUS_API modbus_t* modbus_new_replay(const char *path, int speed);
+
+MODBUS_END_DECLS
+
+#endif /* MODBUS_REPLAY_H */
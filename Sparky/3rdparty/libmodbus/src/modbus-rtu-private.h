@@ -31,16 +31,32 @@
 #include <termios.h>
 #endif
 
+#if defined(__linux__)
+#include <time.h>
+#endif
+
 #define _MODBUS_RTU_HEADER_LENGTH      1
-#define _MODBUS_RTU_EXTENDED_LENGTH    10 // ADDED BY DKOH FOR MODBUS EXTENDED ADDRESS FOR SPARKY
 #define _MODBUS_RTU_PRESET_REQ_LENGTH  6
+/* Request header with an extended address */
+#define _MODBUS_RTU_EXTENDED_REQ_LENGTH (_MODBUS_RTU_PRESET_REQ_LENGTH + MODBUS_EXTENDED_ADDRESS_LENGTH)
 #define _MODBUS_RTU_PRESET_RSP_LENGTH  2
 #define _MODBUS_RTU_CHECKSUM_LENGTH    2
 
+/* modbus_set_slave() takes a larger slave as the serial number of an
+   extended address, as the Sparky analyzers always did */
+#define _MODBUS_RTU_MAX_STANDARD_SLAVE 256
+
+/* The analyzers compute the CRC of an extended response over its length
+   less the serial number, counted from the first byte */
+#define _MODBUS_RTU_EXTENDED_CRC_SKIP  MODBUS_EXTENDED_ADDRESS_LENGTH
+
 /* Time waited beetween the RTS switch before transmit data or after transmit
    data before to read */
 #define _MODBUS_RTU_TIME_BETWEEN_RTS_SWITCH 10000
 
+/* Inter-frame silence used above 19200 bauds (Modbus over serial line, 2.5.1.1) */
+#define _MODBUS_RTU_FIXED_FRAME_SILENCE 1750
+
 #if defined(_WIN32)
 #if !defined(ENOTSUP)
 #define ENOTSUP WSAEOPNOTSUPP
@@ -82,6 +98,17 @@ typedef struct _modbus_rtu {
 #if HAVE_DECL_TIOCM_RTS
     int rts;
     int onebyte_time;
+#endif
+    /* Silent interval (3.5 characters) between two frames in micro seconds */
+    int frame_silence;
+    /* Time in micro seconds to send one character */
+    int char_time;
+#if defined(__linux__)
+    /* Low latency profile, see modbus_rtu_set_low_latency() */
+    int low_latency;
+    int old_serial_flags;
+    /* End of the last frame seen on the line (monotonic clock) */
+    struct timespec last_activity;
 #endif
     /* To handle many slaves on the same link */
     int confirmation_to_ignore;
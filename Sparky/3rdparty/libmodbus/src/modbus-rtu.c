@@ -40,6 +40,11 @@
 #include <linux/serial.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
+
 /* Table of CRC values for high-order byte */
 static const uint8_t table_crc_hi[] = {
     0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
@@ -113,6 +118,7 @@ static int _modbus_set_slave(modbus_t *ctx, int slave)
     }*/
 
     ctx->slave = slave;
+    ctx->extended_length = (slave > _MODBUS_RTU_MAX_STANDARD_SLAVE) ? MODBUS_EXTENDED_ADDRESS_LENGTH : 0;
 
     return 0;
 }
@@ -120,32 +126,29 @@ static int _modbus_set_slave(modbus_t *ctx, int slave)
 /* Builds a RTU request header */
 static int _modbus_rtu_build_request_basis(modbus_t *ctx, int function, int addr, int nb, uint8_t *req)
 {
-    if (ctx->slave > 256) // DKOH : extended slaveid
-    {
-        req[0] = 0xFA;
-        req[1] = (ctx->slave>>24) & 0xFF;
-        req[2] = (ctx->slave>>16) & 0xFF;
-        req[3] = (ctx->slave>>8)  & 0xFF;
-        req[4] = (ctx->slave)     & 0xFF;
+    if (ctx->extended_length) {
+        req[0] = MODBUS_EXTENDED_ADDRESS;
+        req[1] = (ctx->slave >> 24) & 0xFF;
+        req[2] = (ctx->slave >> 16) & 0xFF;
+        req[3] = (ctx->slave >> 8) & 0xFF;
+        req[4] = ctx->slave & 0xFF;
         req[5] = function;
         req[6] = addr >> 8;
         req[7] = addr & 0x00ff;
         req[8] = nb >> 8;
         req[9] = nb & 0x00ff;
 
-        return _MODBUS_RTU_EXTENDED_LENGTH;
+        return _MODBUS_RTU_EXTENDED_REQ_LENGTH;
     }
-    else 
-    {
-        req[0] = ctx->slave;
-        req[1] = function;
-        req[2] = addr >> 8;
-        req[3] = addr & 0x00ff;
-        req[4] = nb >> 8;
-        req[5] = nb & 0x00ff;
 
-        return _MODBUS_RTU_PRESET_REQ_LENGTH;
-    }
+    req[0] = ctx->slave;
+    req[1] = function;
+    req[2] = addr >> 8;
+    req[3] = addr & 0x00ff;
+    req[4] = nb >> 8;
+    req[5] = nb & 0x00ff;
+
+    return _MODBUS_RTU_PRESET_REQ_LENGTH;
 }
 
 /* Builds a RTU response header */
@@ -293,6 +296,77 @@ static void _modbus_rtu_ioctl_rts(int fd, int on)
 }
 #endif
 
+#if defined(__linux__)
+/* Mark the line as busy until delay micro seconds from now */
+static void _modbus_rtu_mark_activity(modbus_rtu_t *ctx_rtu, int delay)
+{
+    struct timespec *t = &ctx_rtu->last_activity;
+
+    clock_gettime(CLOCK_MONOTONIC, t);
+    t->tv_nsec += (long)delay * 1000;
+    while (t->tv_nsec >= 1000000000) {
+        t->tv_nsec -= 1000000000;
+        t->tv_sec++;
+    }
+}
+
+/* Wait until the line has been silent for 3.5 characters so the previous
+   frame is complete for every device on the bus */
+static void _modbus_rtu_wait_frame_silence(modbus_rtu_t *ctx_rtu)
+{
+    struct timespec now;
+    struct timespec request;
+    long long elapsed;
+    long long remaining;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (long long)(now.tv_sec - ctx_rtu->last_activity.tv_sec) * 1000000 +
+              (now.tv_nsec - ctx_rtu->last_activity.tv_nsec) / 1000;
+    remaining = ctx_rtu->frame_silence - elapsed;
+    if (remaining <= 0) {
+        return;
+    }
+
+    request.tv_sec = remaining / 1000000;
+    request.tv_nsec = (remaining % 1000000) * 1000;
+    while (nanosleep(&request, &request) == -1 && errno == EINTR);
+}
+
+static ssize_t _modbus_rtu_send_low_latency(modbus_t *ctx, const uint8_t *req, int req_length)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    ssize_t size;
+
+    _modbus_rtu_wait_frame_silence(ctx_rtu);
+
+#if HAVE_DECL_TIOCM_RTS
+    if (ctx_rtu->low_latency != MODBUS_RTU_LOW_LATENCY_RS485 &&
+        ctx_rtu->rts != MODBUS_RTU_RTS_NONE) {
+        _modbus_rtu_ioctl_rts(ctx->s, ctx_rtu->rts == MODBUS_RTU_RTS_UP);
+        size = write(ctx->s, req, req_length);
+
+        /* Release the bus as soon as the UART is empty instead of after an
+           estimated transmit time and a fixed margin */
+        tcdrain(ctx->s);
+        _modbus_rtu_ioctl_rts(ctx->s, ctx_rtu->rts != MODBUS_RTU_RTS_UP);
+        _modbus_rtu_mark_activity(ctx_rtu, 0);
+
+        return size;
+    }
+#endif
+
+    /* In RS485 mode the driver raises RTS when the frame is queued and drops
+       it after the last stop bit */
+    size = write(ctx->s, req, req_length);
+
+    /* write() returns once the frame is queued, the line stays busy until the
+       last character has been shifted out */
+    _modbus_rtu_mark_activity(ctx_rtu, ctx_rtu->char_time * req_length);
+
+    return size;
+}
+#endif
+
 static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_length)
 {
 #if defined(_WIN32)
@@ -300,6 +374,11 @@ static ssize_t _modbus_rtu_send(modbus_t *ctx, const uint8_t *req, int req_lengt
     DWORD n_bytes = 0;
     return (WriteFile(ctx_rtu->w_ser.fd, req, req_length, &n_bytes, NULL)) ? (ssize_t)n_bytes : -1;
 #else
+#if defined(__linux__)
+    if (((modbus_rtu_t *)ctx->backend_data)->low_latency != MODBUS_RTU_LOW_LATENCY_OFF) {
+        return _modbus_rtu_send_low_latency(ctx, req, req_length);
+    }
+#endif
 #if HAVE_DECL_TIOCM_RTS
     modbus_rtu_t *ctx_rtu = ctx->backend_data;
     if (ctx_rtu->rts != MODBUS_RTU_RTS_NONE) {
@@ -354,6 +433,15 @@ static ssize_t _modbus_rtu_recv(modbus_t *ctx, uint16_t *rsp, int rsp_length)
 {
 #if defined(_WIN32)
     return win32_ser_read(&((modbus_rtu_t *)ctx->backend_data)->w_ser, rsp, rsp_length);
+#elif defined(__linux__)
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    ssize_t rc = read(ctx->s, rsp, rsp_length);
+
+    if (rc > 0 && ctx_rtu->low_latency != MODBUS_RTU_LOW_LATENCY_OFF) {
+        _modbus_rtu_mark_activity(ctx_rtu, 0);
+    }
+
+    return rc;
 #else
     return read(ctx->s, rsp, rsp_length);
 #endif
@@ -365,8 +453,9 @@ static int _modbus_rtu_pre_check_confirmation(modbus_t *ctx, const uint8_t *req,
                                               const uint8_t *rsp, int rsp_length)
 {
     /* Check responding slave is the slave we requested (except for broacast
-     * request) */
-    if (req[0] != rsp[0] && req[0] != MODBUS_BROADCAST_ADDRESS) {
+     * request), serial number included for an extended one */
+    if (req[0] != MODBUS_BROADCAST_ADDRESS &&
+        (rsp_length <= ctx->extended_length || memcmp(req, rsp, 1 + ctx->extended_length) != 0)) {
         if (ctx->debug) {
             fprintf(stderr,
                     "The responding slave %d isn't the requested slave %d\n",
@@ -388,7 +477,14 @@ static int _modbus_rtu_check_integrity(modbus_t *ctx, uint8_t *msg,
     uint16_t crc_calculated;
     uint16_t crc_received;
     int slave = msg[0];
-    if (msg[0] == 0xFA) slave = (msg[1]<<8) + (msg[2]<<8) + (msg[3]<<8) + (msg[4]); // DKOH
+    int crc_length = msg_length - 2;
+
+    if (ctx->extended_length) {
+        /* A standard frame can't be meant for an extended address */
+        slave = (msg[0] == MODBUS_EXTENDED_ADDRESS && msg_length > ctx->extended_length) ?
+            _MODBUS_EXTENDED_SLAVE(msg) : -1;
+        crc_length -= _MODBUS_RTU_EXTENDED_CRC_SKIP;
+    }
 
     /* Filter on the Modbus unit identifier (slave) in RTU mode to avoid useless
      * CRC computing. */
@@ -400,8 +496,7 @@ static int _modbus_rtu_check_integrity(modbus_t *ctx, uint8_t *msg,
         return 0;
     }
 
-    crc_calculated = crc16(msg, msg_length - 2);
-    if (msg[0] == 0xFA) crc_calculated = crc16(msg, msg_length - (2+4));
+    crc_calculated = crc16(msg, crc_length);
     crc_received = (msg[msg_length - 2] << 8) | msg[msg_length - 1];
 
 	ctx->last_crc_expected = crc_calculated;
@@ -1059,6 +1154,217 @@ int modbus_rtu_get_rts(modbus_t *ctx)
     }
 }
 
+#if defined(__linux__)
+static int _modbus_rtu_apply_low_latency(modbus_t *ctx, int mode)
+{
+    modbus_rtu_t *ctx_rtu = ctx->backend_data;
+    struct serial_struct serial;
+    struct serial_rs485 rs485conf;
+
+    memset(&rs485conf, 0x0, sizeof(struct serial_rs485));
+    if (mode == MODBUS_RTU_LOW_LATENCY_RS485) {
+        /* RTS follows the transmitter, no delay before or after the frame */
+        rs485conf.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        rs485conf.delay_rts_before_send = 0;
+        rs485conf.delay_rts_after_send = 0;
+        if (ioctl(ctx->s, TIOCSRS485, &rs485conf) < 0) {
+            return -1;
+        }
+    } else if (ctx_rtu->low_latency == MODBUS_RTU_LOW_LATENCY_RS485) {
+        if (ioctl(ctx->s, TIOCSRS485, &rs485conf) < 0) {
+            return -1;
+        }
+    }
+
+    /* Drivers of USB adapters map this flag to their shortest latency timer
+       (FTDI: 1 ms instead of 16 ms). Not all drivers support it, the frame
+       pacing is still used without it. */
+    if (ioctl(ctx->s, TIOCGSERIAL, &serial) == 0) {
+        if (ctx_rtu->low_latency == MODBUS_RTU_LOW_LATENCY_OFF) {
+            ctx_rtu->old_serial_flags = serial.flags;
+        }
+
+        if (mode == MODBUS_RTU_LOW_LATENCY_OFF) {
+            serial.flags &= ~ASYNC_LOW_LATENCY;
+            serial.flags |= ctx_rtu->old_serial_flags & ASYNC_LOW_LATENCY;
+        } else {
+            serial.flags |= ASYNC_LOW_LATENCY;
+        }
+
+        if (ioctl(ctx->s, TIOCSSERIAL, &serial) < 0 && ctx->debug) {
+            fprintf(stderr, "Unable to set the low latency flag\n");
+        }
+    } else if (ctx->debug) {
+        fprintf(stderr, "The low latency flag isn't supported by this port\n");
+    }
+
+    ctx_rtu->low_latency = mode;
+
+    return 0;
+}
+#endif
+
+int modbus_rtu_set_low_latency(modbus_t *ctx, int mode)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+#if defined(__linux__)
+        if (mode == MODBUS_RTU_LOW_LATENCY_OFF || mode == MODBUS_RTU_LOW_LATENCY_ON ||
+            mode == MODBUS_RTU_LOW_LATENCY_RS485) {
+            return _modbus_rtu_apply_low_latency(ctx, mode);
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+#else
+        if (ctx->debug) {
+            fprintf(stderr, "This function isn't supported on your platform\n");
+        }
+        errno = ENOTSUP;
+        return -1;
+#endif
+    }
+    /* Wrong backend or invalid mode specified */
+    errno = EINVAL;
+    return -1;
+}
+
+int modbus_rtu_get_low_latency(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+#if defined(__linux__)
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        return ctx_rtu->low_latency;
+#else
+        return MODBUS_RTU_LOW_LATENCY_OFF;
+#endif
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int modbus_rtu_get_frame_silence(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type == _MODBUS_BACKEND_TYPE_RTU) {
+        modbus_rtu_t *ctx_rtu = ctx->backend_data;
+        return ctx_rtu->frame_silence;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Character time, inter-frame silence and the estimated time to send one
+   byte in micro seconds, from the line settings */
+static void _modbus_rtu_set_timing(modbus_rtu_t *ctx_rtu)
+{
+    const int bits = 1 + ctx_rtu->data_bit + (ctx_rtu->parity == 'N' ? 0 : 1) + ctx_rtu->stop_bit;
+    const int baud = ctx_rtu->baud;
+
+#if HAVE_DECL_TIOCM_RTS
+    ctx_rtu->onebyte_time = (1000 * 1000) * bits / baud;
+#endif
+
+    ctx_rtu->char_time = (1000 * 1000) * bits / baud;
+    if (baud > 19200) {
+        ctx_rtu->frame_silence = _MODBUS_RTU_FIXED_FRAME_SILENCE;
+    } else {
+        /* 3.5 characters, rounded up */
+        ctx_rtu->frame_silence = ((7 * 1000 * 1000) * bits + 2 * baud - 1) / (2 * baud);
+    }
+}
+
+static int _modbus_rtu_is_open(modbus_t *ctx)
+{
+#if defined(_WIN32)
+    return ((modbus_rtu_t *)ctx->backend_data)->w_ser.fd != INVALID_HANDLE_VALUE;
+#else
+    return ctx->s != -1;
+#endif
+}
+
+static void _modbus_rtu_close(modbus_t *ctx);
+
+/* The line settings are applied when the port is opened, an open port is
+   reopened at the new rate with its low latency profile */
+int modbus_rtu_set_baud(modbus_t *ctx, int baud)
+{
+    modbus_rtu_t *ctx_rtu;
+    int old_baud;
+    int is_open;
+    int low_latency = MODBUS_RTU_LOW_LATENCY_OFF;
+
+    if (ctx == NULL || baud <= 0 ||
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx_rtu = ctx->backend_data;
+    if (baud == ctx_rtu->baud) {
+        return 0;
+    }
+
+    old_baud = ctx_rtu->baud;
+    is_open = _modbus_rtu_is_open(ctx);
+#if defined(__linux__)
+    low_latency = ctx_rtu->low_latency;
+#endif
+    if (is_open) {
+        _modbus_rtu_close(ctx);
+    }
+
+    ctx_rtu->baud = baud;
+    _modbus_rtu_set_timing(ctx_rtu);
+    if (!is_open) {
+        return 0;
+    }
+
+    if (_modbus_rtu_connect(ctx) == -1) {
+        int saved_errno = errno;
+
+        /* Back to the rate that worked */
+        ctx_rtu->baud = old_baud;
+        _modbus_rtu_set_timing(ctx_rtu);
+        if (_modbus_rtu_connect(ctx) == 0 && low_latency != MODBUS_RTU_LOW_LATENCY_OFF) {
+            modbus_rtu_set_low_latency(ctx, low_latency);
+        }
+        errno = saved_errno;
+        return -1;
+    }
+
+    if (low_latency != MODBUS_RTU_LOW_LATENCY_OFF) {
+        modbus_rtu_set_low_latency(ctx, low_latency);
+    }
+
+    return 0;
+}
+
+int modbus_rtu_get_baud(modbus_t *ctx)
+{
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ((modbus_rtu_t *)ctx->backend_data)->baud;
+}
+
 static void _modbus_rtu_close(modbus_t *ctx)
 {
     /* Restore line settings and close file descriptor in RTU mode */
@@ -1075,8 +1381,14 @@ static void _modbus_rtu_close(modbus_t *ctx)
         fprintf(stderr, "ERROR Error while closing handle (LastError %d)\n",
                 (int)GetLastError());
     }
+    ctx_rtu->w_ser.fd = INVALID_HANDLE_VALUE;
 #else
     if (ctx->s != -1) {
+#if defined(__linux__)
+        if (ctx_rtu->low_latency != MODBUS_RTU_LOW_LATENCY_OFF) {
+            _modbus_rtu_apply_low_latency(ctx, MODBUS_RTU_LOW_LATENCY_OFF);
+        }
+#endif
         tcsetattr(ctx->s, TCSANOW, &(ctx_rtu->old_tios));
         close(ctx->s);
         ctx->s = -1;
@@ -1206,6 +1518,10 @@ modbus_t* modbus_new_rtu(const char *device,
     ctx_rtu->data_bit = data_bit;
     ctx_rtu->stop_bit = stop_bit;
 
+#if defined(_WIN32)
+    win32_ser_init(&ctx_rtu->w_ser);
+#endif
+
 #if HAVE_DECL_TIOCSRS485
     /* The RS232 mode has been set by default */
     ctx_rtu->serial_mode = MODBUS_RTU_RS232;
@@ -1214,9 +1530,15 @@ modbus_t* modbus_new_rtu(const char *device,
 #if HAVE_DECL_TIOCM_RTS
     /* The RTS use has been set by default */
     ctx_rtu->rts = MODBUS_RTU_RTS_NONE;
+#endif
+
+    _modbus_rtu_set_timing(ctx_rtu);
 
-    /* Calculate estimated time in micro second to send one byte */
-    ctx_rtu->onebyte_time = (1000 * 1000) * (1 + data_bit + (parity == 'N' ? 0 : 1) + stop_bit) / baud;
+#if defined(__linux__)
+    ctx_rtu->low_latency = MODBUS_RTU_LOW_LATENCY_OFF;
+    ctx_rtu->old_serial_flags = 0;
+    ctx_rtu->last_activity.tv_sec = 0;
+    ctx_rtu->last_activity.tv_nsec = 0;
 #endif
 
     ctx_rtu->confirmation_to_ignore = FALSE;
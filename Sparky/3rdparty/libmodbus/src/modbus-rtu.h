@@ -44,6 +44,17 @@ MODBUS_API int modbus_rtu_get_serial_mode(modbus_t *ctx);
 MODBUS_API int modbus_rtu_set_rts(modbus_t *ctx, int mode);
 MODBUS_API int modbus_rtu_get_rts(modbus_t *ctx);
 
+#define MODBUS_RTU_LOW_LATENCY_OFF   0
+#define MODBUS_RTU_LOW_LATENCY_ON    1
+#define MODBUS_RTU_LOW_LATENCY_RS485 2
+
+MODBUS_API int modbus_rtu_set_low_latency(modbus_t *ctx, int mode);
+MODBUS_API int modbus_rtu_get_low_latency(modbus_t *ctx);
+MODBUS_API int modbus_rtu_get_frame_silence(modbus_t *ctx);
+
+MODBUS_API int modbus_rtu_set_baud(modbus_t *ctx, int baud);
+MODBUS_API int modbus_rtu_get_baud(modbus_t *ctx);
+
 MODBUS_END_DECLS
 
 #endif /* MODBUS_RTU_H */
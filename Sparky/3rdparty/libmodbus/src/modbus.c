@@ -29,6 +29,9 @@
 #ifndef _MSC_VER
 #include <unistd.h>
 #endif
+#if defined(_WIN32)
+#include <windows.h>
+#endif
 
 #include <config.h>
 
@@ -43,8 +46,6 @@ const unsigned int libmodbus_version_major = LIBMODBUS_VERSION_MAJOR;
 const unsigned int libmodbus_version_minor = LIBMODBUS_VERSION_MINOR;
 const unsigned int libmodbus_version_micro = LIBMODBUS_VERSION_MICRO;
 
-#define MAX_MODBUS_ID 256
-
 /* Max between RTU and TCP max adu length (so TCP) */
 #define MAX_MESSAGE_LENGTH 260
 
@@ -55,6 +56,22 @@ typedef enum {
     _STEP_DATA
 } _step_t;
 
+/* Position of the function code, the serial number of an extended address
+   sits between the slave byte and the function */
+static int function_offset(modbus_t *ctx)
+{
+    return ctx->backend->header_length + ctx->extended_length;
+}
+
+/* Slave a request or response was addressed to */
+static int frame_slave(modbus_t *ctx, const uint8_t *msg)
+{
+    if (ctx->extended_length)
+        return _MODBUS_EXTENDED_SLAVE(msg);
+
+    return msg[ctx->backend->header_length - 1];
+}
+
 const char *modbus_strerror(int errnum) {
     switch (errnum) {
     case EMBXILFUN:
@@ -143,8 +160,7 @@ int modbus_flush(modbus_t *ctx)
 static unsigned int compute_response_length_from_request(modbus_t *ctx, uint8_t *req)
 {
     int length;
-    int offset = ctx->backend->header_length;
-	if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+    int offset = function_offset(ctx);
 
     switch (req[offset]) {
     case MODBUS_FC_READ_COILS:
@@ -177,6 +193,55 @@ static unsigned int compute_response_length_from_request(modbus_t *ctx, uint8_t
     return offset + length + ctx->backend->checksum_length;
 }
 
+/* Monotonic time in micro seconds for the transaction monitor */
+uint64_t _modbus_time_us(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void _modbus_report_transaction(modbus_t *ctx, int rsp_length, int error)
+{
+    int saved_errno = errno;
+
+    ctx->transaction_pending = FALSE;
+    ctx->transaction.rsp_length = rsp_length;
+    ctx->transaction.error = error;
+    ctx->transaction.done = _modbus_time_us();
+    ctx->monitor_transaction(ctx, &ctx->transaction);
+
+    errno = saved_errno;
+}
+
+static void _modbus_capture(modbus_t *ctx, int direction, const uint8_t *data, int length)
+{
+    uint8_t record[_MODBUS_CAPTURE_RECORD_LENGTH];
+    uint64_t t = _modbus_time_us() - ctx->capture_origin;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        record[i] = (uint8_t)(t >> (8 * i));
+    record[8] = length & 0xFF;
+    record[9] = (length >> 8) & 0xFF;
+    record[10] = (uint8_t)direction;
+    record[11] = 0;
+
+    fwrite(record, 1, sizeof(record), ctx->capture);
+    fwrite(data, 1, length, ctx->capture);
+}
+
 /* Sends a request/response */
 static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
 {
@@ -218,6 +283,27 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
     } while ((ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) &&
              rc == -1);
 
+    if (ctx->capture && rc > 0) {
+        _modbus_capture(ctx, _MODBUS_CAPTURE_TX, msg, rc);
+    }
+
+    if (ctx->monitor_transaction) {
+        int offset = function_offset(ctx);
+
+        memset(&ctx->transaction, 0, sizeof(modbus_transaction_t));
+        ctx->transaction.slave = ctx->slave;
+        ctx->transaction.function = msg[offset];
+        ctx->transaction.req_length = msg_length;
+        ctx->transaction.sent = _modbus_time_us();
+        ctx->transaction_pending = TRUE;
+
+        if (rc == -1) {
+            _modbus_report_transaction(ctx, 0, errno);
+        } else if (rc != msg_length) {
+            _modbus_report_transaction(ctx, 0, EMBBADDATA);
+        }
+    }
+
     if (rc > 0 && rc != msg_length) {
         errno = EMBBADDATA;
         return -1;
@@ -308,19 +394,18 @@ static uint8_t compute_meta_length_after_function(int function,
 /* Computes the length to read after the meta information (address, count, etc) */
 static int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,msg_type_t msg_type)
 {
-    int function = msg[ctx->backend->header_length];
-    //if (ctx->slave > 99) function = msg[ctx->backend->header_length + 4]; // DKOH
-    if (ctx->slave > MAX_MODBUS_ID) function = msg[ctx->backend->header_length + 4]; // DKOH
+    int offset = function_offset(ctx);
+    int function = msg[offset];
     int length;
 
     if (msg_type == MSG_INDICATION) {
         switch (function) {
         case MODBUS_FC_WRITE_MULTIPLE_COILS:
         case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
-            length = msg[ctx->backend->header_length + 5];
+            length = msg[offset + 5];
             break;
         case MODBUS_FC_WRITE_AND_READ_REGISTERS:
-            length = msg[ctx->backend->header_length + 9];
+            length = msg[offset + 9];
             break;
         default:
             length = 0;
@@ -330,8 +415,7 @@ static int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,msg_type_t
         if (function <= MODBUS_FC_READ_INPUT_REGISTERS ||
             function == MODBUS_FC_REPORT_SLAVE_ID ||
             function == MODBUS_FC_WRITE_AND_READ_REGISTERS) {
-            length = msg[ctx->backend->header_length + 1];
-            if (ctx->slave > MAX_MODBUS_ID) length = msg[ctx->backend->header_length + 1 + 4]; // DKOH
+            length = msg[offset + 1];
         } else {
             length = 0;
         }
@@ -356,7 +440,7 @@ static int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,msg_type_t
    - read() or recv() error codes
 */
 
-int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
+static int receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
 {
     int rc;
     fd_set rset;
@@ -382,8 +466,7 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
      * to reach the function code because all packets contain this
      * information. */
     step = _STEP_FUNCTION;
-    length_to_read = ctx->backend->header_length + 1;
-    if (ctx->slave > MAX_MODBUS_ID) length_to_read = ctx->backend->header_length + 1 + 4; //DKOH
+    length_to_read = function_offset(ctx) + 1;
 
 #if 0
     if (msg_type == MSG_INDICATION) {
@@ -439,6 +522,17 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
             return -1;
         }
 
+        if (ctx->capture) {
+            _modbus_capture(ctx, _MODBUS_CAPTURE_RX, msg + msg_length, rc);
+        }
+
+        if (ctx->transaction_pending && msg_type == MSG_CONFIRMATION) {
+            ctx->transaction.last_byte = _modbus_time_us();
+            if (msg_length == 0) {
+                ctx->transaction.first_byte = ctx->transaction.last_byte;
+            }
+        }
+
 		/* -- BEGIN QMODBUS MODIFICATION -- */
         if (ctx->monitor_raw_data) {
 		    ctx->monitor_raw_data(ctx, msg + msg_length, rc, ( step == _STEP_DATA && length_to_read-rc == 0 ) ? 1 : 0 );
@@ -461,9 +555,7 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
             switch (step) {
             case _STEP_FUNCTION:
                 /* Function code position */
-                //length_to_read = compute_meta_length_after_function(msg[ctx->backend->header_length], msg_type );
-                //length_to_read = compute_meta_length_after_function( (ctx->slave > 99) ? msg[ctx->backend->header_length + 4] : msg[ctx->backend->header_length], msg_type ); // DKOH
-                length_to_read = compute_meta_length_after_function( (ctx->slave > MAX_MODBUS_ID) ? msg[ctx->backend->header_length + 4] : msg[ctx->backend->header_length], msg_type ); // DKOH
+                length_to_read = compute_meta_length_after_function(msg[function_offset(ctx)], msg_type);
                 if (length_to_read != 0) {
                     step = _STEP_META;
                     break;
@@ -501,6 +593,30 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
     return ctx->backend->check_integrity(ctx, msg, msg_length);
 }
 
+int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
+{
+    int rc = receive_msg(ctx, msg, msg_type);
+
+    if (ctx->transaction_pending && msg_type == MSG_CONFIRMATION) {
+        if (ctx->monitor_transaction) {
+            /* A confirmation of another slave is ignored by the integrity check */
+            _modbus_report_transaction(ctx, (rc > 0) ? rc : 0,
+                                       (rc > 0) ? 0 : ((rc == 0) ? EMBBADSLAVE : errno));
+        }
+        ctx->transaction_pending = FALSE;
+    }
+
+    /* The frames of the exchange reach the disk even if the process dies
+       before the capture is closed */
+    if (ctx->capture) {
+        int saved_errno = errno;
+        fflush(ctx->capture);
+        errno = saved_errno;
+    }
+
+    return rc;
+}
+
 /* Receive the request from a modbus master */
 int modbus_receive(modbus_t *ctx, uint8_t *req)
 {
@@ -535,16 +651,14 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
 {
     int rc;
     int rsp_length_computed;
-    int offset = ctx->backend->header_length;
-	if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+    int offset = function_offset(ctx);
     int function = rsp[offset];
 
 	/* BEGIN QMODBUS MODIFICATION */
 	int s_crc = 0; /* TODO */
     if (ctx->monitor_add_item) {
         ctx->monitor_add_item(ctx, 1,
-				//req[offset - 1], DKOH
-				(req[0] == 0xFA) ? (req[1] << 8) + (req[2]<< 8) + (req[3]<< 8) + (req[4]) : req[offset - 1], // DKOH
+                frame_slave(ctx, req),
                 req[offset],  /* func */
                 ( req[offset + 1] << 8 ) + req[offset + 2], /* addr */
                 ( req[offset + 3] << 8 ) + req[offset + 4], /* nb */
@@ -662,7 +776,7 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
 				break;
 		}
         if (ctx->monitor_add_item) {
-            ctx->monitor_add_item(ctx, 0, (rsp[0] == 0xFA) ? (rsp[1] << 8) + (rsp[2]<< 8) + (rsp[3]<< 8) + (rsp[4]) : rsp[offset-1], rsp[offset+0],
+            ctx->monitor_add_item(ctx, 0, frame_slave(ctx, rsp), rsp[offset+0],
 						   addr, num_items,
 							ctx->last_crc_expected,
 							ctx->last_crc_received
@@ -755,8 +869,7 @@ static int response_exception(modbus_t *ctx, sft_t *sft,
 int modbus_reply(modbus_t *ctx, const uint8_t *req,
                  int req_length, modbus_mapping_t *mb_mapping)
 {
-    int offset = ctx->backend->header_length;
-	if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+    int offset = function_offset(ctx);
     int slave = req[offset - 1];
     int function = req[offset];
     uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
@@ -1140,8 +1253,7 @@ int modbus_reply(modbus_t *ctx, const uint8_t *req,
 int modbus_reply_exception(modbus_t *ctx, const uint8_t *req,
                            unsigned int exception_code)
 {
-    int offset = ctx->backend->header_length;
-	if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+    int offset = function_offset(ctx);
     int slave = req[offset - 1];
     int function = req[offset];
     uint8_t rsp[MAX_MESSAGE_LENGTH];
@@ -1196,8 +1308,7 @@ static int read_io_status(modbus_t *ctx, int function,
         if (rc == -1)
             return -1;
 
-        offset = ctx->backend->header_length + 2;
-		if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+        offset = function_offset(ctx) + 2;
         offset_end = offset + rc;
         for (i = offset; i < offset_end; i++) {
             /* Shift reg hi_byte to temp */
@@ -1307,8 +1418,7 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb,uint16_t
         if (rc == -1)
             return -1;
 
-        offset = ctx->backend->header_length;
-		if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+        offset = function_offset(ctx);
 
         for (i = 0; i < rc; i++) {
             /* shift reg hi_byte to temp OR with lo_byte */
@@ -1369,6 +1479,69 @@ int modbus_read_input_registers(modbus_t *ctx, int addr, int nb,uint16_t *dest)
     return status;
 }
 
+/* Reads registers of any number of devices back to back, each request with
+   its own address, so the slave of the context is left as it was. Once a
+   device times out its remaining requests are not sent: a device that is
+   gone costs one response timeout per batch, not one per request.
+
+   Returns the number of requests that succeeded, the outcome of each one is
+   in its rc and error fields. */
+int modbus_read_batch(modbus_t *ctx, modbus_read_request_t *requests, int nb_requests)
+{
+    int slave;
+    int extended_length;
+    int nb_done = 0;
+    int i;
+    int j;
+
+    if (ctx == NULL || (requests == NULL && nb_requests > 0) || nb_requests < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    slave = ctx->slave;
+    extended_length = ctx->extended_length;
+
+    for (i = 0; i < nb_requests; i++) {
+        modbus_read_request_t *request = &requests[i];
+        int is_gone = FALSE;
+        int rc;
+
+        for (j = 0; j < i && !is_gone; j++) {
+            is_gone = requests[j].slave == request->slave &&
+                      requests[j].extended == request->extended &&
+                      requests[j].error == ETIMEDOUT;
+        }
+
+        if (is_gone) {
+            errno = ETIMEDOUT;
+            rc = -1;
+        } else if (request->function != MODBUS_FC_READ_HOLDING_REGISTERS &&
+                   request->function != MODBUS_FC_READ_INPUT_REGISTERS) {
+            errno = EINVAL;
+            rc = -1;
+        } else {
+            rc = request->extended ? modbus_set_extended_slave(ctx, request->slave) :
+                                     modbus_set_slave(ctx, request->slave);
+            if (rc != -1) {
+                rc = (request->function == MODBUS_FC_READ_HOLDING_REGISTERS) ?
+                    modbus_read_registers(ctx, request->addr, request->nb, request->dest) :
+                    modbus_read_input_registers(ctx, request->addr, request->nb, request->dest);
+            }
+        }
+
+        request->rc = rc;
+        request->error = (rc == -1) ? errno : 0;
+        if (rc != -1)
+            nb_done++;
+    }
+
+    ctx->slave = slave;
+    ctx->extended_length = extended_length;
+
+    return nb_done;
+}
+
 /* Write a value to the specified register of the remote device.
    Used by write_bit and write_register */
 static int write_single(modbus_t *ctx, int function, int addr, int value)
@@ -1635,8 +1808,7 @@ int modbus_write_and_read_registers(modbus_t *ctx,
         if (rc == -1)
             return -1;
 
-        offset = ctx->backend->header_length;
-		if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+        offset = function_offset(ctx);
         for (i = 0; i < rc; i++) {
             /* shift reg hi_byte to temp OR with lo_byte */
             dest[i] = (rsp[offset + 2 + (i << 1)] << 8) |
@@ -1680,8 +1852,7 @@ int modbus_report_slave_id(modbus_t *ctx, int max_dest, uint8_t *dest)
         if (rc == -1)
             return -1;
 
-        offset = ctx->backend->header_length + 2;
-		if (ctx->slave > MAX_MODBUS_ID) offset+=4; // DKOH
+        offset = function_offset(ctx) + 2;
 
         /* Byte count, slave id, run indicator status and
            additional data. Truncate copy to max_dest. */
@@ -1697,6 +1868,7 @@ void _modbus_init_common(modbus_t *ctx)
 {
     /* Slave and socket are initialized to -1 */
     ctx->slave = -1;
+    ctx->extended_length = 0;
     ctx->s = -1;
 
     ctx->debug = FALSE;
@@ -1710,6 +1882,10 @@ void _modbus_init_common(modbus_t *ctx)
 
     ctx->monitor_add_item = NULL;
     ctx->monitor_raw_data = NULL;
+    ctx->monitor_transaction = NULL;
+    ctx->transaction_pending = FALSE;
+    ctx->capture = NULL;
+    ctx->capture_origin = 0;
 }
 
 /* Define the slave number */
@@ -1723,6 +1899,47 @@ int modbus_set_slave(modbus_t *ctx, int slave)
     return ctx->backend->set_slave(ctx, slave);
 }
 
+int modbus_get_slave(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ctx->slave;
+}
+
+/* Addresses the following requests to the device with this serial number,
+   framed with MODBUS_EXTENDED_ADDRESS. Only the RTU framing knows it. */
+int modbus_set_extended_slave(modbus_t *ctx, int serial_number)
+{
+    if (ctx == NULL || serial_number < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_RTU &&
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_REPLAY) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    ctx->slave = serial_number;
+    ctx->extended_length = MODBUS_EXTENDED_ADDRESS_LENGTH;
+
+    return 0;
+}
+
+int modbus_is_extended_slave(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ctx->extended_length ? TRUE : FALSE;
+}
+
 int modbus_set_error_recovery(modbus_t *ctx,
                               modbus_error_recovery_mode error_recovery)
 {
@@ -1842,6 +2059,9 @@ void modbus_free(modbus_t *ctx)
     if (ctx == NULL)
         return;
 
+    if (ctx->capture)
+        fclose(ctx->capture);
+
     ctx->backend->free(ctx);
 }
 
@@ -2008,6 +2228,57 @@ void modbus_register_monitor_raw_data_fnc(modbus_t *ctx,
     } 
 } 
 
+/* Records every frame sent and every chunk received to path, NULL stops the
+   capture. The file can be served back by modbus_new_replay(). */
+int modbus_set_capture(modbus_t *ctx, const char *path)
+{
+    uint8_t header[_MODBUS_CAPTURE_HEADER_LENGTH];
+    FILE *file;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->capture) {
+        fclose(ctx->capture);
+        ctx->capture = NULL;
+    }
+
+    if (path == NULL)
+        return 0;
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+        return -1;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, _MODBUS_CAPTURE_MAGIC, _MODBUS_CAPTURE_MAGIC_LENGTH);
+    header[8] = _MODBUS_CAPTURE_VERSION;
+    header[10] = (uint8_t)ctx->backend->backend_type;
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        int saved_errno = errno;
+        fclose(file);
+        errno = saved_errno;
+        return -1;
+    }
+
+    ctx->capture = file;
+    ctx->capture_origin = _modbus_time_us();
+
+    return 0;
+}
+
+void modbus_register_monitor_transaction_fnc(modbus_t *ctx,
+                                             modbus_monitor_transaction_fnc_t cb)
+{
+    if (ctx) {
+        ctx->monitor_transaction = cb;
+        ctx->transaction_pending = FALSE;
+    }
+}
+
 void modbus_poll(modbus_t* ctx)
 {
 	uint8_t msg[MAX_MESSAGE_LENGTH];
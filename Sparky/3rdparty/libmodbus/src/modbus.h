@@ -85,6 +85,12 @@ MODBUS_BEGIN_DECLS
 
 #define MODBUS_BROADCAST_ADDRESS    0
 
+/* Extended address of the Sparky analyzers (RTU only): this byte in place
+ * of the slave, then the 32 bit serial number of the device, big endian.
+ * A device is reached by its serial number whatever its slave address. */
+#define MODBUS_EXTENDED_ADDRESS         0xFA
+#define MODBUS_EXTENDED_ADDRESS_LENGTH  4
+
 /* Modbus_Application_Protocol_V1_1b.pdf (chapter 6 section 1 page 12)
  * Quantity of Coils to read (2 bytes): 1 to 2000 (0x7D0)
  * (chapter 6 section 11 page 29)
@@ -180,12 +186,49 @@ typedef enum
 } modbus_error_recovery_mode;
 
 typedef void (*modbus_monitor_add_item_fnc_t)(modbus_t *ctx,
-        uint8_t isOut, uint16_t slave, uint8_t func, uint16_t addr, uint16_t nb,
+        uint8_t isOut, uint32_t slave, uint8_t func, uint16_t addr, uint16_t nb,
         uint16_t expectedCRC, uint16_t actualCRC );
 typedef void (*modbus_monitor_raw_data_fnc_t)(modbus_t *ctx,
         uint8_t *data, uint8_t dataLen, uint8_t addNewline);
 
+/* Timing of a request and its confirmation. Times are micro seconds on a
+   monotonic clock, first_byte and last_byte are 0 when nothing was read. */
+typedef struct {
+    int slave;
+    int function;
+    int req_length;
+    int rsp_length;
+    uint64_t sent;
+    uint64_t first_byte;
+    uint64_t last_byte;
+    uint64_t done;
+    /* 0 or the errno of the failure (ETIMEDOUT, EMBBADCRC, ...) */
+    int error;
+} modbus_transaction_t;
+
+typedef void (*modbus_monitor_transaction_fnc_t)(modbus_t *ctx,
+        const modbus_transaction_t *transaction);
+
+/* One register read of modbus_read_batch(), rc and error are filled in */
+typedef struct {
+    /* Slave address, or serial number when extended is TRUE */
+    int slave;
+    int extended;
+    /* MODBUS_FC_READ_HOLDING_REGISTERS or MODBUS_FC_READ_INPUT_REGISTERS */
+    int function;
+    int addr;
+    int nb;
+    uint16_t *dest;
+    /* Registers read or -1 */
+    int rc;
+    /* 0 or the errno of the failure */
+    int error;
+} modbus_read_request_t;
+
 MODBUS_API int modbus_set_slave(modbus_t *ctx, int slave);
+MODBUS_API int modbus_get_slave(modbus_t *ctx);
+MODBUS_API int modbus_set_extended_slave(modbus_t *ctx, int serial_number);
+MODBUS_API int modbus_is_extended_slave(modbus_t *ctx);
 MODBUS_API int modbus_set_error_recovery(modbus_t *ctx, modbus_error_recovery_mode error_recovery);
 MODBUS_API int modbus_set_socket(modbus_t *ctx, int s);
 MODBUS_API int modbus_get_socket(modbus_t *ctx);
@@ -212,6 +255,7 @@ MODBUS_API int modbus_read_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest);
 MODBUS_API int modbus_read_input_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest);
 MODBUS_API int modbus_read_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest);
 MODBUS_API int modbus_read_input_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest);
+MODBUS_API int modbus_read_batch(modbus_t *ctx, modbus_read_request_t *requests, int nb_requests);
 MODBUS_API int modbus_write_bit(modbus_t *ctx, int coil_addr, int status);
 MODBUS_API int modbus_write_register(modbus_t *ctx, int reg_addr, int value);
 MODBUS_API int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *data);
@@ -240,6 +284,9 @@ MODBUS_API void modbus_register_monitor_add_item_fnc(modbus_t *ctx,
                                                     modbus_monitor_add_item_fnc_t cb); 
 MODBUS_API void modbus_register_monitor_raw_data_fnc(modbus_t *ctx,
                                                     modbus_monitor_raw_data_fnc_t cb); 
+MODBUS_API void modbus_register_monitor_transaction_fnc(modbus_t *ctx,
+                                                       modbus_monitor_transaction_fnc_t cb);
+MODBUS_API int modbus_set_capture(modbus_t *ctx, const char *path);
 
 void modbus_poll(modbus_t *ctx);
 
@@ -270,6 +317,7 @@ MODBUS_API void modbus_set_float_dcba(float f, uint16_t *dest);
 #include "modbus-tcp.h"
 #include "modbus-rtu.h"
 #include "modbus-ascii.h"
+#include "modbus-replay.h"
 
 MODBUS_END_DECLS
 
@@ -0,0 +1,475 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#include <modbus.h>
+
+/* Per sample path of a Sparky loop, measured on a replayed bus so that no
+   rig is needed. Results are written in the JSON layout of Google
+   Benchmark so that the usual compare tools can diff two runs. */
+
+#define MAX_BENCHMARKS      32
+/* temperature, frequency, oil rp, measured and trimmed ai */
+#define READS_PER_PIPE      5
+#define FLOAT_ITERATIONS    1000000
+#define FORMAT_ITERATIONS   200000
+#define FILE_ITERATIONS     20000
+#define CRC_ITERATIONS      200000
+#define FRAME_ITERATIONS    50000
+#define CYCLE_ITERATIONS    2000
+
+typedef struct {
+    char name[64];
+    long iterations;
+    double real_ns;
+    double cpu_ns;
+} result_t;
+
+static result_t results[MAX_BENCHMARKS];
+static int nb_results = 0;
+static char tmp_dir[256] = "/tmp";
+static volatile double sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double cpu_ns(void)
+{
+    return (double)clock() * 1e9 / CLOCKS_PER_SEC;
+}
+
+typedef void (*bench_fnc_t)(void *arg, long iterations);
+
+static void run(const char *name, bench_fnc_t fnc, void *arg, long iterations)
+{
+    result_t *result = &results[nb_results++];
+    double real_start = now_ns();
+    double cpu_start = cpu_ns();
+
+    fnc(arg, iterations);
+
+    result->real_ns = (now_ns() - real_start) / iterations;
+    result->cpu_ns = (cpu_ns() - cpu_start) / iterations;
+    result->iterations = iterations;
+    strncpy(result->name, name, sizeof(result->name) - 1);
+
+    fprintf(stderr, "%-32s %12.1f ns %12ld\n", name, result->real_ns, iterations);
+}
+
+static uint16_t crc16(const uint8_t *buffer, int length)
+{
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    while (length--) {
+        crc ^= *buffer++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+static void put(FILE *file, uint64_t value, int size)
+{
+    int i;
+    for (i = 0; i < size; i++)
+        fputc((int)((value >> (8 * i)) & 0xFF), file);
+}
+
+static void put_frame(FILE *file, uint64_t t, int direction, uint8_t *frame, int length)
+{
+    uint16_t crc = crc16(frame, length);
+
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    put(file, t, 8);
+    put(file, length, 2);
+    put(file, direction, 1);
+    put(file, 0, 1);
+    fwrite(frame, 1, length, file);
+}
+
+/* Writes the capture of cycles x pipes x READS_PER_PIPE float reads in the
+   order a loop issues them, see modbus_set_capture(3) for the layout */
+static int write_capture(const char *path, int nb_pipes, long cycles)
+{
+    FILE *file = fopen(path, "wb");
+    uint64_t t = 0;
+    long cycle;
+    int pipe;
+    int read;
+
+    if (file == NULL)
+        return -1;
+
+    fwrite("MBCAP\r\n\032", 1, 8, file);
+    put(file, 1, 2);
+    put(file, 0, 2);
+    put(file, 0, 4);
+
+    for (cycle = 0; cycle < cycles; cycle++) {
+        for (pipe = 0; pipe < nb_pipes; pipe++) {
+            for (read = 0; read < READS_PER_PIPE; read++) {
+                uint8_t frame[16];
+                float value = 20.0f + pipe + read / 10.0f;
+                uint16_t regs[2];
+
+                frame[0] = pipe + 1;
+                frame[1] = 0x03;
+                frame[2] = 0;
+                frame[3] = read * 2;
+                frame[4] = 0;
+                frame[5] = 2;
+                put_frame(file, t, 0, frame, 6);
+
+                modbus_set_float(value, regs);
+                frame[2] = 4;
+                frame[3] = regs[0] >> 8;
+                frame[4] = regs[0] & 0xFF;
+                frame[5] = regs[1] >> 8;
+                frame[6] = regs[1] & 0xFF;
+                put_frame(file, t + 5000, 1, frame, 7);
+                t += 10000;
+            }
+        }
+    }
+
+    return fclose(file);
+}
+
+static modbus_t *open_replay(const char *path)
+{
+    modbus_t *ctx = modbus_new_replay(path, MODBUS_REPLAY_FAST);
+
+    if (ctx == NULL || modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Unable to replay %s: %s\n", path, modbus_strerror(errno));
+        exit(1);
+    }
+
+    return ctx;
+}
+
+/* Port of MainWindow::toFloat(): hex, then a binary string, then powers */
+static double to_float_bit_string(const uint8_t *bytes)
+{
+    char hex[9];
+    char bits[40];
+    long long value;
+    double mantissa = 0;
+    int sign = 1;
+    int length;
+    int exponent;
+    int i;
+
+    sprintf(hex, "%02x%02x%02x%02x", bytes[0], bytes[1], bytes[2], bytes[3]);
+    value = strtoll(hex, NULL, 16);
+
+    length = 0;
+    for (i = 31; i >= 0; i--) {
+        if (length == 0 && !((value >> i) & 1))
+            continue;
+        bits[length++] = ((value >> i) & 1) ? '1' : '0';
+    }
+    bits[length] = 0;
+
+    if (length == 32) {
+        if (bits[0] == '1')
+            sign = -1;
+        memmove(bits, bits + 1, length--);
+    }
+
+    for (i = 0; i < 23 && i < length; i++) {
+        if (bits[length - 23 + i] == '1')
+            mantissa += 1.0 / pow(2, i + 1);
+    }
+
+    exponent = -127;
+    if (length > 23) {
+        bits[length - 23] = 0;
+        exponent = (int)strtol(bits, NULL, 2) - 127;
+    }
+
+    return sign * pow(2, exponent) * (mantissa + 1.0);
+}
+
+static const uint8_t sample_float[4] = { 0x41, 0xA4, 0x66, 0x66 };
+
+static void bm_float_bit_string(void *arg, long iterations)
+{
+    long i;
+    for (i = 0; i < iterations; i++)
+        sink = to_float_bit_string(sample_float);
+}
+
+static void bm_float_modbus_get_float(void *arg, long iterations)
+{
+    uint16_t regs[2];
+    long i;
+
+    regs[0] = (sample_float[0] << 8) | sample_float[1];
+    regs[1] = (sample_float[2] << 8) | sample_float[3];
+    for (i = 0; i < iterations; i++)
+        sink = modbus_get_float(regs);
+}
+
+static void bm_float_direct(void *arg, long iterations)
+{
+    long i;
+
+    for (i = 0; i < iterations; i++) {
+        uint32_t raw = ((uint32_t)sample_float[0] << 24) | ((uint32_t)sample_float[1] << 16) |
+                       ((uint32_t)sample_float[2] << 8) | sample_float[3];
+        float f;
+        memcpy(&f, &raw, sizeof(f));
+        sink = f;
+    }
+}
+
+/* Same fields and widths as the record of a calibration file */
+static int format_record(char *line, size_t size, double elapsed, double frequency, double temperature)
+{
+    return snprintf(line, size,
+                    "%9g %7.2f %4g %s %7g %9.3f %8.2f %9.2f %11.2f %8.2f %12.2f %12.2f %10.2f "
+                    "%11.2f %11.2f %11.2f %11.2f %11.2f %6.1f %8.2f",
+                    elapsed, 12.5, 1.0, " INT", 1.0, frequency, 0.0, 1.25, temperature, 0.0,
+                    4.5, 4.6, 0.0, 25.0, 1.0, 560.0, 12.4, 1.3, 1.0, 0.0);
+}
+
+static void bm_record_format(void *arg, long iterations)
+{
+    char line[512];
+    long i;
+
+    for (i = 0; i < iterations; i++)
+        sink = format_record(line, sizeof(line), i, 560.125, 25.5);
+}
+
+static void bm_cal_file_reopen(void *arg, long iterations)
+{
+    const char *path = arg;
+    char line[512];
+    long i;
+
+    format_record(line, sizeof(line), 1, 560.125, 25.5);
+    for (i = 0; i < iterations; i++) {
+        FILE *file = fopen(path, "a");
+        fputs(line, file);
+        fputc('\n', file);
+        fclose(file);
+    }
+}
+
+static void bm_cal_file_open(void *arg, long iterations)
+{
+    const char *path = arg;
+    FILE *file = fopen(path, "a");
+    char line[512];
+    long i;
+
+    format_record(line, sizeof(line), 1, 560.125, 25.5);
+    for (i = 0; i < iterations; i++) {
+        fputs(line, file);
+        fputc('\n', file);
+    }
+    fclose(file);
+}
+
+typedef struct {
+    modbus_t *ctx;
+    int length;
+} crc_arg_t;
+
+/* The request CRC is computed on the send path, the replay backend does
+   nothing with a request that isn't in the capture */
+static void bm_crc16(void *arg, long iterations)
+{
+    crc_arg_t *crc_arg = arg;
+    uint8_t raw[MODBUS_RTU_MAX_ADU_LENGTH];
+    long i;
+
+    memset(raw, 0x5A, sizeof(raw));
+    raw[0] = 1;
+    raw[1] = 0x10;
+    for (i = 0; i < iterations; i++)
+        modbus_send_raw_request(crc_arg->ctx, raw, crc_arg->length);
+}
+
+static void bm_receive_msg(void *arg, long iterations)
+{
+    modbus_t *ctx = open_replay(arg);
+    uint16_t regs[2];
+    long i;
+
+    modbus_set_slave(ctx, 1);
+    for (i = 0; i < iterations; i++) {
+        if (modbus_read_registers(ctx, (i % READS_PER_PIPE) * 2, 2, regs) != 2) {
+            fprintf(stderr, "Replay lost sync: %s\n", modbus_strerror(errno));
+            exit(1);
+        }
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+}
+
+typedef struct {
+    const char *capture;
+    const char *cal_file;
+    int nb_pipes;
+} cycle_arg_t;
+
+/* One pass of readPipe() over every pipe: five float reads, then the
+   record appended to the pipe file the way writeToCalFile() does it */
+static void bm_read_pipe_cycle(void *arg, long iterations)
+{
+    cycle_arg_t *cycle_arg = arg;
+    modbus_t *ctx = open_replay(cycle_arg->capture);
+    char line[512];
+    float values[READS_PER_PIPE];
+    uint16_t regs[2];
+    long i;
+    int pipe;
+    int read;
+
+    for (i = 0; i < iterations; i++) {
+        for (pipe = 0; pipe < cycle_arg->nb_pipes; pipe++) {
+            modbus_set_slave(ctx, pipe + 1);
+            for (read = 0; read < READS_PER_PIPE; read++) {
+                if (modbus_read_registers(ctx, read * 2, 2, regs) != 2) {
+                    fprintf(stderr, "Replay lost sync: %s\n", modbus_strerror(errno));
+                    exit(1);
+                }
+                values[read] = modbus_get_float(regs);
+            }
+
+            format_record(line, sizeof(line), i, values[1], values[0]);
+            {
+                FILE *file = fopen(cycle_arg->cal_file, "a");
+                fputs(line, file);
+                fputc('\n', file);
+                fclose(file);
+            }
+        }
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+}
+
+static void write_json(FILE *out, const char *executable)
+{
+    char date[64];
+    time_t t = time(NULL);
+    int i;
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+
+    fprintf(out, "{\n  \"context\": {\n");
+    fprintf(out, "    \"date\": \"%s\",\n", date);
+    fprintf(out, "    \"executable\": \"%s\",\n", executable);
+    fprintf(out, "    \"libmodbus_version\": \"%s\"\n", LIBMODBUS_VERSION_STRING);
+    fprintf(out, "  },\n  \"benchmarks\": [\n");
+    for (i = 0; i < nb_results; i++) {
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", results[i].name);
+        fprintf(out, "      \"run_type\": \"iteration\",\n");
+        fprintf(out, "      \"iterations\": %ld,\n", results[i].iterations);
+        fprintf(out, "      \"real_time\": %.3f,\n", results[i].real_ns);
+        fprintf(out, "      \"cpu_time\": %.3f,\n", results[i].cpu_ns);
+        fprintf(out, "      \"time_unit\": \"ns\"\n");
+        fprintf(out, "    }%s\n", (i + 1 < nb_results) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const int pipe_counts[] = { 3, 8, 16 };
+    char capture[300];
+    char cal_file[300];
+    char name[64];
+    crc_arg_t crc_arg;
+    cycle_arg_t cycle_arg;
+    FILE *out = stdout;
+    unsigned int i;
+
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage:\n  %s [output.json] [tmp dir] - "
+               "benchmark of the acquisition path on a replayed bus\n\n", argv[0]);
+        exit(1);
+    }
+    if (argc > 2) {
+        strncpy(tmp_dir, argv[2], sizeof(tmp_dir) - 1);
+    }
+
+    snprintf(capture, sizeof(capture), "%s/acquisition-bench-%d.mbcap", tmp_dir, (int)getpid());
+    snprintf(cal_file, sizeof(cal_file), "%s/acquisition-bench-%d.cal", tmp_dir, (int)getpid());
+
+    run("BM_FloatDecode/bit_string", bm_float_bit_string, NULL, FLOAT_ITERATIONS);
+    run("BM_FloatDecode/modbus_get_float", bm_float_modbus_get_float, NULL, FLOAT_ITERATIONS);
+    run("BM_FloatDecode/direct", bm_float_direct, NULL, FLOAT_ITERATIONS);
+
+    run("BM_RecordFormat", bm_record_format, NULL, FORMAT_ITERATIONS);
+
+    run("BM_CalFile/reopen", bm_cal_file_reopen, cal_file, FILE_ITERATIONS);
+    remove(cal_file);
+    run("BM_CalFile/open", bm_cal_file_open, cal_file, FILE_ITERATIONS);
+    remove(cal_file);
+
+    /* An empty capture, no request is ever matched */
+    write_capture(capture, 0, 0);
+    crc_arg.ctx = open_replay(capture);
+    crc_arg.length = 6;
+    run("BM_Crc16/8", bm_crc16, &crc_arg, CRC_ITERATIONS);
+    crc_arg.length = MODBUS_RTU_MAX_ADU_LENGTH - 2;
+    run("BM_Crc16/256", bm_crc16, &crc_arg, CRC_ITERATIONS);
+    modbus_close(crc_arg.ctx);
+    modbus_free(crc_arg.ctx);
+
+    if (write_capture(capture, 1, FRAME_ITERATIONS / READS_PER_PIPE) == -1) {
+        fprintf(stderr, "Unable to write %s: %s\n", capture, strerror(errno));
+        return 1;
+    }
+    run("BM_ReceiveMsg", bm_receive_msg, capture, FRAME_ITERATIONS);
+
+    cycle_arg.capture = capture;
+    cycle_arg.cal_file = cal_file;
+    for (i = 0; i < sizeof(pipe_counts) / sizeof(pipe_counts[0]); i++) {
+        cycle_arg.nb_pipes = pipe_counts[i];
+        write_capture(capture, cycle_arg.nb_pipes, CYCLE_ITERATIONS);
+        snprintf(name, sizeof(name), "BM_ReadPipeCycle/%d", cycle_arg.nb_pipes);
+        run(name, bm_read_pipe_cycle, &cycle_arg, CYCLE_ITERATIONS);
+        remove(cal_file);
+    }
+
+    remove(capture);
+
+    if (argc > 1) {
+        out = fopen(argv[1], "w");
+        if (out == NULL) {
+            fprintf(stderr, "Unable to write %s: %s\n", argv[1], strerror(errno));
+            return 1;
+        }
+    }
+    write_json(out, argv[0]);
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
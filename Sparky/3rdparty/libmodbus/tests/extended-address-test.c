@@ -0,0 +1,240 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <modbus.h>
+
+/* Extended (0xFA) addressing against a replayed bus: request framing,
+   serial number decoding, the CRC of the analyzers' responses and the
+   batch reads. The capture is generated, no rig is needed. */
+
+#define SN_SMALL        100
+#define SN_LARGE        0x01020304
+#define SN_GONE         424242
+#define SN_OTHER        555
+#define STANDARD_SLAVE  7
+#define REGISTER        14
+
+static int nb_failures = 0;
+static uint32_t last_monitor_slave = 0;
+static int nb_transactions = 0;
+
+#define ASSERT_TRUE(cond, ...)                  \
+    do {                                        \
+        if (cond) {                             \
+            printf("OK\n");                     \
+        } else {                                \
+            printf("FAILED ");                  \
+            printf(__VA_ARGS__);                \
+            printf("\n");                       \
+            nb_failures++;                      \
+        }                                       \
+    } while (0)
+
+static uint16_t crc16(const uint8_t *buffer, int length)
+{
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    while (length--) {
+        crc ^= *buffer++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+static void put(FILE *file, uint64_t value, int size)
+{
+    int i;
+    for (i = 0; i < size; i++)
+        fputc((int)((value >> (8 * i)) & 0xFF), file);
+}
+
+/* crc_length is what the sender covers with its CRC */
+static void put_frame(FILE *file, int direction, uint8_t *frame, int length, int crc_length)
+{
+    uint16_t crc = crc16(frame, crc_length);
+
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    put(file, 0, 8);
+    put(file, length, 2);
+    put(file, direction, 1);
+    put(file, 0, 1);
+    fwrite(frame, 1, length, file);
+}
+
+static int address(uint8_t *frame, int slave, int extended)
+{
+    if (!extended) {
+        frame[0] = slave;
+        return 1;
+    }
+
+    frame[0] = MODBUS_EXTENDED_ADDRESS;
+    frame[1] = (slave >> 24) & 0xFF;
+    frame[2] = (slave >> 16) & 0xFF;
+    frame[3] = (slave >> 8) & 0xFF;
+    frame[4] = slave & 0xFF;
+    return 1 + MODBUS_EXTENDED_ADDRESS_LENGTH;
+}
+
+/* One input register read of `value` from `responder`, asked of `slave` */
+static void put_read(FILE *file, int slave, int responder, int extended, uint16_t value)
+{
+    uint8_t frame[32];
+    int length = address(frame, slave, extended);
+
+    frame[length++] = MODBUS_FC_READ_INPUT_REGISTERS;
+    frame[length++] = 0;
+    frame[length++] = REGISTER;
+    frame[length++] = 0;
+    frame[length++] = 1;
+    put_frame(file, 0, frame, length, length);
+
+    length = address(frame, responder, extended);
+    frame[length++] = MODBUS_FC_READ_INPUT_REGISTERS;
+    frame[length++] = 2;
+    frame[length++] = value >> 8;
+    frame[length++] = value & 0xFF;
+    /* The analyzers leave the serial number out of the count */
+    put_frame(file, 1, frame, length, extended ? length - MODBUS_EXTENDED_ADDRESS_LENGTH : length);
+}
+
+static int write_capture(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL)
+        return -1;
+
+    fwrite("MBCAP\r\n\032", 1, 8, file);
+    put(file, 1, 2);
+    put(file, 0, 2);
+    put(file, 0, 4);
+
+    put_read(file, SN_SMALL, SN_SMALL, TRUE, 0x1111);
+    put_read(file, SN_LARGE, SN_LARGE, TRUE, 0x2222);
+    put_read(file, 12345, 12345, TRUE, 0x3333);
+    put_read(file, SN_OTHER, SN_OTHER + 1, TRUE, 0x4444);
+
+    /* the batch: SN_GONE never answers */
+    put_read(file, SN_SMALL, SN_SMALL, TRUE, 0x5555);
+    put_read(file, STANDARD_SLAVE, STANDARD_SLAVE, FALSE, 0x6666);
+
+    fclose(file);
+    return 0;
+}
+
+static void monitor_add_item(modbus_t *ctx, uint8_t isOut, uint32_t slave, uint8_t func,
+                             uint16_t addr, uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC)
+{
+    last_monitor_slave = slave;
+}
+
+static void monitor_transaction(modbus_t *ctx, const modbus_transaction_t *transaction)
+{
+    nb_transactions++;
+}
+
+int main(int argc, char *argv[])
+{
+    char capture[300];
+    modbus_t *ctx;
+    uint16_t value = 0;
+    uint16_t values[4];
+    modbus_read_request_t requests[4];
+    int rc;
+
+    snprintf(capture, sizeof(capture), "/tmp/extended-address-test-%d.mbcap", (int)getpid());
+    if (write_capture(capture) == -1) {
+        fprintf(stderr, "Unable to write %s: %s\n", capture, strerror(errno));
+        return -1;
+    }
+
+    ctx = modbus_new_replay(capture, MODBUS_REPLAY_FAST);
+    if (ctx == NULL || modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Unable to replay %s: %s\n", capture, modbus_strerror(errno));
+        return -1;
+    }
+    modbus_register_monitor_add_item_fnc(ctx, monitor_add_item);
+
+    printf("1/8 modbus_set_extended_slave below 256: ");
+    modbus_set_extended_slave(ctx, SN_SMALL);
+    rc = modbus_read_input_registers(ctx, REGISTER, 1, &value);
+    ASSERT_TRUE(rc == 1 && value == 0x1111 && modbus_is_extended_slave(ctx) == TRUE,
+                "rc %d value %04X (%s)", rc, value, modbus_strerror(errno));
+
+    printf("2/8 all four bytes of the serial number: ");
+    modbus_set_extended_slave(ctx, SN_LARGE);
+    rc = modbus_read_input_registers(ctx, REGISTER, 1, &value);
+    ASSERT_TRUE(rc == 1 && value == 0x2222 && last_monitor_slave == SN_LARGE,
+                "rc %d value %04X monitor %u", rc, value, last_monitor_slave);
+
+    printf("3/8 modbus_set_slave above 256 is extended: ");
+    modbus_set_slave(ctx, 12345);
+    rc = modbus_read_input_registers(ctx, REGISTER, 1, &value);
+    ASSERT_TRUE(rc == 1 && value == 0x3333 && modbus_is_extended_slave(ctx) == TRUE,
+                "rc %d value %04X", rc, value);
+
+    printf("4/8 the answer of another serial number is refused: ");
+    modbus_set_extended_slave(ctx, SN_OTHER);
+    rc = modbus_read_input_registers(ctx, REGISTER, 1, &value);
+    ASSERT_TRUE(rc == -1, "rc %d", rc);
+
+    printf("5/8 a standard slave is not extended: ");
+    modbus_set_slave(ctx, STANDARD_SLAVE);
+    ASSERT_TRUE(modbus_is_extended_slave(ctx) == FALSE, "extended");
+
+    memset(requests, 0, sizeof(requests));
+    requests[0].slave = SN_SMALL;
+    requests[0].extended = TRUE;
+    requests[1].slave = SN_GONE;
+    requests[1].extended = TRUE;
+    requests[2].slave = STANDARD_SLAVE;
+    requests[2].extended = FALSE;
+    requests[3].slave = SN_GONE;
+    requests[3].extended = TRUE;
+    for (rc = 0; rc < 4; rc++) {
+        requests[rc].function = MODBUS_FC_READ_INPUT_REGISTERS;
+        requests[rc].addr = REGISTER;
+        requests[rc].nb = 1;
+        requests[rc].dest = &values[rc];
+    }
+    modbus_set_response_timeout(ctx, 0, 20000);
+    modbus_set_extended_slave(ctx, SN_LARGE);
+    modbus_register_monitor_transaction_fnc(ctx, monitor_transaction);
+    rc = modbus_read_batch(ctx, requests, 4);
+
+    printf("6/8 modbus_read_batch reads every device: ");
+    ASSERT_TRUE(rc == 2 && requests[0].rc == 1 && values[0] == 0x5555 &&
+                requests[2].rc == 1 && values[2] == 0x6666,
+                "rc %d, %d %04X, %d %04X", rc, requests[0].rc, values[0], requests[2].rc, values[2]);
+
+    printf("7/8 modbus_read_batch skips a device that timed out: ");
+    ASSERT_TRUE(requests[1].error == ETIMEDOUT && requests[3].rc == -1 && requests[3].error == ETIMEDOUT &&
+                nb_transactions == 3,
+                "%d %d %d, %d requests sent", requests[1].error, requests[3].rc, requests[3].error, nb_transactions);
+
+    printf("8/8 modbus_read_batch leaves the slave alone: ");
+    ASSERT_TRUE(modbus_get_slave(ctx) == SN_LARGE && modbus_is_extended_slave(ctx) == TRUE,
+                "slave %d", modbus_get_slave(ctx));
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+    remove(capture);
+
+    printf("\n%s\n", nb_failures ? "SOME TESTS FAILED" : "ALL TESTS PASS WITH SUCCESS.");
+    return nb_failures ? -1 : 0;
+}
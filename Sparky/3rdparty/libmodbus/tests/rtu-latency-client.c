@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+#include <modbus.h>
+
+#define N_LOOP 1000
+
+static uint32_t gettime_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint32_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Round trip time of a two registers read (one float of a Sparky pipe),
+   with the low latency profile given in argument. Run against
+   bandwidth-server-one in RTU mode on the other end of the line. */
+int main(int argc, char *argv[])
+{
+    uint16_t tab_reg[2];
+    uint32_t *rtt;
+    modbus_t *ctx;
+    const char *device = "/dev/ttyUSB1";
+    int baud = 115200;
+    int low_latency = MODBUS_RTU_LOW_LATENCY_OFF;
+    uint64_t total = 0;
+    int i;
+    int rc;
+
+    if (argc > 1) {
+        if (strcmp(argv[1], "off") == 0) {
+            low_latency = MODBUS_RTU_LOW_LATENCY_OFF;
+        } else if (strcmp(argv[1], "on") == 0) {
+            low_latency = MODBUS_RTU_LOW_LATENCY_ON;
+        } else if (strcmp(argv[1], "rs485") == 0) {
+            low_latency = MODBUS_RTU_LOW_LATENCY_RS485;
+        } else {
+            printf("Usage:\n  %s [off|on|rs485] [device] [baud] - "
+                   "Modbus RTU client to measure round trip time\n\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (argc > 2) {
+        device = argv[2];
+    }
+    if (argc > 3) {
+        baud = atoi(argv[3]);
+    }
+
+    ctx = modbus_new_rtu(device, baud, 'N', 8, 1);
+    if (ctx == NULL) {
+        fprintf(stderr, "Unable to create the libmodbus context\n");
+        return -1;
+    }
+    modbus_set_slave(ctx, 1);
+
+    if (modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Connection failed: %s\n",
+                modbus_strerror(errno));
+        modbus_free(ctx);
+        return -1;
+    }
+
+    if (modbus_rtu_set_low_latency(ctx, low_latency) == -1) {
+        fprintf(stderr, "Unable to set the low latency profile: %s\n",
+                modbus_strerror(errno));
+        modbus_close(ctx);
+        modbus_free(ctx);
+        return -1;
+    }
+
+    rtt = (uint32_t *) malloc(N_LOOP * sizeof(uint32_t));
+
+    for (i=0; i<N_LOOP; i++) {
+        uint32_t start = gettime_us();
+        rc = modbus_read_registers(ctx, 0, 2, tab_reg);
+        rtt[i] = gettime_us() - start;
+        if (rc == -1) {
+            fprintf(stderr, "%s\n", modbus_strerror(errno));
+            free(rtt);
+            return -1;
+        }
+        total += rtt[i];
+    }
+
+    qsort(rtt, N_LOOP, sizeof(uint32_t), compare_us);
+
+    printf("ROUND TRIP (%s, %d bauds, frame silence %d us)\n\n",
+           device, baud, modbus_rtu_get_frame_silence(ctx));
+    printf("* %d requests\n", N_LOOP);
+    printf("* min %u us\n", rtt[0]);
+    printf("* avg %u us\n", (uint32_t) (total / N_LOOP));
+    printf("* p50 %u us\n", rtt[N_LOOP / 2]);
+    printf("* p99 %u us\n", rtt[N_LOOP * 99 / 100]);
+    printf("* max %u us\n", rtt[N_LOOP - 1]);
+    printf("\n");
+
+    free(rtt);
+
+    /* Close the connection */
+    modbus_close(ctx);
+    modbus_free(ctx);
+
+    return 0;
+}
@@ -23,6 +23,11 @@
     #include <IOKit/usb/IOUSBLib.h>
 #endif
 
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+    class QFileSystemWatcher;
+    class QTimer;
+#endif
+
 /*!
  * Structure containing port information.
  */
@@ -33,6 +38,7 @@ struct QextPortInfo {
     QString enumName;   ///< Enumerator name.
     int vendorID;       ///< Vendor ID.
     int productID;      ///< Product ID
+    QString serialNumber; ///< Serial number of the USB adapter, empty if unknown.
 };
 
 #ifdef Q_OS_WIN
@@ -73,7 +79,7 @@ class QextSerialRegistrationWidget : public QWidget
 
   To enable event-driven notification of device connection events, first call
   setUpNotifications() and then connect to the deviceDiscovered() and deviceRemoved()
-  signals.  Event-driven behavior is currently available only on Windows and OS X.
+  signals.  Event-driven behavior is currently available on Windows, OS X and Linux.
 
   \b Example
   \code
@@ -163,6 +169,23 @@ Q_OBJECT
                *    \param infoList list with result.
                */
               static void scanPortsNix(QList<QextPortInfo> & infoList);
+
+              /*!
+               * Fill in adapter serial numbers from the udev /dev/serial/by-id links.
+               *    \param infoList list to complete.
+               */
+              static void readSerialNumbersNix(QList<QextPortInfo> & infoList);
+
+            private slots:
+              /*!
+               * Compare the ports in /dev against the last scan and report the difference.
+               */
+              void rescanNix( );
+
+            private:
+              QFileSystemWatcher* watcherNix;
+              QTimer* rescanTimerNix;
+              QList<QextPortInfo> knownPortsNix;
             #endif // Q_OS_MAC
         #endif /* Q_OS_UNIX */
 
@@ -182,7 +205,8 @@ Q_OBJECT
           A new device has been connected to the system.
 
           setUpNotifications() must be called first to enable event-driven device notifications.
-          Currently only implemented on Windows and OS X.
+          Currently only implemented on Windows, OS X and Linux.  On Linux it is emitted
+          again for a known port once its adapter serial number becomes available.
           \param info The device that has been discovered.
         */
         void deviceDiscovered( const QextPortInfo & info );
@@ -190,7 +214,7 @@ Q_OBJECT
           A device has been disconnected from the system.
 
           setUpNotifications() must be called first to enable event-driven device notifications.
-          Currently only implemented on Windows and OS X.
+          Currently only implemented on Windows, OS X and Linux.
           \param info The device that was disconnected.
         */
         void deviceRemoved( const QextPortInfo & info );
@@ -6,11 +6,19 @@
 #include <QMetaType>
 #include <QStringList>
 #include <QDir>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QRegExp>
+
+#define SERIAL_BY_ID "/dev/serial/by-id"
 
 QextSerialEnumerator::QextSerialEnumerator( )
 {
     if( !QMetaType::isRegistered( QMetaType::type("QextPortInfo") ) )
         qRegisterMetaType<QextPortInfo>("QextPortInfo");
+
+    watcherNix = 0;
+    rescanTimerNix = 0;
 }
 
 QextSerialEnumerator::~QextSerialEnumerator( )
@@ -61,15 +69,91 @@ QList<QextPortInfo> QextSerialEnumerator::getPorts()
             inf.friendName = "Bluetooth-serial adapter "+str.remove(0, 6);
         }
         inf.enumName = "/dev"; // is there a more helpful name for this?
+        inf.vendorID = 0;
+        inf.productID = 0;
         infoList.append(inf);
     }
+
+    readSerialNumbersNix(infoList);
 #else
     qCritical("Enumeration for POSIX systems (except Linux) is not implemented yet.");
 #endif
     return infoList;
 }
 
+void QextSerialEnumerator::readSerialNumbersNix(QList<QextPortInfo> & infoList)
+{
+    // udev names the links usb-<vendor>_<product>_<serial>-if<n>-port<n>
+    QDir dir(SERIAL_BY_ID);
+    foreach (QFileInfo link, dir.entryInfoList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot)) {
+        if (!link.isSymLink())
+            continue;
+
+        QString id = link.fileName();
+        id.remove(QRegExp("-if[0-9]+.*$"));
+        const QString serial = id.section('_', -1);
+        const QString target = QFileInfo(link.symLinkTarget()).fileName();
+
+        for (int i = 0; i < infoList.size(); i++) {
+            if (infoList[i].portName == target)
+                infoList[i].serialNumber = serial;
+        }
+    }
+}
+
 void QextSerialEnumerator::setUpNotifications( )
 {
+#ifdef Q_OS_LINUX
+    if (watcherNix)
+        return;
+
+    knownPortsNix = getPorts();
+
+    // inotify on /dev sees the tty node, the by-id directory sees udev finish
+    // naming it; the timer folds both (and bursts of either) into one rescan
+    watcherNix = new QFileSystemWatcher(this);
+    rescanTimerNix = new QTimer(this);
+    rescanTimerNix->setSingleShot(true);
+    rescanTimerNix->setInterval(250);
+    connect(watcherNix, SIGNAL(directoryChanged(const QString &)), rescanTimerNix, SLOT(start()));
+    connect(rescanTimerNix, SIGNAL(timeout()), this, SLOT(rescanNix()));
+
+    watcherNix->addPath("/dev");
+    if (QDir(SERIAL_BY_ID).exists())
+        watcherNix->addPath(SERIAL_BY_ID);
+#else
     qCritical("Notifications for *Nix/FreeBSD are not implemented yet");
+#endif
+}
+
+void QextSerialEnumerator::rescanNix( )
+{
+    QList<QextPortInfo> ports = getPorts();
+
+    // the by-id directory comes and goes with the first and last USB adapter
+    if (QDir(SERIAL_BY_ID).exists() && !watcherNix->directories().contains(SERIAL_BY_ID))
+        watcherNix->addPath(SERIAL_BY_ID);
+
+    foreach (QextPortInfo known, knownPortsNix) {
+        bool found = false;
+        foreach (QextPortInfo port, ports)
+            found = found || (port.portName == known.portName);
+        if (!found)
+            emit deviceRemoved(known);
+    }
+
+    foreach (QextPortInfo port, ports) {
+        bool found = false;
+        bool changed = false;
+        foreach (QextPortInfo known, knownPortsNix) {
+            if (known.portName == port.portName) {
+                found = true;
+                changed = (known.serialNumber != port.serialNumber);
+            }
+        }
+        if (!found || changed)
+            emit deviceDiscovered(port);
+    }
+
+    knownPortsNix = ports;
 }
@@ -2,22 +2,62 @@ TARGET = Sparky
 TEMPLATE = app
 VERSION = 0.1.0
 
-QT += gui widgets charts concurrent
+QT += gui widgets charts concurrent network sql
+CONFIG += c++14
 
 SOURCES += src/main.cpp \
     src/mainwindow.cpp \
+    src/stability.cpp \
+    src/settling.cpp \
+    src/injectioncontroller.cpp \
+    src/masterpipetracker.cpp \
+    src/qcgaugewidget.cpp \
+    src/busstatistics.cpp \
+    src/metricsserver.cpp \
+    src/eventlog.cpp \
+    src/transportmanager.cpp \
+    src/settings.cpp \
+    src/deviceprofile.cpp \
+    src/spoolreplicator.cpp \
+    src/runcatalog.cpp \
+    src/legacyimporter.cpp \
+    src/curvefit.cpp \
+    src/batchfit.cpp \
+    src/busscanner.cpp \
+    src/devicecache.cpp \
+    src/linktuner.cpp \
     3rdparty/qextserialport/qextserialport.cpp	\
     3rdparty/libmodbus/src/modbus.c \
     3rdparty/libmodbus/src/modbus-data.c \
     3rdparty/libmodbus/src/modbus-rtu.c \
     3rdparty/libmodbus/src/modbus-tcp.c \
     3rdparty/libmodbus/src/modbus-ascii.c \
+    3rdparty/libmodbus/src/modbus-replay.c \
 #    src/ipaddressctrl.cpp \
 #    src/iplineedit.cpp \
 #    src/serialsetting.cpp \
-#    src/qcgaugewidget.cpp
 
 HEADERS += src/mainwindow.h \
+    src/stability.h \
+    src/settling.h \
+    src/injectioncontroller.h \
+    src/masterpipetracker.h \
+    src/qcgaugewidget.h \
+    src/busstatistics.h \
+    src/triplebuffer.h \
+    src/metricsserver.h \
+    src/eventlog.h \
+    src/transportmanager.h \
+    src/settings.h \
+    src/deviceprofile.h \
+    src/spoolreplicator.h \
+    src/runcatalog.h \
+    src/legacyimporter.h \
+    src/curvefit.h \
+    src/batchfit.h \
+    src/busscanner.h \
+    src/devicecache.h \
+    src/linktuner.h \
     src/BatchProcessor.h \
     3rdparty/qextserialport/qextserialport.h \
     3rdparty/qextserialport/qextserialenumerator.h \
@@ -26,7 +66,6 @@ HEADERS += src/mainwindow.h \
 #    src/ipaddressctrl.h \
 #    src/iplineedit.h \
 #    src/serialsetting.h \
-#    src/qcgaugewidget.h
 
 INCLUDEPATH += 3rdparty/libmodbus \
                3rdparty/libmodbus/src \
@@ -0,0 +1,304 @@
+#include "batchfit.h"
+#include <QtMath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define BATCH_SSE2
+#endif
+
+#define BATCH_MAX_TERMS         4
+
+
+#ifdef BATCH_SSE2
+static inline double horizontalSum(const __m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+#endif
+
+
+static void range(const double * x, const int n, double & lo, double & hi)
+{
+    int i = 0;
+    lo = hi = x[0];
+#ifdef BATCH_SSE2
+    __m128d vlo = _mm_set1_pd(x[0]);
+    __m128d vhi = vlo;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d v = _mm_loadu_pd(x + i);
+        vlo = _mm_min_pd(vlo, v);
+        vhi = _mm_max_pd(vhi, v);
+    }
+    double l[2], h[2];
+    _mm_storeu_pd(l, vlo);
+    _mm_storeu_pd(h, vhi);
+    lo = qMin(l[0], l[1]);
+    hi = qMax(h[0], h[1]);
+#endif
+    for (; i < n; i++)
+    {
+        lo = qMin(lo, x[i]);
+        hi = qMax(hi, x[i]);
+    }
+}
+
+
+/// sxx[k] = sum u^k for k <= 2 (terms - 1), sxy[k] = sum u^k y for k < terms
+static void powerSums(const double * x, const double * y, const int n, const double origin, const double inv, const int terms,
+                      double * sxx, double * sxy)
+{
+    const int powers = 2 * terms - 1;
+    for (int k = 0; k < powers; k++) sxx[k] = 0;
+    for (int k = 0; k < terms; k++) sxy[k] = 0;
+
+    int i = 0;
+#ifdef BATCH_SSE2
+    __m128d axx[2 * BATCH_MAX_TERMS - 1];
+    __m128d axy[BATCH_MAX_TERMS];
+    for (int k = 0; k < powers; k++) axx[k] = _mm_setzero_pd();
+    for (int k = 0; k < terms; k++) axy[k] = _mm_setzero_pd();
+
+    const __m128d vo = _mm_set1_pd(origin);
+    const __m128d vi = _mm_set1_pd(inv);
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d u = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i), vo), vi);
+        const __m128d vy = _mm_loadu_pd(y + i);
+        __m128d p = _mm_set1_pd(1.0);
+        for (int k = 0; k < powers; k++)
+        {
+            axx[k] = _mm_add_pd(axx[k], p);
+            if (k < terms) axy[k] = _mm_add_pd(axy[k], _mm_mul_pd(p, vy));
+            p = _mm_mul_pd(p, u);
+        }
+    }
+
+    for (int k = 0; k < powers; k++) sxx[k] = horizontalSum(axx[k]);
+    for (int k = 0; k < terms; k++) sxy[k] = horizontalSum(axy[k]);
+#endif
+    for (; i < n; i++)
+    {
+        const double u = (x[i] - origin) * inv;
+        double p = 1;
+        for (int k = 0; k < powers; k++)
+        {
+            sxx[k] += p;
+            if (k < terms) sxy[k] += p * y[i];
+            p *= u;
+        }
+    }
+}
+
+
+/// sum of squared residuals of the polynomial a in u, and of y around its mean
+static void residuals(const double * x, const double * y, const int n, const double origin, const double inv, const double * a, const int terms,
+                      const double mean, double & rss, double & sst)
+{
+    rss = sst = 0;
+
+    int i = 0;
+#ifdef BATCH_SSE2
+    __m128d vrss = _mm_setzero_pd();
+    __m128d vsst = _mm_setzero_pd();
+    const __m128d vo = _mm_set1_pd(origin);
+    const __m128d vi = _mm_set1_pd(inv);
+    const __m128d vm = _mm_set1_pd(mean);
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d u = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(x + i), vo), vi);
+        const __m128d vy = _mm_loadu_pd(y + i);
+
+        /// Horner
+        __m128d f = _mm_set1_pd(a[terms - 1]);
+        for (int k = terms - 2; k >= 0; k--) f = _mm_add_pd(_mm_mul_pd(f, u), _mm_set1_pd(a[k]));
+
+        const __m128d r = _mm_sub_pd(vy, f);
+        const __m128d d = _mm_sub_pd(vy, vm);
+        vrss = _mm_add_pd(vrss, _mm_mul_pd(r, r));
+        vsst = _mm_add_pd(vsst, _mm_mul_pd(d, d));
+    }
+    rss = horizontalSum(vrss);
+    sst = horizontalSum(vsst);
+#endif
+    for (; i < n; i++)
+    {
+        const double u = (x[i] - origin) * inv;
+        double f = a[terms - 1];
+        for (int k = terms - 2; k >= 0; k--) f = f * u + a[k];
+
+        rss += (y[i] - f) * (y[i] - f);
+        sst += (y[i] - mean) * (y[i] - mean);
+    }
+}
+
+
+/// normal equations G a = b, Gaussian elimination with partial pivoting
+static bool solve(const double * sxx, const double * sxy, const int terms, double * a)
+{
+    double g[BATCH_MAX_TERMS][BATCH_MAX_TERMS + 1];
+    for (int i = 0; i < terms; i++)
+    {
+        for (int j = 0; j < terms; j++) g[i][j] = sxx[i + j];
+        g[i][terms] = sxy[i];
+    }
+
+    for (int c = 0; c < terms; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < terms; r++) if (qAbs(g[r][c]) > qAbs(g[pivot][c])) pivot = r;
+        if (qAbs(g[pivot][c]) < 1e-12 * qAbs(g[0][0])) return false;
+
+        for (int j = c; j <= terms; j++) qSwap(g[c][j], g[pivot][j]);
+        for (int r = c + 1; r < terms; r++)
+        {
+            const double f = g[r][c] / g[c][c];
+            for (int j = c; j <= terms; j++) g[r][j] -= f * g[c][j];
+        }
+    }
+
+    for (int c = terms - 1; c >= 0; c--)
+    {
+        double sum = g[c][terms];
+        for (int j = c + 1; j < terms; j++) sum -= g[c][j] * a[j];
+        a[c] = sum / g[c][c];
+    }
+
+    return true;
+}
+
+
+bool
+BatchFit::
+fit(const double * x, const double * y, const int n, const Model model, const int degree,
+    QVector<double> & coefficients, double & residual, double & rSquared)
+{
+    const int terms = (model == Exponential) ? 2 : qBound(2, degree + 1, BATCH_MAX_TERMS);
+    if (n <= terms) return false;
+
+    /// a * exp(b x) is a straight line through ln y
+    QVector<double> logY;
+    const double * fitY = y;
+    if (model == Exponential)
+    {
+        logY.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            if (y[i] <= 0) return false;
+            logY[i] = qLn(y[i]);
+        }
+        fitY = logY.constData();
+    }
+
+    /// x scaled onto [-1, 1] keeps the normal equations well conditioned
+    double lo, hi;
+    range(x, n, lo, hi);
+    if (hi <= lo) return false;
+    const double origin = (lo + hi) / 2;
+    const double inv = 2 / (hi - lo);
+
+    double sxx[2 * BATCH_MAX_TERMS - 1];
+    double sxy[BATCH_MAX_TERMS];
+    double a[BATCH_MAX_TERMS];
+    powerSums(x, fitY, n, origin, inv, terms, sxx, sxy);
+    if (!solve(sxx, sxy, terms, a)) return false;
+
+    /// expand a_k ((x - origin) * inv)^k into powers of x
+    QVector<double> c(terms, 0.0);
+    for (int k = 0; k < terms; k++)
+    {
+        double binomial = 1;
+        for (int i = 0; i <= k; i++)
+        {
+            c[i] += a[k] * binomial * qPow(-origin, k - i) * qPow(inv, k);
+            binomial = binomial * (k - i) / (i + 1);
+        }
+    }
+
+    double rss = 0;
+    double sst = 0;
+    if (model == Exponential)
+    {
+        coefficients.clear();
+        coefficients << qExp(c[0]) << c[1];
+
+        double mean = 0;
+        for (int i = 0; i < n; i++) mean += y[i];
+        mean /= n;
+        for (int i = 0; i < n; i++)
+        {
+            const double r = y[i] - coefficients[0] * qExp(coefficients[1] * x[i]);
+            rss += r * r;
+            sst += (y[i] - mean) * (y[i] - mean);
+        }
+    }
+    else
+    {
+        coefficients = c;
+        residuals(x, y, n, origin, inv, a, terms, sxy[0] / sxx[0], rss, sst);
+    }
+
+    residual = qSqrt(rss / (n - terms));
+    rSquared = (sst > 0) ? 1 - rss / sst : 1;
+
+    return true;
+}
+
+
+BatchFit::Result
+BatchFit::
+fitFile(const QString & path, const Model model, const int degree)
+{
+    Result result;
+    result.path = path;
+
+    const LegacyFile file = LegacyImporter::load(path);
+    if (!file.isValid())
+    {
+        result.error = file.error;
+        return result;
+    }
+
+    result.sn = file.sn;
+    result.mode = file.mode;
+    result.loop = file.loop;
+    result.pipe = file.pipe;
+    result.kind = file.range.section(':', 0, 0).trimmed().toUpper();
+    result.samples = file.rows();
+
+    /// temperature runs hold the watercut, everything else sweeps it
+    const bool isTemperature = (result.kind == "TEMPERATURE");
+    const QVector<double> & x = isTemperature ? file.columns[LegacyFile::Temperature] : file.columns[LegacyFile::Frequency];
+    const QVector<double> & y = isTemperature ? file.columns[LegacyFile::Frequency] : file.columns[LegacyFile::Watercut];
+
+    if (!fit(x.constData(), y.constData(), file.rows(), model, degree, result.coefficients, result.residual, result.rSquared))
+    {
+        result.error = "not enough distinct samples";
+    }
+
+    return result;
+}
+
+
+QString
+BatchFit::
+csvHeader(const int terms)
+{
+    QString line("path,sn,mode,loop,pipe,kind,samples");
+    for (int i = 0; i < terms; i++) line += QString(",c%1").arg(i);
+    line += ",residual,r2,error";
+
+    return line;
+}
+
+
+QString
+BatchFit::
+csvLine(const Result & result, const int terms)
+{
+    QString line = QString("\"%1\",%2,%3,%4,%5,%6,%7").arg(result.path).arg(result.sn).arg(result.mode).arg(result.loop).arg(result.pipe + 1).arg(result.kind).arg(result.samples);
+    for (int i = 0; i < terms; i++) line += "," + ((i < result.coefficients.size()) ? QString::number(result.coefficients[i], 'g', 12) : QString());
+    line += result.error.isEmpty() ? QString(",%1,%2,").arg(result.residual, 0, 'g', 6).arg(result.rSquared, 0, 'g', 8) : QString(",,,\"%1\"").arg(result.error);
+
+    return line;
+}
@@ -0,0 +1,60 @@
+#ifndef BATCHFIT_H
+#define BATCHFIT_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "legacyimporter.h"
+
+/// re-fits archived calibration files with the current fitting method.
+/// injection files are fitted as watercut over frequency, temperature
+/// files as frequency over temperature. a fit is two streaming passes
+/// over the columns of LegacyImporter: power sums of the scaled x into
+/// the normal equations, then the residuals, both two samples per SSE2
+/// instruction. one file is one job, the jobs are independent, see
+/// BatchFit::Job and QtConcurrent::mapped().
+class BatchFit
+{
+public:
+    enum Model { Polynomial, Exponential };
+
+    struct Result
+    {
+        QString path;
+        QString error;          /// empty when the file was fitted
+        QString sn;
+        QString mode;
+        int loop;
+        int pipe;
+        QString kind;           /// "INJECTION", "TEMPERATURE" or "ROLLOVER" from header2
+        int samples;
+        QVector<double> coefficients;   /// polynomial: c0 + c1 x + ..., exponential: a, b of a * exp(b x)
+        double residual;
+        double rSquared;
+
+        Result() : loop(0), pipe(0), samples(0), residual(0), rSquared(0) {}
+    };
+
+    /// one file, as a functor for QtConcurrent::mapped()
+    struct Job
+    {
+        typedef Result result_type;
+
+        Model model;
+        int degree;
+
+        Job(const Model m, const int d) : model(m), degree(d) {}
+        Result operator()(const QString & path) const { return BatchFit::fitFile(path, model, degree); }
+    };
+
+    static Result fitFile(const QString & path, const Model model, const int degree);
+
+    /// y over x, n samples. false when there are too few distinct x
+    static bool fit(const double * x, const double * y, const int n, const Model model, const int degree,
+                    QVector<double> & coefficients, double & residual, double & rSquared);
+
+    static QString csvHeader(const int terms);
+    static QString csvLine(const Result & result, const int terms);
+};
+
+#endif // BATCHFIT_H
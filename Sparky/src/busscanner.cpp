@@ -0,0 +1,160 @@
+#include "busscanner.h"
+#include <QElapsedTimer>
+#include <errno.h>
+#include "deviceprofile.h"
+
+/// standard slave addresses
+#define SCAN_FIRST_ADDRESS      1
+#define SCAN_LAST_ADDRESS       247
+
+/// a probe and a typical answer on the wire, 11 bits per character
+#define SCAN_PROBE_CHARACTERS   24
+#define SCAN_TURNAROUND_US      10000
+#define SCAN_MAX_TIMEOUT_US     500000
+
+/// factory register lock, as validateSerialNumber() uses it
+#define SCAN_UNLOCK_REGISTER    999
+
+
+/// the device answered, if only with an exception
+static bool isAnswer(const int error)
+{
+    return (error >= EMBXILFUN) && (error <= EMBXGTAR);
+}
+
+
+/// something is there but the frame was damaged, worth a second look
+static bool isGarbled(const int error)
+{
+    return (error == EMBBADCRC) || (error == EMBBADDATA) || (error == EMBBADEXC) || (error == EMBUNKEXC) || (error == EMBMDATA) || (error == EMBBADSLAVE);
+}
+
+
+BusScanner::
+BusScanner(QObject * parent) : QObject(parent), m_timeoutUs(0), m_floorUs(0), m_slowestUs(0), m_isCanceled(0)
+{
+}
+
+
+QList<BusDevice>
+BusScanner::
+scan(modbus_t * ctx, const int baud, const QList<int> & skip)
+{
+    QList<BusDevice> devices;
+    m_isCanceled.store(0);
+
+    uint32_t sec, usec;
+    modbus_get_response_timeout(ctx, &sec, &usec);
+    const int slave = modbus_get_slave(ctx);
+
+    m_floorUs = int(qint64(SCAN_PROBE_CHARACTERS) * 11 * 1000000 / qMax(baud, 1200)) + SCAN_TURNAROUND_US;
+    m_timeoutUs = 2 * m_floorUs;
+    m_slowestUs = 0;
+
+    QList<int> garbled;
+    for (int address = SCAN_FIRST_ADDRESS; (address <= SCAN_LAST_ADDRESS) && !m_isCanceled.load(); address++)
+    {
+        emit progress(address);
+        if (skip.contains(address)) continue;
+
+        BusDevice device;
+        device.address = address;
+        modbus_set_slave(ctx, address);
+        if (probe(ctx, device)) devices.append(device);
+        else if (isGarbled(errno)) garbled.append(address);
+    }
+
+    /// damaged answers get one more try with all the time the slowest device needed
+    foreach (const int address, garbled)
+    {
+        if (m_isCanceled.load()) break;
+
+        modbus_flush(ctx);
+        setTimeout(ctx, qMin(4 * qMax(m_timeoutUs, m_slowestUs), SCAN_MAX_TIMEOUT_US));
+
+        BusDevice device;
+        device.address = address;
+        modbus_set_slave(ctx, address);
+        if (probe(ctx, device)) devices.append(device);
+    }
+
+    for (int i = 0; (i < devices.size()) && !m_isCanceled.load(); i++) identify(ctx, devices[i]);
+
+    modbus_set_slave(ctx, slave);
+    modbus_set_response_timeout(ctx, sec, usec);
+
+    return devices;
+}
+
+
+/// one report slave id request; the timeout of the next probe follows
+/// the slowest answer so far
+bool
+BusScanner::
+probe(modbus_t * ctx, BusDevice & device)
+{
+    uint8_t data[MODBUS_MAX_PDU_LENGTH];
+
+    setTimeout(ctx, m_timeoutUs);
+
+    QElapsedTimer clock;
+    clock.start();
+    const int rc = modbus_report_slave_id(ctx, sizeof(data), data);
+    const int error = errno;
+    const int us = int(clock.nsecsElapsed() / 1000);
+
+    if ((rc <= 0) && !isAnswer(error))
+    {
+        if (isGarbled(error)) modbus_flush(ctx);
+        errno = error;
+        return false;
+    }
+
+    if (rc > 0) device.slaveId = QByteArray(reinterpret_cast<const char *>(data), rc);
+    device.roundTripUs = us;
+
+    m_slowestUs = qMax(m_slowestUs, us);
+    m_timeoutUs = qBound(m_floorUs, 2 * m_slowestUs, SCAN_MAX_TIMEOUT_US);
+
+    return true;
+}
+
+
+/// family and serial number from the identity registers, then a read
+/// addressed by that serial number to see the device takes extended frames
+void
+BusScanner::
+identify(modbus_t * ctx, BusDevice & device)
+{
+    uint16_t sn = 0;
+
+    setTimeout(ctx, qMin(4 * m_timeoutUs, SCAN_MAX_TIMEOUT_US));
+    modbus_set_slave(ctx, device.address);
+    modbus_write_register(ctx, SCAN_UNLOCK_REGISTER, 1);
+
+    const QByteArray name = device.slaveId.toUpper();
+    if (name.contains("RAZOR")) device.isEEA = false;
+    else if (name.contains("EEA")) device.isEEA = true;
+    else device.isEEA = (modbus_read_input_registers(ctx, device::Razor::identity.serialNumber - 1, 1, &sn) != 1) || (sn == 0);
+
+    const int snRegister = (device.isEEA ? device::Eea::identity.serialNumber : device::Razor::identity.serialNumber) - 1;
+    if (modbus_read_input_registers(ctx, snRegister, 1, &sn) == 1) device.serialNumber = sn;
+
+    modbus_write_register(ctx, SCAN_UNLOCK_REGISTER, 0);
+
+    if (device.serialNumber > 0)
+    {
+        uint16_t check = 0;
+        modbus_set_extended_slave(ctx, device.serialNumber);
+        device.isAddressableBySn = (modbus_read_input_registers(ctx, snRegister, 1, &check) == 1) && (check == device.serialNumber);
+        if (!device.isAddressableBySn) modbus_flush(ctx);
+    }
+}
+
+
+void
+BusScanner::
+setTimeout(modbus_t * ctx, const int us)
+{
+    modbus_set_response_timeout(ctx, us / 1000000, us % 1000000);
+}
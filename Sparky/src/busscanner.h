@@ -0,0 +1,58 @@
+#ifndef BUSSCANNER_H
+#define BUSSCANNER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include "modbus.h"
+
+/// an analyzer found on the bus
+struct BusDevice
+{
+    int address;            /// standard slave address it answered on
+    int serialNumber;       /// 0 when it could not be read
+    bool isEEA;
+    bool isAddressableBySn; /// answers extended (0xFA) frames addressed by its serial number
+    QByteArray slaveId;     /// report slave id payload, empty when not supported
+    int roundTripUs;
+
+    BusDevice() : address(0), serialNumber(0), isEEA(false), isAddressableBySn(false), roundTripUs(0) {}
+};
+
+/// sweeps the standard slave addresses of one RTU bus for analyzers.
+/// a probe is a report slave id request, which every device answers
+/// either with data or with an exception, so one frame tells whether
+/// an address is taken. the response timeout starts at a few frame
+/// times of the configured baud rate and follows the slowest device
+/// seen so far, and requests go out back to back. the responders are
+/// then identified (family and serial number) through their
+/// identity registers. scan() blocks, run it off the GUI thread with
+/// nothing else on the bus.
+class BusScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BusScanner(QObject * parent = 0);
+
+    QList<BusDevice> scan(modbus_t * ctx, const int baud, const QList<int> & skip);
+
+public slots:
+    void cancel() { m_isCanceled.store(1); }
+
+signals:
+    void progress(int address);
+
+private:
+    bool probe(modbus_t * ctx, BusDevice & device);
+    void identify(modbus_t * ctx, BusDevice & device);
+    void setTimeout(modbus_t * ctx, const int us);
+
+    int m_timeoutUs;
+    int m_floorUs;
+    int m_slowestUs;
+    QAtomicInt m_isCanceled;
+};
+
+#endif // BUSSCANNER_H
@@ -0,0 +1,172 @@
+#include "busstatistics.h"
+#include <QStringList>
+#include <errno.h>
+
+/// 2^SUB_BITS linear sub-buckets per power of two
+#define SUB_BITS            4
+#define SUB_BUCKETS         (1 << SUB_BITS)
+
+/// highest power of two kept, longer values land in the last bucket
+#define MAX_MAGNITUDE       27
+
+#define BUCKETS             (SUB_BUCKETS + (MAX_MAGNITUDE - SUB_BITS) * SUB_BUCKETS)
+
+
+LatencyHistogram::
+LatencyHistogram() : m_counts(BUCKETS, 0)
+{
+    reset();
+}
+
+
+void
+LatencyHistogram::
+reset()
+{
+    m_counts.fill(0);
+    m_count = 0;
+    m_min = 0;
+    m_max = 0;
+    m_sum = 0;
+}
+
+
+int
+LatencyHistogram::
+bucketOf(quint64 us)
+{
+    if (us < SUB_BUCKETS) return int(us);
+
+    const quint64 limit = (quint64(1) << MAX_MAGNITUDE) - 1;
+    if (us > limit) us = limit;
+
+    int magnitude = SUB_BITS;
+    while ((us >> (magnitude + 1)) != 0) magnitude++;
+
+    const int shift = magnitude - SUB_BITS;
+    return SUB_BUCKETS + shift * SUB_BUCKETS + int(us >> shift) - SUB_BUCKETS;
+}
+
+
+quint64
+LatencyHistogram::
+upperEdge(const int bucket)
+{
+    if (bucket < SUB_BUCKETS) return quint64(bucket);
+
+    const int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    const quint64 sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+
+void
+LatencyHistogram::
+record(const quint64 us)
+{
+    m_counts[bucketOf(us)]++;
+
+    if ((m_count == 0) || (us < m_min)) m_min = us;
+    if (us > m_max) m_max = us;
+    m_sum += us;
+    m_count++;
+}
+
+
+quint64
+LatencyHistogram::
+percentile(const double percent) const
+{
+    if (m_count == 0) return 0;
+
+    /// rank of the sample, then the bucket that holds it
+    quint64 rank = quint64(percent / 100.0 * m_count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > m_count) rank = m_count;
+
+    quint64 seen = 0;
+    for (int i = 0; i < m_counts.size(); i++)
+    {
+        seen += m_counts[i];
+        if (seen >= rank) return qMin(upperEdge(i), m_max);
+    }
+
+    return m_max;
+}
+
+
+BusStatistics::
+BusStatistics()
+{
+    reset();
+}
+
+
+void
+BusStatistics::
+reset()
+{
+    m_series.clear();
+    m_transactions = 0;
+    m_busyUs = 0;
+    m_firstUs = 0;
+    m_lastUs = 0;
+}
+
+
+void
+BusStatistics::
+record(const modbus_transaction_t & t)
+{
+    BusSeries & series = m_series[qMakePair(t.slave, t.function)];
+    series.slave = t.slave;
+    series.function = t.function;
+    series.requests++;
+
+    if (t.error == 0)
+    {
+        series.firstByte.record(t.first_byte - t.sent);
+        series.roundTrip.record(t.last_byte - t.sent);
+    }
+    else if (t.error == ETIMEDOUT) series.timeouts++;
+    else if (t.error == EMBBADCRC) series.crcErrors++;
+    else series.otherErrors++;
+
+    /// a transaction holds the bus from the request to its outcome
+    if (m_transactions == 0) m_firstUs = t.sent;
+    if (t.done > t.sent) m_busyUs += t.done - t.sent;
+    m_lastUs = qMax(m_lastUs, t.done);
+    m_transactions++;
+}
+
+
+double
+BusStatistics::
+dutyCycle() const
+{
+    if (m_lastUs <= m_firstUs) return 0;
+
+    return qMin(1.0, double(m_busyUs) / double(m_lastUs - m_firstUs));
+}
+
+
+QString
+BusStatistics::
+toCsv() const
+{
+    QStringList lines;
+    lines << "slave,function,requests,timeouts,crc_errors,errors,first_byte_p50_us,p50_us,p90_us,p99_us,max_us,mean_us";
+
+    foreach (const BusSeries & s, m_series)
+    {
+        lines << QString("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12")
+                 .arg(s.slave).arg(s.function).arg(s.requests).arg(s.timeouts).arg(s.crcErrors).arg(s.otherErrors)
+                 .arg(s.firstByte.percentile(50)).arg(s.roundTrip.percentile(50)).arg(s.roundTrip.percentile(90))
+                 .arg(s.roundTrip.percentile(99)).arg(s.roundTrip.max()).arg(s.roundTrip.mean(), 0, 'f', 0);
+    }
+
+    lines << QString("duty_cycle,%1").arg(dutyCycle(), 0, 'f', 4);
+
+    return lines.join("\n") + "\n";
+}
@@ -0,0 +1,78 @@
+#ifndef BUSSTATISTICS_H
+#define BUSSTATISTICS_H
+
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include "modbus.h"
+
+/// log-linear latency histogram in the spirit of HdrHistogram: every power
+/// of two of microseconds is split into 16 linear sub-buckets, so a recorded
+/// value is kept to about 6 % anywhere between 1 us and two minutes.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void reset();
+    void record(const quint64 us);
+
+    quint64 count() const { return m_count; }
+    quint64 min() const { return m_count ? m_min : 0; }
+    quint64 max() const { return m_max; }
+    double mean() const { return m_count ? (m_sum / m_count) : 0; }
+    double sum() const { return m_sum; }
+    quint64 percentile(const double percent) const;
+
+private:
+    static int bucketOf(quint64 us);
+    static quint64 upperEdge(const int bucket);
+
+    QVector<quint64> m_counts;
+    quint64 m_count;
+    quint64 m_min;
+    quint64 m_max;
+    double m_sum;
+};
+
+/// transactions of one function code to one slave
+struct BusSeries
+{
+    int slave;
+    int function;
+    quint64 requests;
+    quint64 timeouts;
+    quint64 crcErrors;
+    quint64 otherErrors;
+    LatencyHistogram firstByte;     /// request sent to first response byte
+    LatencyHistogram roundTrip;     /// request sent to last response byte
+
+    BusSeries() : slave(0), function(0), requests(0), timeouts(0), crcErrors(0), otherErrors(0) {}
+};
+
+/// aggregates the libmodbus transaction monitor per slave and function,
+/// along with the share of wall time the bus spent in transactions.
+class BusStatistics
+{
+public:
+    BusStatistics();
+
+    void reset();
+    void record(const modbus_transaction_t & transaction);
+
+    QList<BusSeries> series() const { return m_series.values(); }
+    double dutyCycle() const;
+    quint64 transactions() const { return m_transactions; }
+
+    QString toCsv() const;
+
+private:
+    QMap<QPair<int, int>, BusSeries> m_series;
+    quint64 m_transactions;
+    quint64 m_busyUs;
+    quint64 m_firstUs;
+    quint64 m_lastUs;
+};
+
+#endif // BUSSTATISTICS_H
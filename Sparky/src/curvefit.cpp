@@ -0,0 +1,214 @@
+#include "curvefit.h"
+#include <QtMath>
+
+/// a diagonal of R this small next to the first one means x has not moved enough yet
+#define CURVE_FIT_RANK_EPSILON  1e-7
+
+/// two sided 95 %, normal approximation
+#define CURVE_FIT_Z95           1.96
+
+
+CurveFit::
+CurveFit(const int degree)
+{
+    setDegree(degree);
+}
+
+
+void
+CurveFit::
+setDegree(const int degree)
+{
+    m_terms = qBound(1, degree + 1, CURVE_FIT_MAX_TERMS);
+    reset();
+}
+
+
+void
+CurveFit::
+reset()
+{
+    m_samples = 0;
+    m_origin = 0;
+    m_scale = 1;
+    m_rss = 0;
+    m_mean = 0;
+    m_m2 = 0;
+    m_minX = 0;
+    m_maxX = 0;
+
+    for (int i = 0; i < CURVE_FIT_MAX_TERMS; i++)
+    {
+        m_z[i] = 0;
+        for (int j = 0; j < CURVE_FIT_MAX_TERMS; j++) m_r[i][j] = 0;
+    }
+}
+
+
+void
+CurveFit::
+addSample(const double x, const double y)
+{
+    if (!m_samples)
+    {
+        m_origin = x;
+        m_scale = qMax(qAbs(x), 1.0);
+        m_minX = m_maxX = x;
+    }
+    m_minX = qMin(m_minX, x);
+    m_maxX = qMax(m_maxX, x);
+
+    double v[CURVE_FIT_MAX_TERMS];
+    basis(x, v);
+
+    /// rotate the new row [v | y] into R and Q'y, what is left of y is its residual
+    double r = y;
+    for (int k = 0; k < m_terms; k++)
+    {
+        if (v[k] == 0) continue;
+
+        const double h = qSqrt(m_r[k][k] * m_r[k][k] + v[k] * v[k]);
+        const double c = m_r[k][k] / h;
+        const double s = v[k] / h;
+
+        m_r[k][k] = h;
+        for (int j = k + 1; j < m_terms; j++)
+        {
+            const double t = m_r[k][j];
+            m_r[k][j] = c * t + s * v[j];
+            v[j] = c * v[j] - s * t;
+        }
+
+        const double t = m_z[k];
+        m_z[k] = c * t + s * r;
+        r = c * r - s * t;
+    }
+    m_rss += r * r;
+
+    m_samples++;
+    const double delta = y - m_mean;
+    m_mean += delta / m_samples;
+    m_m2 += delta * (y - m_mean);
+}
+
+
+bool
+CurveFit::
+isValid() const
+{
+    double a[CURVE_FIT_MAX_TERMS];
+    return (m_samples > m_terms) && solve(a);
+}
+
+
+/// in powers of x itself, ready for the equation table
+QVector<double>
+CurveFit::
+coefficients() const
+{
+    QVector<double> c(m_terms, 0.0);
+    double a[CURVE_FIT_MAX_TERMS];
+    if (!solve(a)) return c;
+
+    /// expand a_k ((x - origin) / scale)^k
+    for (int k = 0; k < m_terms; k++)
+    {
+        double binomial = 1;
+        for (int i = 0; i <= k; i++)
+        {
+            c[i] += a[k] * binomial * qPow(-m_origin, k - i) / qPow(m_scale, k);
+            binomial = binomial * (k - i) / (i + 1);
+        }
+    }
+
+    return c;
+}
+
+
+double
+CurveFit::
+value(const double x) const
+{
+    double a[CURVE_FIT_MAX_TERMS];
+    double v[CURVE_FIT_MAX_TERMS];
+    if (!solve(a)) return 0;
+
+    basis(x, v);
+    double y = 0;
+    for (int k = 0; k < m_terms; k++) y += a[k] * v[k];
+
+    return y;
+}
+
+
+/// rms of the residuals, corrected for the fitted terms
+double
+CurveFit::
+residual() const
+{
+    return (m_samples > m_terms) ? qSqrt(m_rss / (m_samples - m_terms)) : 0;
+}
+
+
+double
+CurveFit::
+rSquared() const
+{
+    return (m_m2 > 0) ? 1 - m_rss / m_m2 : 1;
+}
+
+
+/// half width of the confidence band of the fitted value at x:
+/// z * sigma * sqrt(v' (R'R)^-1 v), with R' w = v solved forward
+double
+CurveFit::
+confidence(const double x) const
+{
+    if (!isValid()) return 0;
+
+    double v[CURVE_FIT_MAX_TERMS];
+    double w[CURVE_FIT_MAX_TERMS];
+    basis(x, v);
+
+    double norm = 0;
+    for (int k = 0; k < m_terms; k++)
+    {
+        double sum = v[k];
+        for (int j = 0; j < k; j++) sum -= m_r[j][k] * w[j];
+        w[k] = sum / m_r[k][k];
+        norm += w[k] * w[k];
+    }
+
+    return CURVE_FIT_Z95 * residual() * qSqrt(norm);
+}
+
+
+void
+CurveFit::
+basis(const double x, double * v) const
+{
+    const double u = (x - m_origin) / m_scale;
+
+    v[0] = 1;
+    for (int k = 1; k < m_terms; k++) v[k] = v[k - 1] * u;
+}
+
+
+/// back substitution R a = Q'y in the scaled basis
+bool
+CurveFit::
+solve(double * a) const
+{
+    if (m_samples < m_terms) return false;
+
+    for (int k = m_terms - 1; k >= 0; k--)
+    {
+        if (qAbs(m_r[k][k]) <= CURVE_FIT_RANK_EPSILON * qAbs(m_r[0][0])) return false;
+
+        double sum = m_z[k];
+        for (int j = k + 1; j < m_terms; j++) sum -= m_r[k][j] * a[j];
+        a[k] = sum / m_r[k][k];
+    }
+
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef CURVEFIT_H
+#define CURVEFIT_H
+
+#include <QVector>
+
+#define CURVE_FIT_MAX_TERMS     4
+
+/// online least squares polynomial y = c0 + c1 x + ... + cn x^n. every
+/// sample is rotated into the triangular factor R of the design matrix
+/// (Givens QR update) and folded into Welford's running variance of y,
+/// so a sample costs a fixed handful of operations and nothing is kept
+/// per sample. the coefficients, residual and confidence band are one
+/// back substitution away at any time. x is taken relative to the first
+/// sample and scaled by it, which keeps the powers well conditioned.
+class CurveFit
+{
+public:
+    explicit CurveFit(const int degree = 1);
+
+    void setDegree(const int degree);
+    void reset();
+    void addSample(const double x, const double y);
+
+    int degree() const { return m_terms - 1; }
+    int samples() const { return m_samples; }
+    double minX() const { return m_minX; }
+    double maxX() const { return m_maxX; }
+
+    bool isValid() const;
+    QVector<double> coefficients() const;
+    double value(const double x) const;
+    double residual() const;
+    double rSquared() const;
+    double confidence(const double x) const;
+
+private:
+    void basis(const double x, double * v) const;
+    bool solve(double * a) const;
+
+    int m_terms;
+    int m_samples;
+    double m_origin;
+    double m_scale;
+    double m_r[CURVE_FIT_MAX_TERMS][CURVE_FIT_MAX_TERMS];
+    double m_z[CURVE_FIT_MAX_TERMS];
+    double m_rss;
+    double m_mean;
+    double m_m2;
+    double m_minX;
+    double m_maxX;
+};
+
+#endif // CURVEFIT_H
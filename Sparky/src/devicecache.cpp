@@ -0,0 +1,42 @@
+#include "devicecache.h"
+
+
+bool
+DeviceCache::
+find(const QString & port, const int slave, DeviceIdentity & identity) const
+{
+    QMap<Key, DeviceIdentity>::const_iterator it = m_devices.constFind(Key(port, slave));
+    if (it == m_devices.constEnd()) return false;
+
+    identity = it.value();
+    return true;
+}
+
+
+void
+DeviceCache::
+insert(const QString & port, const int slave, const DeviceIdentity & identity)
+{
+    m_devices[Key(port, slave)] = identity;
+}
+
+
+void
+DeviceCache::
+invalidate(const QString & port, const int slave)
+{
+    m_devices.remove(Key(port, slave));
+}
+
+
+void
+DeviceCache::
+invalidate(const QString & port)
+{
+    QMap<Key, DeviceIdentity>::iterator it = m_devices.begin();
+    while (it != m_devices.end())
+    {
+        if (it.key().first == port) it = m_devices.erase(it);
+        else ++it;
+    }
+}
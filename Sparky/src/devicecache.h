@@ -0,0 +1,47 @@
+#ifndef DEVICECACHE_H
+#define DEVICECACHE_H
+
+#include <QMap>
+#include <QPair>
+#include <QString>
+
+/// response timeout of a validated pipe, a multiple of its slowest round trip
+#define DEVICE_TIMEOUT_FACTOR   4
+#define DEVICE_MIN_TIMEOUT_US   50000
+#define DEVICE_MAX_TIMEOUT_US   500000
+
+/// what validateSerialNumber() learned about one analyzer
+struct DeviceIdentity
+{
+    int serialNumber;
+    bool isEEA;
+    int mapVersion;     /// device::Identity::mapVersion of the family it was validated against
+    int timeoutUs;      /// response timeout from its measured round trips
+
+    DeviceIdentity() : serialNumber(0), isEEA(false), mapVersion(0), timeoutUs(0) {}
+};
+
+/// identities of the analyzers validated since the program started, by
+/// port and slave. main() keeps it across RESTART_CODE together with the
+/// open buses, so back to back runs on an unchanged rig skip the unlock,
+/// read, lock sequence of every pipe. an entry goes away when its port
+/// is unplugged or reopened and when a transaction with it fails.
+class DeviceCache
+{
+public:
+    bool find(const QString & port, const int slave, DeviceIdentity & identity) const;
+    void insert(const QString & port, const int slave, const DeviceIdentity & identity);
+
+    void invalidate(const QString & port, const int slave);
+    void invalidate(const QString & port);
+    void clear() { m_devices.clear(); }
+
+private:
+    typedef QPair<QString, int> Key;
+
+    QMap<Key, DeviceIdentity> m_devices;
+};
+
+extern DeviceCache * globalDevices;
+
+#endif // DEVICECACHE_H
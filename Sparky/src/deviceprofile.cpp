@@ -0,0 +1,15 @@
+#include "deviceprofile.h"
+
+/// storage for the constexpr tables, they are indexed at run time
+
+namespace device
+{
+
+constexpr Identity Eea::identity;
+constexpr Register Eea::Pipe::registers[];
+constexpr Register Eea::Master::registers[];
+
+constexpr Identity Razor::identity;
+constexpr Register Razor::Pipe::registers[];
+
+}
@@ -0,0 +1,229 @@
+#ifndef DEVICEPROFILE_H
+#define DEVICEPROFILE_H
+
+#include <string.h>
+#include <utility>
+#include "modbus.h"
+
+/// register maps of the analyzer families. every family declares its
+/// registers once as a constexpr table; the read plan (which registers
+/// share one request) and the decoder of every field are worked out by
+/// the compiler, so a poll is a few block reads and a fixed sequence of
+/// word shuffles with no switch on the data type or function code.
+/// a new analyzer model is one more table below.
+namespace device
+{
+
+enum Kind { Float, Int, Coil };
+enum WordOrder { HighWordFirst, LowWordFirst };
+
+struct Register
+{
+    int address;        /// 1 based, as printed in the manuals
+    Kind kind;
+    WordOrder order;
+};
+
+/// one request covering one or more registers of a table
+struct Block
+{
+    int first;          /// 0 based address sent on the wire
+    int count;
+    int offset;         /// where the block lands in the word buffer
+};
+
+constexpr int width(const Register & r) { return (r.kind == Float) ? 2 : 1; }
+
+/// read plan of a table: registers sorted by address and merged into one
+/// block when the gap to the previous one is at most Table::maxGap words
+/// (reading a few unused words is cheaper than another turnaround).
+template <class Table>
+struct Plan
+{
+    Block blocks[Table::count];
+    int size;
+    int words;
+    int slot[Table::count];     /// index of each register in the word buffer
+};
+
+template <class Table>
+constexpr Plan<Table> makePlan()
+{
+    Plan<Table> plan = {};
+    int order[Table::count] = {};
+
+    for (int i = 0; i < Table::count; i++)
+    {
+        int j = i;
+        while ((j > 0) && (Table::registers[order[j - 1]].address > Table::registers[i].address))
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (int i = 0; i < Table::count; i++)
+    {
+        const Register & r = Table::registers[order[i]];
+        const int first = r.address - 1;
+        const int last = plan.size - 1;
+
+        if ((plan.size > 0) && (first - (plan.blocks[last].first + plan.blocks[last].count) <= Table::maxGap) &&
+            (first + width(r) - plan.blocks[last].first <= MODBUS_MAX_READ_REGISTERS))
+        {
+            const int end = first + width(r) - plan.blocks[last].first;
+            if (end > plan.blocks[last].count)
+            {
+                plan.words += end - plan.blocks[last].count;
+                plan.blocks[last].count = end;
+            }
+        }
+        else
+        {
+            plan.blocks[plan.size].first = first;
+            plan.blocks[plan.size].count = width(r);
+            plan.blocks[plan.size].offset = plan.words;
+            plan.words += width(r);
+            plan.size++;
+        }
+
+        const Block & owner = plan.blocks[plan.size - 1];
+        plan.slot[order[i]] = owner.offset + first - owner.first;
+    }
+
+    return plan;
+}
+
+template <Kind K, WordOrder O> struct Decoder;
+
+template <WordOrder O>
+struct Decoder<Float, O>
+{
+    static double decode(const uint16_t * words)
+    {
+        const uint32_t bits = (O == HighWordFirst) ? ((uint32_t(words[0]) << 16) | words[1]) : ((uint32_t(words[1]) << 16) | words[0]);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+};
+
+template <WordOrder O>
+struct Decoder<Int, O>
+{
+    static double decode(const uint16_t * words) { return words[0]; }
+};
+
+template <WordOrder O>
+struct Decoder<Coil, O>
+{
+    static double decode(const uint16_t * words) { return words[0] ? 1 : 0; }
+};
+
+template <class Table, size_t... I>
+inline void decodeAll(const uint16_t * words, const int * slot, double * values, std::index_sequence<I...>)
+{
+    const int expand[] = { 0, ((values[I] = Decoder<Table::registers[I].kind, Table::registers[I].order>::decode(words + slot[I])), 0)... };
+    (void) expand;
+}
+
+/// poll every register of a table from one device, the blocks go out as one
+/// batch addressed to it. values are indexed like Table::registers and only
+/// written when all blocks arrived.
+template <class Table>
+bool read(modbus_t * ctx, const int slave, const bool isExtended, double * values)
+{
+    static constexpr Plan<Table> plan = makePlan<Table>();
+    uint16_t words[plan.words];
+    modbus_read_request_t requests[plan.size];
+
+    for (int b = 0; b < plan.size; b++)
+    {
+        const Block & block = plan.blocks[b];
+        requests[b].slave = slave;
+        requests[b].extended = isExtended;
+        requests[b].function = Table::function;
+        requests[b].addr = block.first;
+        requests[b].nb = block.count;
+        requests[b].dest = words + block.offset;
+    }
+    if (modbus_read_batch(ctx, requests, plan.size) != plan.size) return false;
+
+    decodeAll<Table>(words, plan.slot, values, std::make_index_sequence<Table::count>());
+    return true;
+}
+
+/// field indexes shared by the pipe tables of every family
+enum PipeField { PipeTemperature, PipeFrequency, PipeOilRp, PipeMeasuredAi, PipeTrimmedAi, PIPE_FIELDS };
+
+/// field indexes of the master pipe table
+enum MasterField { MasterWatercut, MasterSalinity, MasterOilAdjust, MasterOilRp, MasterTemperature, MasterFrequency, MasterPhase, MASTER_FIELDS };
+
+/// identity and reference registers, polled one at a time outside the loop
+struct Identity
+{
+    int serialNumber;
+    int watercut;
+    int salinity;
+    int oilAdjust;
+    int waterAdjust;
+    int mapVersion;     /// bump when a register of the family moves, drops the cached identities
+};
+
+/// EEA analyzers, the master pipe of every loop is one of these
+struct Eea
+{
+    static constexpr Identity identity = { 1, 11, 21, 23, 25, 1 };
+
+    struct Pipe
+    {
+        enum { count = PIPE_FIELDS, maxGap = 4, function = MODBUS_FC_READ_INPUT_REGISTERS };
+        static constexpr Register registers[count] = {
+            { 15, Float, HighWordFirst },   /// temperature
+            { 111, Float, HighWordFirst },  /// frequency
+            { 115, Float, HighWordFirst },  /// oil reflected power
+            { 173, Float, HighWordFirst },  /// measured analog input
+            { 175, Float, HighWordFirst },  /// trimmed analog input
+        };
+    };
+
+    struct Master
+    {
+        enum { count = MASTER_FIELDS, maxGap = 4, function = MODBUS_FC_READ_INPUT_REGISTERS };
+        static constexpr Register registers[count] = {
+            { 29, Float, HighWordFirst },   /// watercut
+            { 21, Float, HighWordFirst },   /// salinity
+            { 23, Float, HighWordFirst },   /// oil adjust
+            { 115, Float, HighWordFirst },  /// oil reflected power
+            { 15, Float, HighWordFirst },   /// temperature
+            { 111, Float, HighWordFirst },  /// frequency
+            { 17, Float, HighWordFirst },   /// phase
+        };
+    };
+};
+
+/// RAZOR analyzers, pipes only
+struct Razor
+{
+    static constexpr Identity identity = { 201, 3, 9, 15, 17, 1 };
+
+    struct Pipe
+    {
+        enum { count = PIPE_FIELDS, maxGap = 4, function = MODBUS_FC_READ_INPUT_REGISTERS };
+        static constexpr Register registers[count] = {
+            { 33, Float, HighWordFirst },   /// REG_TEMP_USER
+            { 19, Float, HighWordFirst },   /// frequency
+            { 61, Float, HighWordFirst },   /// oil reflected power
+            { 173, Float, HighWordFirst },  /// measured analog input
+            { 175, Float, HighWordFirst },  /// trimmed analog input
+        };
+    };
+};
+
+/// a pipe poll bound to the table of one family, picked in onUpdateRegisters()
+typedef bool (*Reader)(modbus_t *, int, bool, double *);
+
+}
+
+#endif // DEVICEPROFILE_H
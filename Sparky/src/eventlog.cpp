@@ -0,0 +1,171 @@
+#include "eventlog.h"
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+/// how often the writer wakes up to drain the queue
+#define DRAIN_INTERVAL_MS       50
+
+/// slots of the ring, a power of two. events beyond it are dropped and counted
+#define RING_SIZE               65536
+
+
+EventLog::
+EventLog() : m_ring(new Event[RING_SIZE]), m_enqueue(0), m_dequeue(0), m_posting(0), m_dropped(0), m_running(0)
+{
+    for (int i = 0; i < RING_SIZE; i++) m_ring[i].sequence.store(i);
+    m_clock.start();
+}
+
+
+EventLog::
+~EventLog()
+{
+    close();
+    delete [] m_ring;
+}
+
+
+bool
+EventLog::
+open(const QString & path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) return false;
+
+    m_running.store(1);
+
+    QVariantMap fields;
+    fields["wall"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    fields["monotonic"] = m_clock.isMonotonic();
+    post("log_open", fields);
+
+    start(QThread::LowPriority);
+
+    return true;
+}
+
+
+void
+EventLog::
+close()
+{
+    if (!m_running.fetchAndStoreOrdered(0)) return;
+    wait();
+
+    /// posts that passed the running check before it was cleared land now,
+    /// later ones are rejected
+    while (m_posting.loadAcquire()) QThread::yieldCurrentThread();
+
+    drain();
+    m_file.close();
+}
+
+
+void
+EventLog::
+post(const char * name, const QVariantMap & fields)
+{
+    m_posting.fetchAndAddOrdered(1);
+
+    /// never let a stalled disk grow the queue without bound
+    if (m_running.loadAcquire() && !push(name, fields)) m_dropped.fetchAndAddRelaxed(1);
+
+    m_posting.fetchAndAddRelease(-1);
+}
+
+
+/// false when the ring is full
+bool
+EventLog::
+push(const char * name, const QVariantMap & fields)
+{
+    quint32 position = quint32(m_enqueue.loadAcquire());
+    Event * slot;
+
+    for (;;)
+    {
+        slot = &m_ring[position & (RING_SIZE - 1)];
+        const qint32 lag = qint32(quint32(slot->sequence.loadAcquire()) - position);
+
+        if (lag < 0) return false;
+        if ((lag == 0) && m_enqueue.testAndSetRelaxed(int(position), int(position + 1))) break;
+
+        /// another producer took this position
+        position = quint32(m_enqueue.loadAcquire());
+    }
+
+    slot->ns = m_clock.nsecsElapsed();
+    slot->name = name;
+    slot->fields = fields;
+    slot->sequence.storeRelease(int(position + 1));
+
+    return true;
+}
+
+
+/// only the writer pops, false when the next slot is not filled yet
+bool
+EventLog::
+pop(Event & event)
+{
+    Event & slot = m_ring[m_dequeue & (RING_SIZE - 1)];
+    if (quint32(slot.sequence.loadAcquire()) != m_dequeue + 1) return false;
+
+    event.ns = slot.ns;
+    event.name = slot.name;
+    event.fields.swap(slot.fields);
+    slot.fields.clear();
+
+    slot.sequence.storeRelease(int(m_dequeue + RING_SIZE));
+    m_dequeue++;
+
+    return true;
+}
+
+
+void
+EventLog::
+drain()
+{
+    Event event;
+    bool written = false;
+
+    while (pop(event))
+    {
+        QJsonObject line = QJsonObject::fromVariantMap(event.fields);
+        line["t"] = event.ns / 1e9;
+        line["event"] = QString::fromLatin1(event.name);
+
+        m_file.write(QJsonDocument(line).toJson(QJsonDocument::Compact));
+        m_file.write("\n");
+        written = true;
+    }
+
+    if (written) m_file.flush();
+}
+
+
+void
+EventLog::
+run()
+{
+    quint64 reported = 0;
+
+    while (m_running.load())
+    {
+        msleep(DRAIN_INTERVAL_MS);
+        drain();
+
+        /// leave a trace of what was lost
+        if (dropped() != reported)
+        {
+            reported = dropped();
+            m_file.write(QString("{\"dropped\":%1,\"event\":\"log_overflow\",\"t\":%2}\n").arg(reported).arg(m_clock.nsecsElapsed() / 1e9).toLatin1());
+        }
+    }
+
+    drain();
+}
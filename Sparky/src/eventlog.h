@@ -0,0 +1,57 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <QVariantMap>
+
+/// structured event log. post() only claims a slot of a preallocated
+/// lock-free ring, a background thread drains it and appends one JSON
+/// object per line, so posting stays cheap enough to be used per bus
+/// frame and never allocates. timestamps come from the monotonic clock,
+/// the first line maps them to wall time.
+class EventLog : public QThread
+{
+public:
+    EventLog();
+    ~EventLog();
+
+    bool open(const QString & path);
+    void close();
+
+    void post(const char * event, const QVariantMap & fields = QVariantMap());
+
+    quint64 dropped() const { return quint64(m_dropped.load()); }
+
+protected:
+    void run();
+
+private:
+    struct Event
+    {
+        QAtomicInt sequence;    /// the position the slot is free or full for
+        qint64 ns;
+        const char * name;
+        QVariantMap fields;
+    };
+
+    bool push(const char * name, const QVariantMap & fields);
+    bool pop(Event & event);
+    void drain();
+
+    QElapsedTimer m_clock;
+    QFile m_file;
+
+    /// Vyukov bounded queue: producers claim positions, the writer follows
+    Event * m_ring;
+    QAtomicInt m_enqueue;
+    quint32 m_dequeue;
+
+    QAtomicInt m_posting;       /// producers between the running check and their push
+    QAtomicInt m_dropped;
+    QAtomicInt m_running;
+};
+
+#endif // EVENTLOG_H
@@ -0,0 +1,104 @@
+#include "injectioncontroller.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <QThread>
+
+/// the last few milliseconds before a deadline are spun instead of slept,
+/// timer wakeups on a loaded desktop are not any finer than that
+#define SPIN_MS             3
+
+/// attempts to release the coil before giving up
+#define OFF_RETRIES         3
+
+/// weight of a new sample in the coil write latency estimate
+#define LATENCY_ALPHA       0.2
+
+
+InjectionController::
+InjectionController() : m_latencyMs(-1), m_delivered(0)
+{
+}
+
+
+bool
+InjectionController::
+writeCoil(modbus_t * ctx, const int slave, const int coil, const bool value, qint64 & startNs, qint64 & latencyNs)
+{
+    modbus_set_slave(ctx, slave);
+
+    startNs = m_clock.nsecsElapsed();
+    const int rc = modbus_write_bit(ctx, coil, value);
+    latencyNs = m_clock.nsecsElapsed() - startNs;
+
+    if (rc == -1) return false;
+
+    const double ms = latencyNs / 1e6;
+    m_latencyMs = (m_latencyMs < 0) ? ms : (m_latencyMs + LATENCY_ALPHA * (ms - m_latencyMs));
+
+    return true;
+}
+
+
+void
+InjectionController::
+waitUntil(const qint64 deadlineNs)
+{
+    const qint64 remainingMs = (deadlineNs - m_clock.nsecsElapsed()) / 1000000;
+
+    /// keep the gui alive for the bulk of the wait
+    if (remainingMs > SPIN_MS)
+    {
+        QEventLoop loop;
+        QTimer timer;
+        timer.setTimerType(Qt::PreciseTimer);
+        timer.setSingleShot(true);
+        QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+        timer.start(remainingMs - SPIN_MS);
+        loop.exec();
+    }
+
+    while (m_clock.nsecsElapsed() < deadlineNs) QThread::yieldCurrentThread();
+}
+
+
+double
+InjectionController::
+run(modbus_t * ctx, const int slave, const int coil, const double seconds)
+{
+    qint64 onStart = 0, onLatency = 0;
+    qint64 offStart = 0, offLatency = 0;
+
+    if (!m_clock.isValid()) m_clock.start();
+    m_delivered = 0;
+
+    if (!writeCoil(ctx, slave, coil, true, onStart, onLatency))
+    {
+        /// the request may still have reached the box, make sure it is off
+        if (!release(ctx, slave, coil, offStart, offLatency)) return -1;
+        return 0;
+    }
+
+    /// a coil switches about half a round trip after its request is sent,
+    /// so both edges are placed at the midpoint of their transactions
+    const qint64 onEdge = onStart + onLatency / 2;
+    const qint64 offLead = (m_latencyMs < 0) ? (onLatency / 2) : qint64(m_latencyMs * 1e6 / 2);
+    waitUntil(onEdge + qint64(seconds * 1e9) - offLead);
+
+    /// an unconfirmed release books nothing, the pump may still be running
+    if (!release(ctx, slave, coil, offStart, offLatency)) return -1;
+
+    m_delivered = ((offStart + offLatency / 2) - onEdge) / 1e9;
+
+    return m_delivered;
+}
+
+
+bool
+InjectionController::
+release(modbus_t * ctx, const int slave, const int coil, qint64 & startNs, qint64 & latencyNs)
+{
+    bool isOff = false;
+    for (int i = 0; (i < OFF_RETRIES) && !isOff; i++) isOff = writeCoil(ctx, slave, coil, false, startNs, latencyNs);
+
+    return isOff;
+}
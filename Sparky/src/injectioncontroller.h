@@ -0,0 +1,34 @@
+#ifndef INJECTIONCONTROLLER_H
+#define INJECTIONCONTROLLER_H
+
+#include <QElapsedTimer>
+#include "modbus.h"
+
+/// drives a pump coil for a timed injection.
+/// the deadline is kept on the monotonic clock from the moment the "on"
+/// request is sent, and the "off" request is advanced by the coil write
+/// latency measured on previous requests, so the pump runs for the asked
+/// time rather than the asked time plus bus and event loop overhead.
+class InjectionController
+{
+public:
+    InjectionController();
+
+    /// seconds delivered, 0 when the pump was never started, -1 when it
+    /// could not be released and may still be running
+    double run(modbus_t * ctx, const int slave, const int coil, const double seconds);
+
+    double latency() const { return m_latencyMs; }
+    double delivered() const { return m_delivered; }
+
+private:
+    bool writeCoil(modbus_t * ctx, const int slave, const int coil, const bool value, qint64 & startNs, qint64 & latencyNs);
+    bool release(modbus_t * ctx, const int slave, const int coil, qint64 & startNs, qint64 & latencyNs);
+    void waitUntil(const qint64 deadlineNs);
+
+    QElapsedTimer m_clock;
+    double m_latencyMs;
+    double m_delivered;
+};
+
+#endif // INJECTIONCONTROLLER_H
@@ -0,0 +1,298 @@
+#include "legacyimporter.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define LEGACY_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// fields of a data row, the 19 columns plus the tune type
+#define LEGACY_FIELDS           20
+#define LEGACY_TUNE_TYPE        3
+
+/// the "=====" line ends the header, it is never further down than this
+#define LEGACY_HEADER_LINES     12
+
+/// a data row is about this long, used to size the columns up front
+#define LEGACY_ROW_BYTES        200
+
+/// every extension runTempRun() and runInjection() write
+static const char * extensions[] = { "*.HCI", "*.HCR", "*.FCI", "*.FCR", "*.MCI", "*.MCR", "*.LCT", "*.LCI", "*.LCR" };
+
+
+static inline bool isBlank(const char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+
+#ifdef LEGACY_SSE2
+static inline int lowestBit(const unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+
+/// one bit per byte of the sixteen at p that is a blank
+static inline unsigned blankMask(const char * p)
+{
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+                                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+    return unsigned(_mm_movemask_epi8(blank));
+}
+
+
+static inline unsigned newlineMask(const char * p)
+{
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))));
+}
+#endif
+
+
+/// first byte at or after p that is not a blank, a newline stops it
+static inline const char * skipBlanks(const char * p, const char * end)
+{
+#ifdef LEGACY_SSE2
+    while (end - p >= 16)
+    {
+        const unsigned mask = ~blankMask(p) & 0xffff;
+        if (mask) return p + lowestBit(mask);
+        p += 16;
+    }
+#endif
+    while ((p < end) && isBlank(*p)) p++;
+    return p;
+}
+
+
+/// first blank or newline at or after p
+static inline const char * skipField(const char * p, const char * end)
+{
+#ifdef LEGACY_SSE2
+    while (end - p >= 16)
+    {
+        const unsigned mask = blankMask(p) | newlineMask(p);
+        if (mask) return p + lowestBit(mask);
+        p += 16;
+    }
+#endif
+    while ((p < end) && !isBlank(*p) && (*p != '\n')) p++;
+    return p;
+}
+
+
+/// fixed point numbers as written by QString::arg() are converted
+/// directly, anything else (exponents, nan) goes the slow way
+static bool toNumber(const char * p, const char * end, double & value)
+{
+    static const double scale[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+    const char * s = p;
+    const bool isNegative = (p < end) && (*p == '-');
+    if ((p < end) && ((*p == '-') || (*p == '+'))) p++;
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int fraction = -1;
+    for (; p < end; p++)
+    {
+        if ((*p >= '0') && (*p <= '9'))
+        {
+            mantissa = mantissa * 10 + quint64(*p - '0');
+            digits++;
+            if (fraction >= 0) fraction++;
+        }
+        else if ((*p == '.') && (fraction < 0)) fraction = 0;
+        else break;
+    }
+
+    /// up to 15 digits the mantissa and the scale are exact doubles, so one division rounds correctly
+    if ((p == end) && (digits > 0) && (digits <= 15))
+    {
+        value = double(mantissa) / scale[(fraction > 0) ? fraction : 0];
+        if (isNegative) value = -value;
+        return true;
+    }
+
+    bool ok;
+    value = QByteArray::fromRawData(s, int(end - s)).toDouble(&ok);
+    return ok;
+}
+
+
+/// end of the line starting at p, the newline itself or end
+static inline const char * lineEnd(const char * p, const char * end)
+{
+    const char * newline = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+    return newline ? newline : end;
+}
+
+
+/// "SN8756 | FULLCUT | Mon Oct 19 10:20:30 2026 | L1P2 | Sparky 0.0.8"
+static void parseHeader1(const QString & header1, LegacyFile & file)
+{
+    const QStringList fields = header1.split(" | ");
+    if (fields.size() < 5) return;
+
+    file.sn = fields[0].startsWith("SN") ? fields[0].mid(2).trimmed() : fields[0].trimmed();
+    file.mode = fields[1].trimmed();
+    file.written = QDateTime::fromString(fields[2].trimmed(), Qt::TextDate);
+    file.version = fields[4].trimmed();
+
+    QRegExp loopPipe("L(\\d+)P(\\d+)");
+    if (loopPipe.exactMatch(fields[3].trimmed()))
+    {
+        file.loop = loopPipe.cap(1).toInt();
+        file.pipe = loopPipe.cap(2).toInt() - 1;
+    }
+}
+
+
+QStringList
+LegacyImporter::
+find(const QString & root)
+{
+    QStringList filters;
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) filters << extensions[i];
+
+    QStringList paths;
+    QDirIterator it(root, filters, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) paths << it.next();
+
+    return paths;
+}
+
+
+LegacyFile
+LegacyImporter::
+load(const QString & path)
+{
+    LegacyFile file;
+    file.path = path;
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+    {
+        file.error = f.errorString();
+        return file;
+    }
+    file.bytes = f.size();
+
+    /// shares that can not be mapped are read instead
+    QByteArray buffer;
+    const char * begin = reinterpret_cast<const char *>(file.bytes ? f.map(0, file.bytes) : NULL);
+    if (!begin)
+    {
+        buffer = f.readAll();
+        begin = buffer.constData();
+    }
+    const char * const end = begin + file.bytes;
+
+    /// header0..header2 by position, the data starts below the "=====" line
+    QList<QByteArray> header;
+    const char * p = begin;
+    bool isHeader = true;
+    while (isHeader && (p < end) && (header.size() < LEGACY_HEADER_LINES))
+    {
+        const char * e = lineEnd(p, end);
+        QByteArray line(p, int(e - p));
+        if (line.endsWith('\r')) line.chop(1);
+        isHeader = !line.startsWith("=====");
+        header << line;
+        p = (e < end) ? e + 1 : end;
+    }
+
+    if (isHeader || (header.size() < 3))
+    {
+        file.error = "no calibration data header";
+        return file;
+    }
+
+    file.product = QString::fromLatin1(header[0]).startsWith("EEA") ? "EEA" : "RAZOR";
+    parseHeader1(QString::fromLatin1(header[1]), file);
+    file.range = QString::fromLocal8Bit(header[2]).trimmed();
+    if (!file.written.isValid()) file.written = QFileInfo(f).lastModified();
+
+    const int estimate = int((end - p) / LEGACY_ROW_BYTES) + 1;
+    for (int c = 0; c < LegacyFile::COLUMNS; c++) file.columns[c].reserve(estimate);
+
+    double row[LegacyFile::COLUMNS];
+    while (p < end)
+    {
+        int field = 0;
+        bool isValid = true;
+
+        for (;;)
+        {
+            p = skipBlanks(p, end);
+            if ((p == end) || (*p == '\n')) break;
+
+            const char * e = skipField(p, end);
+            if (field >= LEGACY_FIELDS) isValid = false;
+            else if (field != LEGACY_TUNE_TYPE)
+            {
+                const int column = (field < LEGACY_TUNE_TYPE) ? field : field - 1;
+                if (!toNumber(p, e, row[column])) isValid = false;
+            }
+            field++;
+            p = e;
+        }
+        if (p < end) p++;
+
+        if (field == 0) continue;
+        if (!isValid || (field != LEGACY_FIELDS))
+        {
+            file.rejected++;
+            continue;
+        }
+
+        for (int c = 0; c < LegacyFile::COLUMNS; c++) file.columns[c].append(row[c]);
+    }
+
+    return file;
+}
+
+
+LegacySummary
+LegacyImporter::
+summarize(const QString & path)
+{
+    LegacySummary summary;
+    summary.file = load(path);
+    summary.rows = summary.file.rows();
+
+    const QVector<double> & temperature = summary.file.columns[LegacyFile::Temperature];
+    const QVector<double> & frequency = summary.file.columns[LegacyFile::Frequency];
+    for (int i = 0; i < summary.rows; i++)
+    {
+        if (!i)
+        {
+            summary.minTemperature = summary.maxTemperature = temperature[i];
+            summary.minFrequency = summary.maxFrequency = frequency[i];
+        }
+        summary.minTemperature = qMin(summary.minTemperature, temperature[i]);
+        summary.maxTemperature = qMax(summary.maxTemperature, temperature[i]);
+        summary.minFrequency = qMin(summary.minFrequency, frequency[i]);
+        summary.maxFrequency = qMax(summary.maxFrequency, frequency[i]);
+    }
+
+    for (int c = 0; c < LegacyFile::COLUMNS; c++) summary.file.columns[c] = QVector<double>();
+
+    return summary;
+}
@@ -0,0 +1,74 @@
+#ifndef LEGACYIMPORTER_H
+#define LEGACYIMPORTER_H
+
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/// one calibration file as written by runTempRun() and runInjection(),
+/// its header fields and the data rows stored column by column
+struct LegacyFile
+{
+    /// numeric columns of a data row, the tune type ("INT") is not kept
+    enum Column
+    {
+        Time, Watercut, Osc, TuningVoltage, Frequency, IncidentPower, ReflectedPower,
+        Temperature, Pressure, AnalogInput, UserInput, InjectionTime,
+        MasterTemperature, MasterOilAdjust, MasterFrequency, MasterWatercut, MasterOilRp, MasterPhase,
+        Comment, COLUMNS
+    };
+
+    QString path;
+    QString error;              /// empty when the file was read
+    qint64 bytes;
+
+    QString product;            /// header0, "EEA" or "RAZOR"
+    QString sn;                 /// header1 fields
+    QString mode;
+    QDateTime written;
+    int loop;
+    int pipe;                   /// 0 based like PIPE[]
+    QString version;
+    QString range;              /// header2, the temperature or injection range
+
+    QVector<double> columns[COLUMNS];
+    int rejected;               /// data lines that did not parse
+
+    LegacyFile() : bytes(0), loop(0), pipe(0), rejected(0) {}
+
+    int rows() const { return columns[Time].size(); }
+    bool isValid() const { return error.isEmpty(); }
+};
+
+/// what the run catalog keeps of a file: its header and the range of its
+/// data. the columns are dropped on the worker that read them, so an
+/// archive import holds no more than one file per core at a time.
+struct LegacySummary
+{
+    LegacyFile file;            /// header fields only, the columns are empty
+    int rows;
+    double minTemperature;
+    double maxTemperature;
+    double minFrequency;
+    double maxFrequency;
+
+    LegacySummary() : rows(0), minTemperature(0), maxTemperature(0), minFrequency(0), maxFrequency(0) {}
+};
+
+/// reads archives of fixed-width calibration files. a file is mapped
+/// into memory and split on blanks sixteen bytes at a time, numbers are
+/// converted in place without building a string per field, so a file
+/// costs about what it takes to read it. load() keeps no state and is
+/// safe to run on every core at once, see QtConcurrent::mapped().
+class LegacyImporter
+{
+public:
+    /// calibration files below a directory, any depth
+    static QStringList find(const QString & root);
+
+    static LegacyFile load(const QString & path);
+    static LegacySummary summarize(const QString & path);
+};
+
+#endif // LEGACYIMPORTER_H
@@ -0,0 +1,239 @@
+#include "linktuner.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+#include <functional>
+#include "modbus-rtu.h"
+#include "devicecache.h"
+
+/// polls of every device at the rate the bus starts at, and at a candidate rate
+#define LINK_BASELINE_POLLS     20
+#define LINK_LOAD_POLLS         100
+#define LINK_MAX_ERROR_RATE     0.01
+
+/// a poll and its answer on the wire, 11 bits per character
+#define LINK_FRAME_CHARACTERS   40
+
+/// an analyzer answers the switch at the old rate, then reopens its UART
+#define LINK_SETTLE_MS          100
+#define LINK_RETRIES            3
+
+/// the analyzers take the rate in hundreds of baud
+#define LINK_BAUD_UNIT          100
+
+
+LinkTuner::
+LinkTuner(QObject * parent) : QObject(parent), m_isCanceled(0), m_turnaroundUs(DEVICE_MIN_TIMEOUT_US)
+{
+}
+
+
+LinkResult
+LinkTuner::
+tune(modbus_t * ctx, const QList<LinkDevice> & devices, const QList<int> & rates, const int baudRegister)
+{
+    LinkResult result;
+    m_isCanceled.store(0);
+
+    result.oldBaud = result.baud = modbus_rtu_get_baud(ctx);
+    if (result.oldBaud <= 0)
+    {
+        result.error = "the loop is not on a serial port";
+        return result;
+    }
+    if (devices.isEmpty())
+    {
+        result.error = "no analyzer to poll";
+        return result;
+    }
+
+    uint32_t sec, usec;
+    modbus_get_response_timeout(ctx, &sec, &usec);
+    const int slave = modbus_get_slave(ctx);
+    const bool isExtended = modbus_is_extended_slave(ctx);
+
+    /// a fast rate must fail on the line, not on a slow analyzer
+    m_turnaroundUs = DEVICE_MIN_TIMEOUT_US;
+    foreach (const LinkDevice & device, devices) m_turnaroundUs = qMax(m_turnaroundUs, device.timeoutUs);
+
+    QList<int> candidates = rates;
+    std::sort(candidates.begin(), candidates.end(), std::greater<int>());
+
+    setBaud(ctx, result.oldBaud);
+    result.oldSamplesPerSecond = result.samplesPerSecond = measure(ctx, devices, LINK_BASELINE_POLLS, result.errorRate);
+    const bool isAnswering = (result.errorRate <= LINK_MAX_ERROR_RATE);
+
+    if (baudRegister > 0)
+    {
+        if (!isAnswering) result.error = QString("the analyzers do not answer reliably at %1 baud").arg(result.oldBaud);
+
+        foreach (const int baud, candidates)
+        {
+            if (!isAnswering || m_isCanceled.load() || (baud <= result.oldBaud)) break;
+            emit progress(QString("Moving the analyzers to %1 baud...").arg(baud));
+
+            /// the host has to follow before the analyzers are told to move,
+            /// a rate the port refuses is skipped
+            const bool isOpened = setBaud(ctx, baud);
+            if (!setBaud(ctx, result.oldBaud))
+            {
+                result.error = QString("the port does not reopen at %1 baud").arg(result.oldBaud);
+                break;
+            }
+            if (!isOpened) continue;
+
+            double errorRate = 1;
+            double samplesPerSecond = 0;
+            const bool isSent = writeBaud(ctx, devices, baudRegister, baud);
+            if (!setBaud(ctx, baud))
+            {
+                /// the port opened at this rate a moment ago, the analyzers may be there now
+                result.error = QString("the port did not reopen at %1 baud, the analyzers may have moved to it").arg(baud);
+                break;
+            }
+            if (isSent) samplesPerSecond = measure(ctx, devices, LINK_LOAD_POLLS, errorRate);
+
+            if (isSent && (errorRate <= LINK_MAX_ERROR_RATE) && !m_isCanceled.load())
+            {
+                result.baud = baud;
+                result.samplesPerSecond = samplesPerSecond;
+                result.errorRate = errorRate;
+                result.isSwitched = true;
+                break;
+            }
+
+            /// back to the rate that worked, an analyzer that never switched does not hear this
+            writeBaud(ctx, devices, baudRegister, result.oldBaud);
+            setBaud(ctx, result.oldBaud);
+            if (!answers(ctx, devices))
+            {
+                result.error = QString("the analyzers did not come back from %1 baud").arg(baud);
+                break;
+            }
+        }
+    }
+    else
+    {
+        /// the analyzers stay at their rate, look for it
+        bool isFound = false;
+        foreach (const int baud, candidates)
+        {
+            if (m_isCanceled.load() || (isAnswering && (baud <= result.oldBaud))) break;
+            emit progress(QString("Looking for the analyzers at %1 baud...").arg(baud));
+
+            double errorRate = 1;
+            if (!setBaud(ctx, baud) || !answers(ctx, devices)) continue;
+            const double samplesPerSecond = measure(ctx, devices, LINK_LOAD_POLLS, errorRate);
+            if (errorRate > LINK_MAX_ERROR_RATE) continue;
+
+            result.baud = baud;
+            result.samplesPerSecond = samplesPerSecond;
+            result.errorRate = errorRate;
+            isFound = true;
+            break;
+        }
+
+        if (!isFound && !isAnswering && !m_isCanceled.load()) result.error = "no candidate rate where every analyzer answers";
+        setBaud(ctx, result.baud);
+    }
+
+    isExtended ? modbus_set_extended_slave(ctx, slave) : modbus_set_slave(ctx, slave);
+    modbus_set_response_timeout(ctx, sec, usec);
+
+    return result;
+}
+
+
+/// the port follows, with a timeout of the slowest analyzer plus a few
+/// frames at the new rate
+bool
+LinkTuner::
+setBaud(modbus_t * ctx, const int baud)
+{
+    const int us = int(2 * qint64(LINK_FRAME_CHARACTERS) * 11 * 1000000 / baud) + m_turnaroundUs;
+
+    if (modbus_rtu_get_baud(ctx) != baud)
+    {
+        if (modbus_rtu_set_baud(ctx, baud) == -1) return false;
+        QThread::msleep(LINK_SETTLE_MS);
+        modbus_flush(ctx);
+    }
+    modbus_set_response_timeout(ctx, us / 1000000, us % 1000000);
+
+    return true;
+}
+
+
+/// false when an analyzer did not confirm the rate
+bool
+LinkTuner::
+writeBaud(modbus_t * ctx, const QList<LinkDevice> & devices, const int baudRegister, const int baud)
+{
+    bool isSent = true;
+    foreach (const LinkDevice & device, devices)
+    {
+        device.isExtended ? modbus_set_extended_slave(ctx, device.slave) : modbus_set_slave(ctx, device.slave);
+
+        bool isConfirmed = false;
+        for (int i = 0; (i < LINK_RETRIES) && !isConfirmed; i++)
+        {
+            isConfirmed = (modbus_write_register(ctx, baudRegister - 1, baud / LINK_BAUD_UNIT) == 1);
+            if (!isConfirmed) modbus_flush(ctx);
+        }
+        isSent = isSent && isConfirmed;
+    }
+
+    return isSent;
+}
+
+
+/// every analyzer answers one poll in a few tries
+bool
+LinkTuner::
+answers(modbus_t * ctx, const QList<LinkDevice> & devices)
+{
+    double values[device::PIPE_FIELDS + device::MASTER_FIELDS];
+    foreach (const LinkDevice & device, devices)
+    {
+        bool isAnswered = false;
+        for (int i = 0; (i < LINK_RETRIES) && !isAnswered; i++)
+        {
+            isAnswered = device.read(ctx, device.slave, device.isExtended, values);
+            if (!isAnswered) modbus_flush(ctx);
+        }
+        if (!isAnswered) return false;
+    }
+
+    return true;
+}
+
+
+/// successful polls per second, back to back over all analyzers. stops as
+/// soon as the failures rule the rate out
+double
+LinkTuner::
+measure(modbus_t * ctx, const QList<LinkDevice> & devices, const int polls, double & errorRate)
+{
+    double values[device::PIPE_FIELDS + device::MASTER_FIELDS];
+    const int allowed = int(LINK_MAX_ERROR_RATE * polls * devices.size());
+    int total = 0;
+    int failures = 0;
+
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = 0; (i < polls) && (failures <= allowed) && !m_isCanceled.load(); i++)
+    {
+        foreach (const LinkDevice & device, devices)
+        {
+            total++;
+            if (device.read(ctx, device.slave, device.isExtended, values)) continue;
+
+            failures++;
+            modbus_flush(ctx);
+        }
+    }
+    const qint64 ns = clock.nsecsElapsed();
+
+    errorRate = total ? double(failures) / total : 1;
+    return (ns > 0) ? (total - failures) * 1e9 / ns : 0;
+}
@@ -0,0 +1,69 @@
+#ifndef LINKTUNER_H
+#define LINKTUNER_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include "modbus.h"
+#include "deviceprofile.h"
+
+/// an analyzer of the loop and the poll its samples come from
+struct LinkDevice
+{
+    int slave;
+    bool isExtended;        /// slave is a serial number, see modbus_set_extended_slave()
+    device::Reader read;
+    int timeoutUs;          /// DeviceIdentity::timeoutUs, 0 when it was never measured
+
+    LinkDevice() : slave(0), isExtended(false), read(0), timeoutUs(0) {}
+    LinkDevice(const int s, const bool e, device::Reader r, const int t = 0) : slave(s), isExtended(e), read(r), timeoutUs(t) {}
+};
+
+struct LinkResult
+{
+    int baud;                   /// rate the bus was left at
+    int oldBaud;
+    double samplesPerSecond;    /// polls of every device per second under load at baud
+    double oldSamplesPerSecond;
+    double errorRate;           /// failed polls over polls at baud
+    bool isSwitched;            /// the analyzers were moved to another rate
+    QString error;              /// why the bus stayed where it was, empty otherwise
+
+    LinkResult() : baud(0), oldBaud(0), samplesPerSecond(0), oldSamplesPerSecond(0), errorRate(0), isSwitched(false) {}
+};
+
+/// runs one serial loop at the fastest rate all of its analyzers hold.
+/// with a baud register the analyzers are moved through it to every
+/// faster candidate rate in turn, fastest first, and kept at the first
+/// one that passes a burst of back to back polls with no more than
+/// LINK_MAX_ERROR_RATE failures; a rate that fails moves them back.
+/// without one the analyzers can not be switched, the candidates are
+/// probed for the fastest rate they already answer at. tune() blocks,
+/// run it off the GUI thread with nothing else on the bus.
+class LinkTuner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LinkTuner(QObject * parent = 0);
+
+    LinkResult tune(modbus_t * ctx, const QList<LinkDevice> & devices, const QList<int> & rates, const int baudRegister);
+
+public slots:
+    void cancel() { m_isCanceled.store(1); }
+
+signals:
+    void progress(const QString & step);
+
+private:
+    bool setBaud(modbus_t * ctx, const int baud);
+    bool writeBaud(modbus_t * ctx, const QList<LinkDevice> & devices, const int baudRegister, const int baud);
+    bool answers(modbus_t * ctx, const QList<LinkDevice> & devices);
+    double measure(modbus_t * ctx, const QList<LinkDevice> & devices, const int polls, double & errorRate);
+
+    QAtomicInt m_isCanceled;
+    int m_turnaroundUs;     /// slowest analyzer response, never below DEVICE_MIN_TIMEOUT_US
+};
+
+#endif // LINKTUNER_H
@@ -32,23 +32,24 @@
 #include <QWidget>
 #include <QMainWindow>
 #include <QTimer>
-#include <QThread>
-
-class I : public QThread
-{
-public:
-        static void sleep(unsigned long secs) {
-                QThread::sleep(secs);
-        }
-};
 
 MainWindow * globalMainWin = NULL;
+TransportManager * globalTransports = NULL;
+DeviceCache * globalDevices = NULL;
 
 int main(int argc, char *argv[])
 {
     static int const RESTART_CODE = 1000;
     int return_code = 0;
 
+    /// open buses survive a restart
+    TransportManager transports;
+    globalTransports = &transports;
+
+    /// and so do the analyzers validated on them
+    DeviceCache devices;
+    globalDevices = &devices;
+
 
    QWidget * top = 0;
  
@@ -60,7 +61,7 @@ int main(int argc, char *argv[])
            splash.show();
 
            splash.showMessage(QObject::tr("Loading... please wait...\n\n\n\n\n\n"),Qt::AlignCenter | Qt::AlignBottom, Qt::black);  //This line represents the alignment of text, color and position
-           I::sleep(1);
+           a.processEvents();
            MainWindow w;
     
         //   QScrollArea* scroller = new QScrollArea;
@@ -75,6 +76,7 @@ int main(int argc, char *argv[])
            splash.raise();
 
            return_code = a.exec();
+           globalMainWin = NULL;
 
        } while( return_code == RESTART_CODE);
 
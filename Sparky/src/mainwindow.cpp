@@ -3,6 +3,7 @@
 #include <QDebug>
 #include <QMessageBox>
 #include <QFile>
+#include <QSaveFile>
 #include <QScrollBar>
 #include <QTime>
 #include <QGroupBox>
@@ -11,6 +12,10 @@
 #include <errno.h>
 #include <QSignalMapper>
 #include <QListWidget>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QPushButton>
+#include <QHeaderView>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QInputDialog>
@@ -31,10 +36,27 @@ const int DataColumn = 2;
 
 extern MainWindow * globalMainWin;
 
+/// the fitted response has arrived: a full window was sampled at the
+/// set point and the distance to the asymptote is inside the deviation band
+static bool isSettled(const SettlingPredictor & predictor, const StabilityDetector & detector)
+{
+	return (detector.count() >= detector.criteria().window) && predictor.isValid() && (predictor.residual() <= detector.criteria().maxStdDev);
+}
+
 MainWindow::MainWindow( QWidget * _parent ) :
 	QMainWindow( _parent ),
 	ui( new Ui::MainWindowClass ),
     m_modbus_snipping( NULL ),
+    m_portEnumerator( NULL ),
+    m_metricsServer( NULL ),
+    m_metricsThread( NULL ),
+    m_metricsPhase( STOP_MODE ),
+    m_loggedRunMode( STOP_MODE ),
+    m_loggedStabilityPhase( STABILITY_AMB ),
+    m_refitTerms( 0 ),
+    m_settingsFile( new SettingsFile(SETTINGS_FILE, this) ),
+    m_isSettingsPending( false ),
+    m_isLivePending( false ),
 	m_poll(false),
 	isModbusTransmissionFailed(false)
 {
@@ -44,6 +66,11 @@ MainWindow::MainWindow( QWidget * _parent ) :
     setWindowTitle(SPARKY);
 
     readJsonConfigFile();
+    initializeEventLog();
+    initializeSpool();
+    initializeRunCatalog();
+    connect(m_settingsFile, SIGNAL(changed(const Settings &)), this, SLOT(onSettingsChanged(const Settings &)));
+    connect(m_settingsFile, SIGNAL(rejected(const QString &)), this, SLOT(onSettingsRejected(const QString &)));
     onUpdateRegisters(EEA); 
     initializeToolbarIcons();
     initializeTabIcons();
@@ -54,6 +81,9 @@ MainWindow::MainWindow( QWidget * _parent ) :
     initializePipeObjects();
     initializeLoopObjects();
     initializeGraph();
+    initializeGauges();
+    initializeDiagnostics();
+    initializeMetrics();
     initializeModbusMonitor();
 	setValidators();
 
@@ -102,6 +132,25 @@ MainWindow::MainWindow( QWidget * _parent ) :
 
 MainWindow::~MainWindow()
 {
+    m_portScan.waitForFinished();
+    m_legacyImport.cancel();
+    m_legacyImport.waitForFinished();
+    m_refit.cancel();
+    m_refit.waitForFinished();
+    m_busScanner.cancel();
+    m_discovery.waitForFinished();
+    m_linkTuner.cancel();
+    m_linkTuning.waitForFinished();
+    m_settingsFile->flush();
+
+    if (m_metricsThread)
+    {
+        m_metricsThread->quit();
+        m_metricsThread->wait();
+        delete m_metricsServer;
+        delete m_metricsThread;
+    }
+
 	delete ui;
     delete m_statusInd;
     delete m_statusText;
@@ -203,7 +252,7 @@ void MainWindow::onSendButtonPress( void )
 }
 
 void MainWindow::busMonitorAddItem( bool isRequest,
-                    uint16_t slave,
+                    uint32_t slave,
 					uint8_t func,
 					uint16_t addr,
 					uint16_t nb,
@@ -277,7 +326,7 @@ void MainWindow::busMonitorRawData( uint8_t * data, uint8_t dataLen, bool addNew
 }
 
 // static
-void MainWindow::stBusMonitorAddItem( modbus_t * modbus, uint8_t isRequest, uint16_t slave, uint8_t func, uint16_t addr, uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC )
+void MainWindow::stBusMonitorAddItem( modbus_t * modbus, uint8_t isRequest, uint32_t slave, uint8_t func, uint16_t addr, uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC )
 {
     Q_UNUSED(modbus);
     globalMainWin->busMonitorAddItem( isRequest, slave, func, addr+1, nb, expectedCRC, actualCRC );
@@ -290,6 +339,25 @@ void MainWindow::stBusMonitorRawData( modbus_t * modbus, uint8_t * data, uint8_t
     globalMainWin->busMonitorRawData( data, dataLen, addNewline != 0 );
 }
 
+// static
+void MainWindow::stBusMonitorTransaction( modbus_t * modbus, const modbus_transaction_t * transaction )
+{
+    globalMainWin->m_busStatistics.record( *transaction );
+
+    if (transaction->error != 0)
+    {
+        /// whatever answers there now is validated again before the next run
+        if (modbus == globalMainWin->LOOP.serialModbus) globalDevices->invalidate(globalMainWin->m_serialPort, transaction->slave);
+
+        QVariantMap fields;
+        fields["slave"] = transaction->slave;
+        fields["function"] = transaction->function;
+        fields["error"] = modbus_strerror(transaction->error);
+        fields["elapsed_us"] = qulonglong(transaction->done - transaction->sent);
+        globalMainWin->m_eventLog.post((transaction->error == ETIMEDOUT) ? "bus_timeout" : ((transaction->error == EMBBADCRC) ? "bus_crc_error" : "bus_error"), fields);
+    }
+}
+
 static QString descriptiveDataTypeName( int funcCode )
 {
 	switch( funcCode )
@@ -411,6 +479,8 @@ void MainWindow::enableHexView( void )
 
 void MainWindow::sendModbusRequest( void )
 {
+    if (isBusBusy()) return;
+
     // UPDATE m_modbus_snipping WITH THE CURRENT
     if (ui->tabWidget_2->currentIndex() == 0)      m_modbus_snipping = LOOP.modbus;
 
@@ -593,7 +663,7 @@ void MainWindow::resetStatus( void )
 
 void MainWindow::pollForDataOnBus( void )
 {
-	if( LOOP.modbus )
+	if( LOOP.modbus && !isBusBusy() )
 	{
 		modbus_poll( LOOP.modbus );
 	}
@@ -613,6 +683,7 @@ void MainWindow::onRtuPortActive(bool active)
 		if (LOOP.modbus) {
 			modbus_register_monitor_add_item_fnc(LOOP.modbus, MainWindow::stBusMonitorAddItem);
 			modbus_register_monitor_raw_data_fnc(LOOP.modbus, MainWindow::stBusMonitorRawData);
+			modbus_register_monitor_transaction_fnc(LOOP.modbus, MainWindow::stBusMonitorTransaction);
 		}
 	}
 	else LOOP.modbus = NULL;
@@ -623,6 +694,10 @@ void
 MainWindow::
 setStatusError(const QString &msg)
 {
+    QVariantMap fields;
+    fields["message"] = msg;
+    m_eventLog.post("status_error", fields);
+
     m_statusText->setText( msg );
     m_statusInd->setStyleSheet( "background: red;" );
     m_statusTimer->start( 2000 );
@@ -774,6 +849,894 @@ initializeGraph()
 }
 
 
+void
+MainWindow::
+initializeGauges()
+{
+    QHBoxLayout * layout = new QHBoxLayout;
+
+    m_temperatureGauge = createGauge("Temp (C°)", 0, 80, m_temperatureNeedle);
+    m_RPGauge = createGauge("RP (V)", 0, 80, m_RPNeedle);
+
+    layout->addWidget(m_temperatureGauge);
+    layout->addWidget(m_RPGauge);
+    ui->gridLayout_5->addLayout(layout,1,0);
+}
+
+
+QcGaugeWidget *
+MainWindow::
+createGauge(const QString & title, const float min, const float max, QcNeedleItem *& needle)
+{
+    /// everything but the needle and its value label is cached by the
+    /// widget, so a new reading only repaints the needle
+    QcGaugeWidget * gauge = new QcGaugeWidget;
+    gauge->addBackground(99);
+    QcBackgroundItem *bkg1 = gauge->addBackground(92);
+    bkg1->clearrColors();
+    bkg1->addColor(0.1,Qt::black);
+    bkg1->addColor(1.0,Qt::white);
+
+    QcBackgroundItem *bkg2 = gauge->addBackground(88);
+    bkg2->clearrColors();
+    bkg2->addColor(0.1,Qt::gray);
+    bkg2->addColor(1.0,Qt::darkGray);
+
+    gauge->addArc(55);
+    gauge->addDegrees(65)->setValueRange(min,max);
+    gauge->addColorBand(50);
+    gauge->addValues(80)->setValueRange(min,max);
+    QcLabelItem *name = gauge->addLabel(70);
+    name->setText(title);
+    name->setStatic(true);
+    QcLabelItem *lab = gauge->addLabel(40);
+    lab->setText("0");
+    needle = gauge->addNeedle(60);
+    needle->setLabel(lab);
+    needle->setColor(Qt::white);
+    needle->setValueRange(min,max);
+    gauge->addBackground(7);
+    gauge->addGlass(88);
+
+    return gauge;
+}
+
+
+void
+MainWindow::
+updateGauges(const int pipe)
+{
+    /// gauges follow the first pipe under calibration
+    for (int i = 0; i < pipe; i++) if (PIPE[i].status == ENABLED) return;
+
+    m_temperatureNeedle->setCurrentValue(PIPE[pipe].temperature);
+    m_RPNeedle->setCurrentValue(PIPE[pipe].oilrp);
+}
+
+
+void
+MainWindow::
+initializeDiagnostics()
+{
+    QWidget * tab = new QWidget;
+    QVBoxLayout * layout = new QVBoxLayout(tab);
+    QHBoxLayout * buttons = new QHBoxLayout;
+    QPushButton * exportBtn = new QPushButton(tr("Export CSV"));
+    QPushButton * resetBtn = new QPushButton(tr("Reset"));
+
+    m_dutyCycle = new QLabel;
+    m_diagnosticsTable = new QTableWidget(0, 11);
+    m_diagnosticsTable->setHorizontalHeaderLabels(QStringList() << tr("Slave") << tr("Function") << tr("Requests") << tr("Timeouts") << tr("CRC Errors") << tr("Errors") << tr("First Byte p50 (ms)") << tr("p50 (ms)") << tr("p90 (ms)") << tr("p99 (ms)") << tr("Max (ms)"));
+    m_diagnosticsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_diagnosticsTable->verticalHeader()->hide();
+
+    buttons->addWidget(m_dutyCycle, 1);
+    buttons->addWidget(exportBtn);
+    buttons->addWidget(resetBtn);
+    layout->addWidget(m_diagnosticsTable);
+    layout->addLayout(buttons);
+    ui->tabWidget->addTab(tab, tr("Diagnostics"));
+
+    connect(exportBtn, SIGNAL(clicked()), this, SLOT(onExportDiagnostics()));
+    connect(resetBtn, SIGNAL(clicked()), this, SLOT(onResetDiagnostics()));
+
+    /// the table is refreshed at a fixed rate, not per transaction
+    QTimer * t = new QTimer(this);
+    connect(t, SIGNAL(timeout()), this, SLOT(updateDiagnostics()));
+    t->start(1000);
+
+    updateDiagnostics();
+}
+
+
+void
+MainWindow::
+updateDiagnostics()
+{
+    const QList<BusSeries> series = m_busStatistics.series();
+
+    m_diagnosticsTable->setRowCount(series.size());
+    for (int row = 0; row < series.size(); row++)
+    {
+        const BusSeries & s = series[row];
+        const QStringList cells = QStringList()
+            << QString::number(s.slave) << QString::number(s.function) << QString::number(s.requests)
+            << QString::number(s.timeouts) << QString::number(s.crcErrors) << QString::number(s.otherErrors)
+            << QString::number(s.firstByte.percentile(50)/1000.0, 'f', 1) << QString::number(s.roundTrip.percentile(50)/1000.0, 'f', 1)
+            << QString::number(s.roundTrip.percentile(90)/1000.0, 'f', 1) << QString::number(s.roundTrip.percentile(99)/1000.0, 'f', 1)
+            << QString::number(s.roundTrip.max()/1000.0, 'f', 1);
+
+        for (int col = 0; col < cells.size(); col++)
+        {
+            QTableWidgetItem * item = m_diagnosticsTable->item(row, col);
+            if (!item)
+            {
+                item = new QTableWidgetItem;
+                m_diagnosticsTable->setItem(row, col, item);
+            }
+            item->setText(cells[col]);
+            if ((col == 3) || (col == 4)) item->setForeground((cells[col] == "0") ? Qt::black : Qt::red);
+        }
+    }
+
+    m_dutyCycle->setText(tr("Bus duty cycle: %1 %  (%2 transactions)").arg(m_busStatistics.dutyCycle()*100, 0, 'f', 1).arg(m_busStatistics.transactions()));
+
+    /// keeps the phase duration moving while nothing is read
+    publishMetrics();
+}
+
+
+void
+MainWindow::
+initializeEventLog()
+{
+    if (LOOP.eventLog.isEmpty()) return;
+
+    const QString path = QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(LOOP.eventLog);
+    if (!m_eventLog.open(path)) qWarning() << "event log:" << path << "can not be opened";
+
+    QVariantMap fields;
+    fields["version"] = RELEASE_VERSION;
+    fields["loop"] = LOOP.loopNumber;
+    m_eventLog.post("startup", fields);
+}
+
+
+/// a run directory is written to the local spool and mirrored to the
+/// main server. m_localServer picks the spool, next to the program when
+/// it is not set.
+void
+MainWindow::
+initializeSpool()
+{
+    const QString spool = m_localServer.isEmpty() ? QCoreApplication::applicationDirPath() + "/spool" : m_localServer;
+    const QString clean = QDir::cleanPath(QDir::fromNativeSeparators(spool));
+    const QString remote = m_mainServer.isEmpty() ? QString() : QDir::cleanPath(QDir::fromNativeSeparators(m_mainServer));
+
+    if ((clean == m_spool.spoolRoot()) && (remote == m_spool.remoteRoot())) return;
+    if (!m_spool.open(spool, m_mainServer, &m_eventLog)) qWarning() << "spool:" << spool << "can not be created";
+}
+
+
+void
+MainWindow::
+initializeRunCatalog()
+{
+    if (LOOP.runCatalog.isEmpty()) return;
+
+    const QString path = QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(LOOP.runCatalog);
+    if (m_runCatalog.isOpen() && (m_runCatalogPath == path)) return;
+
+    m_runCatalogPath = path;
+    m_runCatalog.open(path);
+}
+
+
+/// directory of the n-th run of a serial number, the first one has no suffix
+QString
+MainWindow::
+runDirectory(const QString & base, const int runIndex) const
+{
+    return (runIndex > 1) ? base + "_" + QString::number(runIndex) : base;
+}
+
+
+/// phase of the loop as the run catalog records it
+QString
+MainWindow::
+phaseName() const
+{
+    static const char * names[STABILITY_PHASES] = { "AMB", "MIN_REF", "MAX_REF" };
+
+    if (LOOP.runMode == TEMP_RUN_MODE) return QString("TEMP_RUN ") + names[LOOP.stabilityPhase];
+    if (LOOP.runMode == INJECTION_MODE) return "INJECTION";
+    return "STOP";
+}
+
+
+void
+MainWindow::
+onRunHistory()
+{
+    bool ok;
+    const QString sn = QInputDialog::getText(this, tr("Run History"), tr("Enter Serial Number:"), QLineEdit::Normal, PIPE[0].slave->text(), &ok);
+    if (!ok || sn.isEmpty()) return;
+
+    const QList<RunCatalog::Run> runs = m_runCatalog.history(sn);
+    QString text;
+    foreach (const RunCatalog::Run & run, runs)
+    {
+        text += QString("%1  %2 #%3  L%4 P%5  %6  %7\n").arg(run.started.toString("yyyy-MM-dd hh:mm")).arg(run.mode).arg(run.runIndex).arg(run.loop).arg(run.pipe + 1).arg(run.operatorName.trimmed()).arg(run.finished.isValid() ? run.phase : run.phase + " (running)");
+        text += QString("    %1 samples, temperature %2..%3, frequency %4..%5\n    %6\n").arg(run.samples).arg(run.minTemperature).arg(run.maxTemperature).arg(run.minFrequency).arg(run.maxFrequency).arg(run.directory);
+    }
+    if (runs.isEmpty()) text = tr("No runs recorded for SN") + sn;
+
+    QMessageBox::information(this, tr("Run History - SN") + sn, text);
+}
+
+
+/// every file of an archive on all cores, the UI stays live meanwhile
+void
+MainWindow::
+onImportLegacyFiles()
+{
+    if (m_legacyImport.isRunning()) return;
+
+    const QString dirName = QFileDialog::getExistingDirectory(this, tr("Import Legacy Files"), m_mainServer, QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    if (dirName.isEmpty()) return;
+
+    const QStringList files = LegacyImporter::find(dirName);
+    if (files.isEmpty())
+    {
+        QMessageBox::information(this, tr("Import Legacy Files"), tr("No calibration files in ") + dirName);
+        return;
+    }
+
+    QProgressDialog * progress = new QProgressDialog(tr("Importing..."), tr("Abort"), 0, files.size(), this);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(&m_legacyImport, SIGNAL(progressValueChanged(int)), progress, SLOT(setValue(int)));
+    connect(&m_legacyImport, SIGNAL(finished()), progress, SLOT(close()));
+    connect(progress, SIGNAL(canceled()), &m_legacyImport, SLOT(cancel()));
+    progress->show();
+
+    m_legacyClock.start();
+    m_legacyImport.setFuture(QtConcurrent::mapped(files, &LegacyImporter::summarize));
+}
+
+
+/// the files of one run directory become one catalog run
+void
+MainWindow::
+onLegacyFilesImported()
+{
+    const double seconds = qMax(m_legacyClock.elapsed(), qint64(1)) / 1000.0;
+    const QList<LegacySummary> files = m_legacyImport.future().results();
+
+    QMap<QString, RunCatalog::Run> runs;
+    QMap<QString, QStringList> runFiles;
+    qint64 bytes = 0;
+    int rows = 0;
+    int skipped = 0;
+
+    foreach (const LegacySummary & summary, files)
+    {
+        const LegacyFile & file = summary.file;
+        bytes += file.bytes;
+        if (!file.isValid() || file.sn.isEmpty())
+        {
+            skipped++;
+            continue;
+        }
+        rows += summary.rows;
+
+        const QString directory = QFileInfo(file.path).path();
+        const bool isNew = !runs.contains(directory);
+        RunCatalog::Run & run = runs[directory];
+        runFiles[directory] << file.path;
+
+        if (isNew)
+        {
+            QRegExp rerun("_(\\d+)$");
+            run.sn = file.sn;
+            run.mode = file.mode;
+            run.runIndex = (rerun.indexIn(directory) >= 0) ? rerun.cap(1).toInt() : 1;
+            run.product = file.product;
+            run.loop = file.loop;
+            run.pipe = file.pipe;
+            run.directory = directory;
+            run.phase = "IMPORTED";
+            run.started = run.finished = file.written;
+        }
+        run.started = qMin(run.started, file.written);
+        run.finished = qMax(run.finished, file.written);
+
+        if (!summary.rows) continue;
+        if (!run.samples)
+        {
+            run.minTemperature = summary.minTemperature;
+            run.maxTemperature = summary.maxTemperature;
+            run.minFrequency = summary.minFrequency;
+            run.maxFrequency = summary.maxFrequency;
+        }
+        run.minTemperature = qMin(run.minTemperature, summary.minTemperature);
+        run.maxTemperature = qMax(run.maxTemperature, summary.maxTemperature);
+        run.minFrequency = qMin(run.minFrequency, summary.minFrequency);
+        run.maxFrequency = qMax(run.maxFrequency, summary.maxFrequency);
+        run.samples += summary.rows;
+    }
+
+    int added = 0;
+    for (QMap<QString, RunCatalog::Run>::const_iterator it = runs.constBegin(); it != runs.constEnd(); ++it)
+    {
+        if (m_runCatalog.importRun(it.value(), runFiles[it.key()])) added++;
+    }
+
+    QVariantMap fields;
+    fields["files"] = files.size();
+    fields["rows"] = rows;
+    fields["bytes"] = bytes;
+    fields["seconds"] = seconds;
+    fields["runs_added"] = added;
+    m_eventLog.post("legacy_import", fields);
+
+    QString text = QString("%1 files, %2 rows in %3 s (%4 MB/s)\n%5 of %6 runs added to the catalog")
+                   .arg(files.size()).arg(rows).arg(seconds, 0, 'f', 1).arg(bytes / seconds / 1048576.0, 0, 'f', 1).arg(added).arg(runs.size());
+    if (skipped) text += QString("\n%1 files skipped").arg(skipped);
+    if (m_legacyImport.isCanceled()) text += tr("\nImport aborted");
+
+    QMessageBox::information(this, tr("Import Legacy Files"), text);
+}
+
+
+/// every file of an archive fitted again with the chosen model. files
+/// are handed to the global thread pool one at a time, so a few huge
+/// runs never leave the other cores idle.
+void
+MainWindow::
+onRefitArchive()
+{
+    if (m_refit.isRunning()) return;
+
+    const QString dirName = QFileDialog::getExistingDirectory(this, tr("Re-fit Archive"), m_mainServer, QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    if (dirName.isEmpty()) return;
+
+    QStringList models;
+    models << tr("Polynomial, degree 1") << tr("Polynomial, degree 2") << tr("Polynomial, degree 3") << tr("Exponential");
+    bool ok;
+    const QString model = QInputDialog::getItem(this, tr("Re-fit Archive"), tr("Fitting method"), models, 2, false, &ok);
+    if (!ok) return;
+
+    m_refitOutput = QFileDialog::getSaveFileName(this, tr("Save Fits"), "", tr("CSV file (*.csv);;All Files (*)"));
+    if (m_refitOutput.isEmpty()) return;
+
+    const QStringList files = LegacyImporter::find(dirName);
+    if (files.isEmpty())
+    {
+        QMessageBox::information(this, tr("Re-fit Archive"), tr("No calibration files in ") + dirName);
+        return;
+    }
+
+    const int index = models.indexOf(model);
+    const BatchFit::Job job((index == 3) ? BatchFit::Exponential : BatchFit::Polynomial, index + 1);
+    m_refitTerms = (job.model == BatchFit::Exponential) ? 2 : job.degree + 1;
+
+    QProgressDialog * progress = new QProgressDialog(tr("Fitting..."), tr("Abort"), 0, files.size(), this);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(&m_refit, SIGNAL(progressValueChanged(int)), progress, SLOT(setValue(int)));
+    connect(&m_refit, SIGNAL(finished()), progress, SLOT(close()));
+    connect(progress, SIGNAL(canceled()), &m_refit, SLOT(cancel()));
+    progress->show();
+
+    m_refitClock.start();
+    m_refit.setFuture(QtConcurrent::mapped(files, job));
+}
+
+
+void
+MainWindow::
+onArchiveRefitted()
+{
+    const double seconds = qMax(m_refitClock.elapsed(), qint64(1)) / 1000.0;
+    const QList<BatchFit::Result> results = m_refit.future().results();
+
+    QSaveFile file(m_refitOutput);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        setStatusError(tr("Can not write ") + m_refitOutput);
+        return;
+    }
+
+    int fitted = 0;
+    QTextStream out(&file);
+    out << BatchFit::csvHeader(m_refitTerms) << '\n';
+    foreach (const BatchFit::Result & result, results)
+    {
+        out << BatchFit::csvLine(result, m_refitTerms) << '\n';
+        if (result.error.isEmpty()) fitted++;
+    }
+    out.flush();
+    if (!file.commit())
+    {
+        setStatusError(tr("Can not write ") + m_refitOutput);
+        return;
+    }
+
+    QString text = QString("%1 of %2 files fitted in %3 s\n%4").arg(fitted).arg(results.size()).arg(seconds, 0, 'f', 1).arg(m_refitOutput);
+    if (m_refit.isCanceled()) text += tr("\nRe-fit aborted");
+
+    QMessageBox::information(this, tr("Re-fit Archive"), text);
+}
+
+
+/// a worker thread owns LOOP.serialModbus until it is done
+bool
+MainWindow::
+isBusBusy() const
+{
+    return m_discovery.isRunning() || m_linkTuning.isRunning();
+}
+
+
+/// hand the serial loop to a worker and take it back. meanwhile the port
+/// can not be changed, reopened or polled from the gui, the monitors are
+/// off so the worker never calls into the gui, and adapter hot plugs wait
+/// until the context is ours again.
+void
+MainWindow::
+lockBus(const bool isLocked)
+{
+    ui->actionStart->setEnabled(!isLocked);
+    ui->comboBox->setEnabled(!isLocked);
+    ui->comboBox_2->setEnabled(!isLocked);
+    ui->comboBox_3->setEnabled(!isLocked);
+    ui->comboBox_4->setEnabled(!isLocked);
+    ui->comboBox_5->setEnabled(!isLocked);
+
+    if (isLocked && m_pollTimer->isActive())
+    {
+        m_pollTimer->stop();
+        ui->sendBtn->setText(tr("Send"));
+    }
+
+    modbus_register_monitor_add_item_fnc(LOOP.serialModbus, isLocked ? NULL : MainWindow::stBusMonitorAddItem);
+    modbus_register_monitor_raw_data_fnc(LOOP.serialModbus, isLocked ? NULL : MainWindow::stBusMonitorRawData);
+    modbus_register_monitor_transaction_fnc(LOOP.serialModbus, isLocked ? NULL : MainWindow::stBusMonitorTransaction);
+    if (isLocked) return;
+
+    while (!m_deferredPorts.isEmpty())
+    {
+        const QPair<bool, QextPortInfo> port = m_deferredPorts.takeFirst();
+        port.first ? onSerialPortDiscovered(port.second) : onSerialPortRemoved(port.second);
+    }
+}
+
+
+/// sweep the serial loop for analyzers and fill the pipe table. the bus
+/// is the scanner's alone until it is done, so calibration can not start
+/// meanwhile and the diagnostics do not count the probes of empty addresses.
+void
+MainWindow::
+onDiscoverDevices()
+{
+    if (m_discovery.isRunning() || m_linkTuning.isRunning()) return;
+
+    if (LOOP.isCal || (LOOP.serialModbus == NULL))
+    {
+        informUser(tr("Discover Devices"), tr("Discover Devices"), LOOP.isCal ? tr("Stop the calibration first.") : tr("Bad Serial Connection"));
+        return;
+    }
+
+    QProgressDialog * progress = new QProgressDialog(tr("Searching for analyzers..."), tr("Abort"), 0, 247, this);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(&m_busScanner, SIGNAL(progress(int)), progress, SLOT(setValue(int)));
+    connect(&m_discovery, SIGNAL(finished()), progress, SLOT(close()));
+    connect(progress, SIGNAL(canceled()), &m_busScanner, SLOT(cancel()));
+    progress->show();
+
+    lockBus(true);
+
+    QList<int> skip;
+    skip << CONTROLBOX_SLAVE;
+    m_discovery.setFuture(QtConcurrent::run(&m_busScanner, &BusScanner::scan, LOOP.serialModbus, ui->comboBox_2->currentText().toInt(), skip));
+}
+
+
+void
+MainWindow::
+onDevicesDiscovered()
+{
+    lockBus(false);
+
+    const QList<BusDevice> devices = m_discovery.result();
+
+    /// pipes are addressed by serial number, only those that take it can go into the table
+    QList<BusDevice> pipes;
+    QString text;
+    foreach (const BusDevice & device, devices)
+    {
+        text += QString("Slave %1: %2 SN%3, %4 ms%5\n").arg(device.address).arg(device.isEEA ? "EEA" : "RAZOR").arg(device.serialNumber)
+                .arg(device.roundTripUs / 1000.0, 0, 'f', 1).arg(device.isAddressableBySn ? "" : ", not addressable by SN");
+        if (device.isAddressableBySn) pipes.append(device);
+
+        QVariantMap fields;
+        fields["slave"] = device.address;
+        fields["sn"] = device.serialNumber;
+        fields["family"] = device.isEEA ? "EEA" : "RAZOR";
+        fields["by_sn"] = device.isAddressableBySn;
+        fields["round_trip_us"] = device.roundTripUs;
+        m_eventLog.post("device_discovered", fields);
+    }
+
+    if (pipes.isEmpty())
+    {
+        informUser(tr("Discover Devices"), tr("No analyzer found"), text);
+        return;
+    }
+
+    for (int pipe = 0; pipe < 3; pipe++) PIPE[pipe].slave->setText((pipe < pipes.size()) ? QString::number(pipes[pipe].serialNumber) : QString());
+
+    bool isMixed = false;
+    for (int i = 1; i < pipes.size(); i++) if (pipes[i].isEEA != pipes[0].isEEA) isMixed = true;
+    if (!isMixed) pipes[0].isEEA ? ui->radioButton->setChecked(true) : ui->radioButton_2->setChecked(true);
+
+    if (pipes.size() > 3) text += QString("\nOnly the first 3 of %1 analyzers fit the pipe table.").arg(pipes.size());
+    if (isMixed) text += "\nEEA and RAZOR analyzers share this loop, select the family by hand.";
+
+    informUser(tr("Discover Devices"), QString("%1 analyzer(s) found").arg(devices.size()), text);
+}
+
+
+/// run the serial loop at the fastest rate all of its analyzers hold.
+/// every analyzer in the pipe table has to follow a switch, so all of
+/// them are polled whether or not they take part in the next run. the
+/// bus is the tuner's alone until it is done, like the device discovery.
+void
+MainWindow::
+onTuneLink()
+{
+    if (m_linkTuning.isRunning() || m_discovery.isRunning()) return;
+
+    if (LOOP.isCal || (LOOP.serialModbus == NULL) || !LOOP.replayFile.isEmpty())
+    {
+        informUser(tr("Tune Serial Link"), tr("Tune Serial Link"), LOOP.isCal ? tr("Stop the calibration first.") : tr("Bad Serial Connection"));
+        return;
+    }
+
+    QList<LinkDevice> devices;
+    for (int pipe = 0; pipe < 3; pipe++)
+    {
+        const int sn = PIPE[pipe].slave->text().toInt();
+        DeviceIdentity identity;
+        if (sn > 0) devices << LinkDevice(sn, true, LOOP.readPipeRegisters, globalDevices->find(m_serialPort, sn, identity) ? identity.timeoutUs : 0);
+    }
+    if (LOOP.isMaster) devices << LinkDevice(CONTROLBOX_SLAVE, false, device::read<device::Eea::Master>);
+
+    if (devices.isEmpty())
+    {
+        informUser(tr("Tune Serial Link"), tr("No analyzer in the pipe table"), tr("Discover the devices first."));
+        return;
+    }
+
+    QList<int> rates;
+    for (int i = 0; i < ui->comboBox_2->count(); i++) rates << ui->comboBox_2->itemText(i).toInt();
+
+    QProgressDialog * progress = new QProgressDialog(tr("Tuning the serial link..."), tr("Abort"), 0, 0, this);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(&m_linkTuner, SIGNAL(progress(const QString &)), progress, SLOT(setLabelText(const QString &)));
+    connect(&m_linkTuning, SIGNAL(finished()), progress, SLOT(close()));
+    connect(progress, SIGNAL(canceled()), &m_linkTuner, SLOT(cancel()));
+    progress->show();
+
+    lockBus(true);
+
+    m_linkTuning.setFuture(QtConcurrent::run(&m_linkTuner, &LinkTuner::tune, LOOP.serialModbus, devices, rates, LOOP.linkBaudRegister));
+}
+
+
+void
+MainWindow::
+onLinkTuned()
+{
+    lockBus(false);
+
+    const LinkResult result = m_linkTuning.result();
+
+    QVariantMap fields;
+    fields["port"] = m_serialPort;
+    fields["old_baud"] = result.oldBaud;
+    fields["baud"] = result.baud;
+    fields["old_samples_per_second"] = result.oldSamplesPerSecond;
+    fields["samples_per_second"] = result.samplesPerSecond;
+    fields["error_rate"] = result.errorRate;
+    fields["switched"] = result.isSwitched;
+    fields["error"] = result.error;
+    m_eventLog.post("link_tuned", fields);
+
+    /// the rate is kept per adapter, the loop comes back at it after a restart
+    if (result.error.isEmpty() || (result.baud != result.oldBaud))
+    {
+        const QString id = LOOP.portSerial.isEmpty() ? m_serialPort : LOOP.portSerial;
+        QStringList bauds;
+        foreach (const QString & entry, LOOP.linkBauds) if (entry.section('=', 0, 0).trimmed() != id) bauds << entry;
+        bauds << QString("%1=%2").arg(id).arg(result.baud);
+        LOOP.linkBauds = bauds;
+        writeJsonConfigFile();
+    }
+
+    /// the tuner left the port at the new rate, reopening the loop at it drops the identities cached at the old one.
+    /// an adapter pulled meanwhile comes back at the saved rate instead
+    if ((result.baud != result.oldBaud) && LOOP.serialModbus)
+    {
+        globalDevices->invalidate(m_serialPort);
+        const int index = ui->comboBox_2->findText(QString::number(result.baud));
+        if (index >= 0) ui->comboBox_2->setCurrentIndex(index);
+    }
+
+    const QString text = QString("%1 baud: %2 polls/s, %3 % failed\n%4 baud before: %5 polls/s").arg(result.baud).arg(result.samplesPerSecond, 0, 'f', 1).arg(100 * result.errorRate, 0, 'f', 1)
+                         .arg(result.oldBaud).arg(result.oldSamplesPerSecond, 0, 'f', 1);
+    if (!result.error.isEmpty()) informUser(tr("Tune Serial Link"), tr("The link was not tuned"), result.error + "\n\n" + text);
+    else if (result.isSwitched) informUser(tr("Tune Serial Link"), QString("Analyzers moved to %1 baud").arg(result.baud), text);
+    else informUser(tr("Tune Serial Link"), QString("Loop runs at %1 baud").arg(result.baud), text);
+}
+
+
+/// the fits of a pipe on screen: the curve replaces the pipe's line in
+/// the frequency / watercut chart, the numbers go into the tool tips
+void
+MainWindow::
+updateFitView(const int pipe)
+{
+    const CurveFit & curve = PIPE[pipe].watercutFit;
+    const CurveFit & temp = PIPE[pipe].tempFit;
+
+    if (curve.isValid())
+    {
+        if (PIPE[pipe].series->attachedAxes().isEmpty())
+        {
+            PIPE[pipe].series->attachAxis(LOOP.axisX);
+            PIPE[pipe].series->attachAxis(LOOP.axisY);
+        }
+
+        QList<QPointF> points;
+        for (int i = 0; i <= 20; i++)
+        {
+            const double f = curve.minX() + (curve.maxX() - curve.minX()) * i / 20;
+            points << QPointF(f, curve.value(f));
+        }
+        PIPE[pipe].series->replace(points);
+
+        PIPE[pipe].watercut->setToolTip(QString("Watercut fit, degree %1, %2 samples\nresidual %3 %, R² %4, ±%5 % at %6 MHz")
+                                        .arg(curve.degree()).arg(curve.samples()).arg(curve.residual(), 0, 'f', 3).arg(curve.rSquared(), 0, 'f', 5)
+                                        .arg(curve.confidence(PIPE[pipe].frequency), 0, 'f', 3).arg(PIPE[pipe].frequency, 0, 'f', 3));
+    }
+    else PIPE[pipe].watercut->setToolTip(curve.samples() ? QString("Watercut fit, %1 samples").arg(curve.samples()) : QString());
+
+    if (temp.isValid())
+    {
+        PIPE[pipe].temp->setToolTip(QString("Frequency over temperature, degree %1, %2 samples\nresidual %3 MHz, R² %4, ±%5 MHz at %6 °C")
+                                    .arg(temp.degree()).arg(temp.samples()).arg(temp.residual(), 0, 'f', 4).arg(temp.rSquared(), 0, 'f', 5)
+                                    .arg(temp.confidence(PIPE[pipe].temperature), 0, 'f', 4).arg(PIPE[pipe].temperature, 0, 'f', 2));
+    }
+    else PIPE[pipe].temp->setToolTip(temp.samples() ? QString("Temperature fit, %1 samples").arg(temp.samples()) : QString());
+}
+
+
+/// the fits of the finished run go into the equation table, from where
+/// the usual Start button uploads them. the coefficients are logged
+/// either way.
+void
+MainWindow::
+prepareFitUpload()
+{
+    QStringList names;
+    QList<int> pipes;
+
+    for (int pipe = 0; pipe < 3; pipe++)
+    {
+        if (!PIPE[pipe].isRunning) continue;
+
+        const CurveFit & curve = PIPE[pipe].watercutFit;
+        const CurveFit & temp = PIPE[pipe].tempFit;
+        if (!curve.isValid() && !temp.isValid()) continue;
+
+        QVariantMap fields;
+        fields["pipe"] = pipe;
+        fields["sn"] = PIPE[pipe].slave->text();
+        if (curve.isValid())
+        {
+            QVariantList c;
+            foreach (const double value, curve.coefficients()) c << value;
+            fields["watercut_coefficients"] = c;
+            fields["watercut_residual"] = curve.residual();
+            fields["watercut_samples"] = curve.samples();
+        }
+        if (temp.isValid())
+        {
+            QVariantList c;
+            foreach (const double value, temp.coefficients()) c << value;
+            fields["temperature_coefficients"] = c;
+            fields["temperature_residual"] = temp.residual();
+            fields["temperature_samples"] = temp.samples();
+        }
+        m_eventLog.post("calibration_fit", fields);
+
+        names << PIPE[pipe].pipeId + " - SN" + PIPE[pipe].slave->text();
+        pipes << pipe;
+    }
+
+    if (pipes.isEmpty() || ((LOOP.fitCurveRegister <= 0) && (LOOP.fitTempRegister <= 0))) return;
+
+    bool ok;
+    const QString name = QInputDialog::getItem(this, tr("Calibration Fit"), tr("Load the fitted coefficients of"), names, 0, false, &ok);
+    if (!ok) return;
+    const int pipe = pipes[names.indexOf(name)];
+
+    ui->tableWidget->clearContents();
+    ui->tableWidget->setRowCount(0);
+    if ((LOOP.fitCurveRegister > 0) && PIPE[pipe].watercutFit.isValid()) addEquationRow("Watercut Curve", LOOP.fitCurveRegister, PIPE[pipe].watercutFit.coefficients());
+    if ((LOOP.fitTempRegister > 0) && PIPE[pipe].tempFit.isValid()) addEquationRow("Temperature Fit", LOOP.fitTempRegister, PIPE[pipe].tempFit.coefficients());
+
+    ui->radioButton_188->setChecked(true);
+    ui->startEquationBtn->setEnabled(ui->tableWidget->rowCount() > 0);
+}
+
+
+/// one row as loadCsvFile() would read it: name, slave, address, type, scale, rw, qty, values
+void
+MainWindow::
+addEquationRow(const QString & name, const int address, const QVector<double> & values)
+{
+    const int row = ui->tableWidget->rowCount();
+    ui->tableWidget->insertRow(row);
+    while (ui->tableWidget->columnCount() < values.size() + 7) ui->tableWidget->insertColumn(ui->tableWidget->columnCount());
+
+    ui->tableWidget->setItem(row, 0, new QTableWidgetItem(name));
+    ui->tableWidget->setItem(row, 1, new QTableWidgetItem("1"));
+    ui->tableWidget->setItem(row, 2, new QTableWidgetItem(QString::number(address)));
+    ui->tableWidget->setItem(row, 3, new QTableWidgetItem("float"));
+    ui->tableWidget->setItem(row, 4, new QTableWidgetItem("1"));
+    ui->tableWidget->setItem(row, 5, new QTableWidgetItem("RW"));
+    ui->tableWidget->setItem(row, 6, new QTableWidgetItem(QString::number(values.size())));
+    for (int i = 0; i < values.size(); i++) ui->tableWidget->setItem(row, 7 + i, new QTableWidgetItem(QString::number(values[i], 'g', 9)));
+}
+
+
+/// run numbers must stay unique across the spool and everything the
+/// server already holds
+bool
+MainWindow::
+isRunDirectoryTaken(const QString & spoolDir)
+{
+    if (QDir(spoolDir).exists()) return true;
+
+    const QString remote = m_spool.remotePath(spoolDir);
+    return !remote.isEmpty() && QDir(remote).exists();
+}
+
+
+void
+MainWindow::
+logPhaseChange()
+{
+    if ((LOOP.runMode == m_loggedRunMode) && (LOOP.stabilityPhase == m_loggedStabilityPhase)) return;
+
+    QVariantMap fields;
+    fields["run_mode"] = LOOP.runMode;
+    fields["stability_phase"] = LOOP.stabilityPhase;
+    fields["previous_run_mode"] = m_loggedRunMode;
+    fields["previous_stability_phase"] = m_loggedStabilityPhase;
+    m_eventLog.post("phase", fields);
+
+    m_loggedRunMode = LOOP.runMode;
+    m_loggedStabilityPhase = LOOP.stabilityPhase;
+
+    for (int pipe = 0; pipe < 3; pipe++) m_runCatalog.setPhase(PIPE[pipe].runId, phaseName());
+}
+
+
+void
+MainWindow::
+initializeMetrics()
+{
+    m_phaseClock.start();
+    if ((LOOP.metricsPort <= 0) || (LOOP.metricsPort > 65535)) return;
+
+    m_metricsThread = new QThread;
+    m_metricsServer = new MetricsServer(LOOP.metricsPort);
+    m_metricsServer->moveToThread(m_metricsThread);
+    connect(m_metricsThread, SIGNAL(started()), m_metricsServer, SLOT(start()));
+    connect(m_metricsThread, SIGNAL(finished()), m_metricsServer, SLOT(stop()));
+    m_metricsThread->start();
+}
+
+
+void
+MainWindow::
+publishMetrics()
+{
+    if (!m_metricsServer) return;
+
+    /// phase duration restarts on any change of run mode or stability phase
+    const int phase = LOOP.isCal ? (LOOP.runMode * STABILITY_PHASES + LOOP.stabilityPhase) : STOP_MODE;
+    if (phase != m_metricsPhase)
+    {
+        m_metricsPhase = phase;
+        m_phaseClock.restart();
+    }
+
+    MetricsSnapshot & s = m_metricsServer->snapshot();
+    s.loop = LOOP.loopNumber;
+    s.isCalibrating = LOOP.isCal;
+    s.runMode = LOOP.isCal ? LOOP.runMode : STOP_MODE;
+    s.stabilityPhase = LOOP.stabilityPhase;
+    s.phaseSeconds = m_phaseClock.elapsed()/1000.0;
+    s.watercut = LOOP.watercut;
+    s.masterWatercut = LOOP.masterWatercut;
+    s.masterTemperature = LOOP.masterTemp;
+    s.masterPhase = LOOP.masterPhase;
+
+    for (int pipe = 0; pipe < 3; pipe++)
+    {
+        s.pipes[pipe].status = PIPE[pipe].status;
+        s.pipes[pipe].frequency = PIPE[pipe].frequency;
+        s.pipes[pipe].temperature = PIPE[pipe].temperature;
+        s.pipes[pipe].oilRp = PIPE[pipe].oilrp;
+        s.pipes[pipe].tempStability = PIPE[pipe].tempStability;
+        s.pipes[pipe].freqStability = PIPE[pipe].freqStability;
+    }
+
+    s.bus.clear();
+    foreach (const BusSeries & series, m_busStatistics.series())
+    {
+        MetricsBus b;
+        b.slave = series.slave;
+        b.function = series.function;
+        b.requests = series.requests;
+        b.timeouts = series.timeouts;
+        b.crcErrors = series.crcErrors;
+        b.otherErrors = series.otherErrors;
+        b.p50 = series.roundTrip.percentile(50)/1e6;
+        b.p99 = series.roundTrip.percentile(99)/1e6;
+        b.sum = series.roundTrip.sum()/1e6;
+        b.count = series.roundTrip.count();
+        s.bus.append(b);
+    }
+    s.busDutyCycle = m_busStatistics.dutyCycle();
+
+    m_metricsServer->publish();
+}
+
+
+void
+MainWindow::
+onExportDiagnostics()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,tr("Export Bus Diagnostics"), "",tr("CSV file (*.csv);;All Files (*)"));
+
+    if (fileName.isEmpty()) return;
+    QFile file(fileName);
+    QTextStream out(&file);
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        QMessageBox::information(this, tr("Unable to open file"),file.errorString());
+        return;
+    }
+
+    out << m_busStatistics.toCsv();
+    file.close();
+}
+
+
+void
+MainWindow::
+onResetDiagnostics()
+{
+    m_busStatistics.reset();
+    updateDiagnostics();
+}
+
+
 void
 MainWindow::
 updateLineView()
@@ -823,6 +1786,13 @@ connectSerialPort()
 {
     connect( ui->groupBox_18, SIGNAL(toggled(bool)), this, SLOT(onCheckBoxChecked(bool)));
     connect( this, SIGNAL(connectionError(const QString&)), this, SLOT(setStatusError(const QString&)));
+
+    /// follow adapters coming and going
+    m_portEnumerator = new QextSerialEnumerator();
+    m_portEnumerator->setParent(this);
+    connect( m_portEnumerator, SIGNAL(deviceDiscovered(const QextPortInfo &)), this, SLOT(onSerialPortDiscovered(const QextPortInfo &)));
+    connect( m_portEnumerator, SIGNAL(deviceRemoved(const QextPortInfo &)), this, SLOT(onSerialPortRemoved(const QextPortInfo &)));
+    m_portEnumerator->setUpNotifications();
 }
 
 
@@ -832,6 +1802,15 @@ connectActions()
 {
     connect( ui->actionAbout_QModBus, SIGNAL( triggered() ),this, SLOT( aboutQModBus() ) );
     connect( ui->functionCode, SIGNAL( currentIndexChanged( int ) ),this, SLOT( enableHexView() ) );
+    connect( ui->menuTools->addAction( tr("Run History...") ), SIGNAL( triggered() ),this, SLOT( onRunHistory() ) );
+    connect( ui->menuTools->addAction( tr("Import Legacy Files...") ), SIGNAL( triggered() ),this, SLOT( onImportLegacyFiles() ) );
+    connect( &m_legacyImport, SIGNAL( finished() ),this, SLOT( onLegacyFilesImported() ) );
+    connect( ui->menuTools->addAction( tr("Re-fit Archive...") ), SIGNAL( triggered() ),this, SLOT( onRefitArchive() ) );
+    connect( &m_refit, SIGNAL( finished() ),this, SLOT( onArchiveRefitted() ) );
+    connect( ui->menuTools->addAction( tr("Discover Devices...") ), SIGNAL( triggered() ),this, SLOT( onDiscoverDevices() ) );
+    connect( &m_discovery, SIGNAL( finished() ),this, SLOT( onDevicesDiscovered() ) );
+    connect( ui->menuTools->addAction( tr("Tune Serial Link...") ), SIGNAL( triggered() ),this, SLOT( onTuneLink() ) );
+    connect( &m_linkTuning, SIGNAL( finished() ),this, SLOT( onLinkTuned() ) );
 }
 
 
@@ -975,6 +1954,7 @@ MainWindow::
 connectMasterPipe()
 {
     connect(ui->radioButton_11, SIGNAL(toggled(bool)), this, SLOT(onMasterPipeToggled(bool)));
+    connect(&LOOP.masterTracker, SIGNAL(sampled(double,double)), this, SLOT(onMasterPipeSampled(double,double)));
 }
 
 void
@@ -988,43 +1968,151 @@ void
 MainWindow::
 readJsonConfigFile()
 {
-    bool ok = false;
-	QFile file("./sparky.json");
-   	file.open(QIODevice::ReadOnly);
-	QString jsonString = file.readAll();
-	QJsonDocument jsonDoc(QJsonDocument::fromJson(jsonString.toUtf8()));
-    QJsonObject jsonObj = jsonDoc.object(); 
-    QVariantMap json = jsonObj.toVariantMap();
+	/// a bad file keeps the running configuration, the defaults on startup
+	Settings settings = currentSettings();
+	QString error;
+	if (!m_settingsFile->load(settings, error))
+	{
+		qWarning() << "settings:" << error;
+		setStatusError(tr("Configuration not applied: ") + error);
+	}
+
+	/// a run keeps the keys that shape it until it ends
+	if (LOOP.isCal) onSettingsChanged(settings);
+	else applySettings(settings);
+}
+
+
+/// the gui and LOOP hold the live values, fold them back into a Settings
+Settings
+MainWindow::
+currentSettings() const
+{
+	Settings settings;
+
+    /// file server
+	settings.mainServer = m_mainServer;
+	settings.localServer = m_localServer;
+
+    /// calibration control variables
+	settings.injectionOilPumpRate = LOOP.injectionOilPumpRate;
+	settings.injectionWaterPumpRate = LOOP.injectionWaterPumpRate;
+	settings.injectionSmallWaterPumpRate = LOOP.injectionSmallWaterPumpRate;
+	settings.injectionBucket = LOOP.injectionBucket;
+	settings.injectionMark = LOOP.injectionMark;
+	settings.injectionMethod = LOOP.injectionMethod;
+	settings.pressureSensorSlope = LOOP.pressureSensorSlope;
+	settings.minRefTemp = LOOP.minRefTemp;
+	settings.maxRefTemp = LOOP.maxRefTemp;
+	settings.injectionTemp = LOOP.injectionTemp;
+	settings.xDelay = LOOP.xDelay;
+	settings.yFreq = LOOP.yFreq;
+	settings.zTemp = LOOP.zTemp;
+	settings.intervalSmallPump = LOOP.intervalSmallPump;
+	settings.intervalBigPump = LOOP.intervalBigPump;
+	settings.intervalOilPump = LOOP.intervalOilPump;
+	settings.loopNumber = LOOP.loopNumber;
+	settings.masterMin = LOOP.masterMin;
+	settings.masterMax = LOOP.masterMax;
+	settings.masterDelta = LOOP.masterDelta;
+	settings.masterDeltaFinal = LOOP.masterDeltaFinal;
+	settings.maxInjectionWater = LOOP.maxInjectionWater;
+	settings.maxInjectionOil = LOOP.maxInjectionOil;
+	settings.masterPollInterval = LOOP.masterPollInterval;
+
+	/// connection
+	settings.portIndex = LOOP.portIndex;
+	settings.portSerial = LOOP.portSerial;
+	settings.lowLatencyPorts = LOOP.lowLatencyPorts;
+	settings.linkBaudRegister = LOOP.linkBaudRegister;
+	settings.linkBauds = LOOP.linkBauds;
+	settings.metricsPort = LOOP.metricsPort;
+	settings.eventLog = LOOP.eventLog;
+	settings.runCatalog = LOOP.runCatalog;
+	settings.captureDir = LOOP.captureDir;
+	settings.replayFile = LOOP.replayFile;
+	settings.isReplayFast = LOOP.isReplayFast;
+
+	/// stability criteria per temp run phase
+	settings.stabilityEwmaAlpha = LOOP.stabilityEwmaAlpha;
+	settings.isPredictiveSettling = LOOP.isPredictiveSettling;
+	for (int phase = 0; phase < STABILITY_PHASES; phase++)
+	{
+		settings.tempCriteria[phase] = LOOP.tempCriteria[phase];
+		settings.freqCriteria[phase] = LOOP.freqCriteria[phase];
+	}
+
+	/// online calibration fits
+	settings.fitCurveDegree = LOOP.fitCurveDegree;
+	settings.fitTempDegree = LOOP.fitTempDegree;
+	settings.fitCurveRegister = LOOP.fitCurveRegister;
+	settings.fitTempRegister = LOOP.fitTempRegister;
+
+	return settings;
+}
+
 
+void
+MainWindow::
+applySettings(const Settings & settings)
+{
     /// file server 
-	m_mainServer = json[MAIN_SERVER].toString();
-	m_localServer = json[LOCAL_SERVER].toString();
+	m_mainServer = settings.mainServer;
+	m_localServer = settings.localServer;
 
     /// calibration control variables
-	LOOP.injectionOilPumpRate = json[LOOP_OIL_PUMP_RATE].toDouble();
-	LOOP.injectionWaterPumpRate = json[LOOP_WATER_PUMP_RATE].toDouble();
-	LOOP.injectionSmallWaterPumpRate = json[LOOP_SMALL_WATER_PUMP_RATE].toDouble();
-	LOOP.injectionBucket = json[LOOP_BUCKET].toDouble();
-	LOOP.injectionMark = json[LOOP_MARK].toDouble();
-	LOOP.injectionMethod = json[LOOP_METHOD].toDouble();
-	LOOP.pressureSensorSlope = json[LOOP_PRESSURE].toDouble();
-	LOOP.minRefTemp = json[LOOP_MIN_TEMP].toInt();
-	LOOP.maxRefTemp = json[LOOP_MAX_TEMP].toInt();
-	LOOP.injectionTemp = json[LOOP_INJECTION_TEMP].toInt();
-	LOOP.xDelay = json[LOOP_X_DELAY].toInt();
-	LOOP.yFreq = json[LOOP_Y_FREQ].toDouble();
-	LOOP.zTemp = json[LOOP_Z_TEMP].toDouble();
-	LOOP.intervalSmallPump = json[LOOP_INTERVAL_SMALL_PUMP].toDouble();
-	LOOP.intervalBigPump = json[LOOP_INTERVAL_BIG_PUMP].toDouble();
-	LOOP.intervalOilPump = json[LOOP_INTERVAL_OIL_PUMP].toDouble();
-	LOOP.loopNumber = json[LOOP_NUMBER].toInt();
-	LOOP.masterMin = json[LOOP_MASTER_MIN].toDouble();
-	LOOP.masterMax = json[LOOP_MASTER_MAX].toDouble();
-	LOOP.masterDelta = json[LOOP_MASTER_DELTA].toDouble();
-	LOOP.masterDeltaFinal = json[LOOP_MASTER_DELTA_FINAL].toDouble();
-	LOOP.maxInjectionWater = json[LOOP_MAX_INJECTION_WATER].toInt();
-	LOOP.maxInjectionOil = json[LOOP_MAX_INJECTION_OIL].toInt();
-	LOOP.portIndex = json[LOOP_PORT_INDEX].toInt();
+	LOOP.injectionOilPumpRate = settings.injectionOilPumpRate;
+	LOOP.injectionWaterPumpRate = settings.injectionWaterPumpRate;
+	LOOP.injectionSmallWaterPumpRate = settings.injectionSmallWaterPumpRate;
+	LOOP.injectionBucket = settings.injectionBucket;
+	LOOP.injectionMark = settings.injectionMark;
+	LOOP.injectionMethod = settings.injectionMethod;
+	LOOP.pressureSensorSlope = settings.pressureSensorSlope;
+	LOOP.minRefTemp = settings.minRefTemp;
+	LOOP.maxRefTemp = settings.maxRefTemp;
+	LOOP.injectionTemp = settings.injectionTemp;
+	LOOP.xDelay = settings.xDelay;
+	LOOP.yFreq = settings.yFreq;
+	LOOP.zTemp = settings.zTemp;
+	LOOP.intervalSmallPump = settings.intervalSmallPump;
+	LOOP.intervalBigPump = settings.intervalBigPump;
+	LOOP.intervalOilPump = settings.intervalOilPump;
+	LOOP.loopNumber = settings.loopNumber;
+	LOOP.masterMin = settings.masterMin;
+	LOOP.masterMax = settings.masterMax;
+	LOOP.masterDelta = settings.masterDelta;
+	LOOP.masterDeltaFinal = settings.masterDeltaFinal;
+	LOOP.maxInjectionWater = settings.maxInjectionWater;
+	LOOP.maxInjectionOil = settings.maxInjectionOil;
+	LOOP.masterPollInterval = settings.masterPollInterval;
+
+	/// connection, takes effect the next time the port is opened
+	LOOP.portIndex = settings.portIndex;
+	LOOP.portSerial = settings.portSerial;
+	LOOP.lowLatencyPorts = settings.lowLatencyPorts;
+	LOOP.linkBaudRegister = settings.linkBaudRegister;
+	LOOP.linkBauds = settings.linkBauds;
+	LOOP.metricsPort = settings.metricsPort;
+	LOOP.eventLog = settings.eventLog;
+	LOOP.runCatalog = settings.runCatalog;
+	LOOP.captureDir = settings.captureDir;
+	LOOP.replayFile = settings.replayFile;
+	LOOP.isReplayFast = settings.isReplayFast;
+
+	/// stability criteria per temp run phase
+	LOOP.stabilityEwmaAlpha = settings.stabilityEwmaAlpha;
+	LOOP.isPredictiveSettling = settings.isPredictiveSettling;
+	for (int phase = 0; phase < STABILITY_PHASES; phase++)
+	{
+		LOOP.tempCriteria[phase] = settings.tempCriteria[phase];
+		LOOP.freqCriteria[phase] = settings.freqCriteria[phase];
+	}
+
+	/// online calibration fits, the degrees take effect with the next run
+	LOOP.fitCurveDegree = settings.fitCurveDegree;
+	LOOP.fitTempDegree = settings.fitTempDegree;
+	LOOP.fitCurveRegister = settings.fitCurveRegister;
+	LOOP.fitTempRegister = settings.fitTempRegister;
 
 	/// main configuration panel
 	ui->lineEdit_27->setText(QString::number(LOOP.injectionOilPumpRate));
@@ -1050,25 +2138,67 @@ readJsonConfigFile()
 	ui->lineEdit_76->setText(QString::number(LOOP.masterMax));
 	ui->lineEdit_77->setText(QString::number(LOOP.masterDelta));
 	ui->lineEdit_78->setText(QString::number(LOOP.masterDeltaFinal));
+}
+
+
+/// sparky.json was edited by hand. a running calibration picks the keys
+/// that are safe to change up between two cycles, never in the middle of
+/// one, and the rest once it stops.
+void
+MainWindow::
+onSettingsChanged(const Settings & settings)
+{
+	m_pendingSettings = settings;
+	m_isSettingsPending = true;
+	m_isLivePending = true;
 
-    /// done. close file.
-	file.close();
+	if (!LOOP.isCal) applyPendingSettings();
 }
 
 
 void
 MainWindow::
-writeJsonConfigFile(void)
+onSettingsRejected(const QString & error)
 {
-	QFile file(QStringLiteral("sparky.json"));
-    file.open(QIODevice::WriteOnly);
+	setStatusError(tr("Configuration not applied: ") + error);
+}
 
-	QJsonObject json;
 
-    /// file server
-    json[MAIN_SERVER] = m_mainServer;
-	json[LOCAL_SERVER] = m_localServer;
+void
+MainWindow::
+applyPendingSettings()
+{
+	if (!m_isSettingsPending) return;
+	m_isSettingsPending = false;
+	m_isLivePending = false;
+
+	applySettings(m_pendingSettings);
+	m_eventLog.post("settings_reloaded");
+}
+
+
+/// between two cycles of a run, see Settings::mergeLive()
+void
+MainWindow::
+applyLiveSettings()
+{
+	if (!m_isLivePending) return;
+	m_isLivePending = false;
+
+	Settings settings = currentSettings();
+	settings.mergeLive(m_pendingSettings);
+	applySettings(settings);
 
+	QVariantMap fields;
+	fields["deferred"] = true;
+	m_eventLog.post("settings_reloaded", fields);
+}
+
+
+void
+MainWindow::
+writeJsonConfigFile(void)
+{
 	LOOP.injectionOilPumpRate = ui->lineEdit_27->text().toDouble();
 	LOOP.injectionWaterPumpRate = ui->lineEdit_28->text().toDouble(); 
 	LOOP.injectionSmallWaterPumpRate = ui->lineEdit_82->text().toDouble();
@@ -1093,38 +2223,18 @@ writeJsonConfigFile(void)
 	LOOP.masterDelta =  ui->lineEdit_77->text().toDouble();
 	LOOP.masterDeltaFinal = ui->lineEdit_78->text().toDouble();
 
-    /// calibration control variables
-	json[LOOP_OIL_PUMP_RATE] = QString::number(LOOP.injectionOilPumpRate);
-	json[LOOP_WATER_PUMP_RATE] = QString::number(LOOP.injectionWaterPumpRate);
-	json[LOOP_SMALL_WATER_PUMP_RATE] = QString::number(LOOP.injectionSmallWaterPumpRate);
-	json[LOOP_BUCKET] = QString::number(LOOP.injectionBucket);
-	json[LOOP_MARK] = QString::number(LOOP.injectionMark);
-	json[LOOP_METHOD] = QString::number(LOOP.injectionMethod);
-	json[LOOP_PRESSURE] = QString::number(LOOP.pressureSensorSlope);
-	json[LOOP_MIN_TEMP] = QString::number(LOOP.minRefTemp);
-	json[LOOP_MAX_TEMP] = QString::number(LOOP.maxRefTemp);
-	json[LOOP_INJECTION_TEMP] = QString::number(LOOP.injectionTemp);
-	json[LOOP_X_DELAY] = QString::number(LOOP.xDelay);
-	json[LOOP_Y_FREQ] = QString::number(LOOP.yFreq);
-	json[LOOP_Z_TEMP] = QString::number(LOOP.zTemp);
-	json[LOOP_INTERVAL_SMALL_PUMP] = QString::number(LOOP.intervalSmallPump);
-	json[LOOP_INTERVAL_BIG_PUMP] = QString::number(LOOP.intervalBigPump);
-	json[LOOP_INTERVAL_OIL_PUMP] = QString::number(LOOP.intervalOilPump);
-	json[LOOP_NUMBER] = QString::number(LOOP.loopNumber);
-	json[LOOP_MASTER_MIN] = QString::number(LOOP.masterMin);
-	json[LOOP_MASTER_MAX] = QString::number(LOOP.masterMax);
-	json[LOOP_MASTER_DELTA] = QString::number(LOOP.masterDelta);
-	json[LOOP_MASTER_DELTA_FINAL] = QString::number(LOOP.masterDeltaFinal);
-	json[LOOP_MAX_INJECTION_WATER] = QString::number(LOOP.maxInjectionWater);
-	json[LOOP_MAX_INJECTION_OIL] = QString::number(LOOP.maxInjectionOil);
-	json[LOOP_PORT_INDEX] = QString::number(LOOP.portIndex);
-
-    /// file server 
-	json[MAIN_SERVER] = m_mainServer;
-	json[LOCAL_SERVER] = m_localServer;
+	/// a hand edit held back by the run stays in the file, with whatever
+	/// changed live since it was applied
+	Settings settings = currentSettings();
+	if (m_isSettingsPending)
+	{
+		Settings held = m_pendingSettings;
+		if (!m_isLivePending) held.mergeLive(settings);
+		settings = held;
+	}
 
-	file.write(QJsonDocument(json).toJson());
-	file.close();
+	/// debounced, a burst of edits is one write
+	m_settingsFile->save(settings);
 }
 
 void
@@ -1560,6 +2670,7 @@ onActionStop()
 	delay(1);
 
 	LOOP.runMode = STOP_MODE;
+	logPhaseChange();
 
 	/// stop calibration
 	stopCalibration();
@@ -1766,6 +2877,12 @@ void
 MainWindow::
 onEquationButtonPressed()
 {
+    if (isBusBusy())
+    {
+        setStatusError(tr("The serial loop is busy"));
+        return;
+    }
+
     ui->startEquationBtn->setEnabled(false);
     ui->startEquationBtn->setText( tr("Loading") );
 
@@ -1915,6 +3032,13 @@ informUser(const QString t1, const QString t2, const QString t3 = "")
     msgBox.setInformativeText(t3);
     msgBox.setStandardButtons(QMessageBox::Ok);
     int ret = msgBox.exec();
+
+    QVariantMap fields;
+    fields["title"] = t1;
+    fields["text"] = t2;
+    fields["detail"] = t3;
+    m_eventLog.post("inform_user", fields);
+
     switch (ret) {
         case QMessageBox::Ok: return true;
         default: return true;
@@ -1931,6 +3055,13 @@ isUserInputYes(const QString t1, const QString t2)
     msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::Cancel);
     msgBox.setDefaultButton(QMessageBox::Yes);
     int ret = msgBox.exec();
+
+    QVariantMap fields;
+    fields["question"] = t1;
+    fields["detail"] = t2;
+    fields["answer"] = (ret == QMessageBox::Cancel) ? "cancel" : "yes";
+    m_eventLog.post("operator_answer", fields);
+
     switch (ret) {
         case QMessageBox::Yes: return true;
         case QMessageBox::Cancel: return false;
@@ -2275,15 +3406,74 @@ connectProfiler()
 
 void
 MainWindow::
-setupModbusPorts()
+setupModbusPorts()
+{
+    /// enumeration can take seconds on some hosts, the window shows meanwhile
+    ui->comboBox->disconnect();
+    ui->comboBox->clear();
+    ui->comboBox->addItem(tr("Searching for serial ports..."));
+    ui->comboBox->setEnabled(false);
+
+    /// after a restart the ports are already known
+    if (globalTransports->hasPorts())
+    {
+        m_ports = globalTransports->ports();
+        ui->comboBox->setEnabled(true);
+        attachSerialPorts();
+        return;
+    }
+
+    connect(&m_portScan, SIGNAL(finished()), this, SLOT(onSerialPortsEnumerated()));
+    m_portScan.setFuture(QtConcurrent::run(&QextSerialEnumerator::getPorts));
+}
+
+
+void
+MainWindow::
+onSerialPortsEnumerated()
 {
-    setupModbusPort();
+    m_ports = m_portScan.result();
+    globalTransports->setPorts(m_ports);
+    ui->comboBox->setEnabled(true);
+    attachSerialPorts();
 }
 
 
 int
 MainWindow::
 setupModbusPort()
+{
+    /// the startup scan attaches the port when it is done
+    if (m_portScan.isRunning()) return LOOP.portIndex;
+
+    m_ports = QextSerialEnumerator::getPorts();
+    globalTransports->setPorts(m_ports);
+
+    return attachSerialPorts();
+}
+
+
+/// the name modbus_new_rtu() opens a port by
+static QString devicePath(const QextPortInfo & info)
+{
+    // is it a serial port in the range COM1 .. COM9?
+    if ( info.portName.startsWith( "COM" ) )
+    {
+        // use windows communication device name "\\.\COMn"
+        return "\\\\.\\" + info.portName;
+    }
+    else if ( info.physName.startsWith( "/dev/" ) )
+    {
+        return info.physName;
+    }
+
+    return info.portName;
+}
+
+
+int
+MainWindow::
+attachSerialPorts()
 {
     QSettings s;
 
@@ -2291,7 +3481,7 @@ setupModbusPort()
     int i = 0;
     ui->comboBox->disconnect();
     ui->comboBox->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( QextPortInfo port, m_ports )
     {
         ui->comboBox->addItem( port.friendName );
 
@@ -2307,6 +3497,13 @@ setupModbusPort()
     ui->comboBox_4->setCurrentIndex(0);
     ui->comboBox_5->setCurrentIndex(0);
 
+    /// a tuned loop comes back at its rate
+    if ((portIndex >= 0) && (portIndex < m_ports.size()))
+    {
+        const int index = ui->comboBox_2->findText(QString::number(linkBaud(m_ports[portIndex])));
+        if (index >= 0) ui->comboBox_2->setCurrentIndex(index);
+    }
+
     connect( ui->comboBox, SIGNAL( currentIndexChanged( int ) ),this, SLOT( changeSerialPort( int ) ) );
     connect( ui->comboBox_2, SIGNAL( currentIndexChanged( int ) ),this, SLOT( changeSerialPort( int ) ) );
     connect( ui->comboBox_3, SIGNAL( currentIndexChanged( int ) ),this, SLOT( changeSerialPort( int ) ) );
@@ -2328,8 +3525,7 @@ void
 MainWindow::
 releaseSerialModbus()
 {
-    modbus_close( LOOP.serialModbus );
-    modbus_free( LOOP.serialModbus );
+    globalTransports->release( SERIAL_LOOP_TRANSPORT );
     LOOP.serialModbus = NULL;
     updateLoopTabIcon(false);
 }
@@ -2339,12 +3535,15 @@ void
 MainWindow::
 changeSerialPort( int )
 {
+    if (isBusBusy()) return;
+
     const int iface = ui->comboBox->currentIndex();
+    const QList<QextPortInfo> & ports = m_ports;
     LOOP.portIndex = iface;
+    if ((iface >= 0) && (iface < ports.size())) LOOP.portSerial = ports[iface].serialNumber;
     writeJsonConfigFile();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    if( (iface >= 0) && (iface < ports.size()) )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -2352,14 +3551,7 @@ changeSerialPort( int )
         settings.setValue( "serialparity", ui->comboBox_3->currentText() );
         settings.setValue( "serialdatabits", ui->comboBox_4->currentText() );
         settings.setValue( "serialstopbits", ui->comboBox_5->currentText() );
-        QString port = ports[iface].portName;
-
-        // is it a serial port in the range COM1 .. COM9?
-        if ( port.startsWith( "COM" ) )
-        {
-            // use windows communication device name "\\.\COMn"
-            port = "\\\\.\\" + port;
-        }
+        const QString port = devicePath(ports[iface]);
 
         char parity;
         switch( ui->comboBox_3->currentIndex() )
@@ -2373,24 +3565,189 @@ changeSerialPort( int )
         changeModbusInterface(port, parity);
         onRtuPortActive(true);
     }
+    else if (!LOOP.replayFile.isEmpty())
+    {
+        /// a capture needs no rig
+        changeModbusInterface(LOOP.replayFile, 'N');
+        onRtuPortActive(true);
+    }
     else emit connectionError( tr( "No serial port found at Loop_1" ) );
 }
 
 
+void
+MainWindow::
+onSerialPortDiscovered(const QextPortInfo & info)
+{
+    /// the startup scan reports it anyway
+    if (m_portScan.isRunning()) return;
+
+    if (isBusBusy())
+    {
+        m_deferredPorts.append(qMakePair(true, info));
+        return;
+    }
+
+    /// a replugged adapter may have other analyzers behind it
+    globalDevices->invalidate(devicePath(info));
+
+    int index = -1;
+    for (int i = 0; i < m_ports.size(); i++) if (m_ports[i].portName == info.portName) index = i;
+
+    if (index < 0)
+    {
+        m_ports.append(info);
+        ui->comboBox->blockSignals(true);
+        ui->comboBox->addItem(info.friendName);
+        ui->comboBox->blockSignals(false);
+        index = m_ports.size() - 1;
+    }
+    else m_ports[index] = info;
+    globalTransports->setPorts(m_ports);
+
+    /// reattach the loop to its adapter under whatever name it came back
+    if (!LOOP.portSerial.isEmpty() && (info.serialNumber == LOOP.portSerial) && (LOOP.serialModbus == NULL))
+    {
+        ui->comboBox->blockSignals(true);
+        ui->comboBox->setCurrentIndex(index);
+        ui->comboBox->blockSignals(false);
+
+        /// at the rate the link tuning left it at
+        const int baud = ui->comboBox_2->findText(QString::number(linkBaud(info)));
+        ui->comboBox_2->blockSignals(true);
+        if (baud >= 0) ui->comboBox_2->setCurrentIndex(baud);
+        ui->comboBox_2->blockSignals(false);
+        changeSerialPort(index);
+    }
+}
+
+
+void
+MainWindow::
+onSerialPortRemoved(const QextPortInfo & info)
+{
+    if (m_portScan.isRunning()) return;
+
+    /// the worker keeps the context until it gives up on the dead port
+    if (isBusBusy())
+    {
+        m_deferredPorts.append(qMakePair(false, info));
+        m_busScanner.cancel();
+        m_linkTuner.cancel();
+        return;
+    }
+
+    globalDevices->invalidate(devicePath(info));
+
+    for (int i = 0; i < m_ports.size(); i++)
+    {
+        if (m_ports[i].portName != info.portName) continue;
+
+        /// the open context is dead, it gets a new one when the adapter returns
+        if ((i == ui->comboBox->currentIndex()) && LOOP.serialModbus)
+        {
+            releaseSerialModbus();
+            onRtuPortActive(false);
+            emit connectionError(tr("Serial adapter removed from ")+info.portName);
+        }
+
+        ui->comboBox->blockSignals(true);
+        ui->comboBox->removeItem(i);
+        ui->comboBox->blockSignals(false);
+        m_ports.removeAt(i);
+        globalTransports->setPorts(m_ports);
+        return;
+    }
+}
+
+
 void
 MainWindow::
 changeModbusInterface(const QString& port, char parity)
 {
-    releaseSerialModbus();
-    LOOP.serialModbus = modbus_new_rtu( port.toLatin1().constData(),ui->comboBox_2->currentText().toInt(),parity,ui->comboBox_3->currentText().toInt(),ui->comboBox_4->currentText().toInt() );
+    TransportSettings settings;
+    settings.port = port;
+    settings.baud = ui->comboBox_2->currentText().toInt();
+    settings.parity = parity;
+    settings.dataBits = ui->comboBox_3->currentText().toInt();
+    settings.stopBits = ui->comboBox_4->currentText().toInt();
+
+    /// a configured capture replaces the serial port
+    if (!LOOP.replayFile.isEmpty())
+    {
+        settings.port = LOOP.replayFile;
+        settings.isReplay = true;
+        settings.isReplayFast = LOOP.isReplayFast;
+    }
+
+    /// a restarted window gets the context it left open
+    bool isReused = false;
+    LOOP.serialModbus = globalTransports->acquire( SERIAL_LOOP_TRANSPORT, settings, isReused );
+
+    /// identities measured at another baud rate or on another port do not carry over
+    if (!isReused) globalDevices->invalidate(settings.port);
+    m_serialPort = settings.port;
             
-    if( modbus_connect( LOOP.serialModbus ) == -1 )
+    if( LOOP.serialModbus == NULL )
     {
         emit connectionError( tr( "Could not connect serial port at LOOP " )+QString::number(0) );
-        releaseSerialModbus();
+        updateLoopTabIcon(false);
     }
     else
+    {
+        /// opt-in low latency profile, a failure leaves the port usable as it is
+        const int mode = lowLatencyMode(port);
+        if (!isReused && !settings.isReplay && (mode != MODBUS_RTU_LOW_LATENCY_OFF) && (modbus_rtu_set_low_latency(LOOP.serialModbus, mode) == -1)) setStatusError(tr("Low latency profile not available on ")+port);
+
+        modbus_register_monitor_transaction_fnc(LOOP.serialModbus, MainWindow::stBusMonitorTransaction);
+        if (!isReused) startCapture();
+
         updateLoopTabIcon(true);
+    }
+}
+
+
+void
+MainWindow::
+startCapture()
+{
+    if (LOOP.captureDir.isEmpty() || !LOOP.serialModbus) return;
+
+    /// one file per connection, a reconnect never overwrites a capture
+    const QString path = QDir(LOOP.captureDir).absoluteFilePath(QString("LOOP%1_%2.mbcap").arg(LOOP.loopNumber).arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss")));
+    if (modbus_set_capture(LOOP.serialModbus, path.toLocal8Bit().constData()) == -1) setStatusError(tr("Could not capture bus traffic to ")+path);
+}
+
+
+int
+MainWindow::
+lowLatencyMode(const QString & port) const
+{
+    foreach (const QString & entry, LOOP.lowLatencyPorts)
+    {
+        const QStringList fields = entry.trimmed().split('=');
+        const QString & id = fields[0];
+        if ((id.isEmpty()) || ((id != LOOP.portSerial) && (id != port))) continue;
+
+        return (fields.value(1) == "rs485") ? MODBUS_RTU_LOW_LATENCY_RS485 : MODBUS_RTU_LOW_LATENCY_ON;
+    }
+
+    return MODBUS_RTU_LOW_LATENCY_OFF;
+}
+
+
+/// rate the link tuning left the loop at on this port, 0 when it was never tuned
+int
+MainWindow::
+linkBaud(const QextPortInfo & info) const
+{
+    foreach (const QString & entry, LOOP.linkBauds)
+    {
+        const QString id = entry.section('=', 0, 0).trimmed();
+        if (!id.isEmpty() && ((id == info.serialNumber) || (id == devicePath(info)))) return entry.section('=', 1, 1).toInt();
+    }
+
+    return 0;
 }
 
 
@@ -2398,6 +3755,15 @@ void
 MainWindow::
 onCheckBoxChecked(bool checked)
 {
+    /// the port stays as the worker found it
+    if (isBusBusy())
+    {
+        ui->groupBox_18->blockSignals(true);
+        ui->groupBox_18->setChecked(!checked);
+        ui->groupBox_18->blockSignals(false);
+        return;
+    }
+
     clearMonitors();
 
     if (checked) 
@@ -2609,6 +3975,7 @@ updateFileList(const QString fileName, const int sn, const int pipe)
     QString header1("SN"+QString::number(sn)+" | "+LOOP.mode.split("\\").at(1) +" | "+currentDataTime.toString()+" | L"+QString::number(LOOP.loopNumber)+PIPE[pipe].pipeId+" | "+PROJECT+RELEASE_VERSION); 
  
     file.setFileName(PIPE[pipe].mainDirPath+"\\"+FILE_LIST);
+    m_runCatalog.addFile(PIPE[pipe].runId, PIPE[pipe].mainDirPath+"\\"+fileName);
     file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
 
 	/// write header to streamList
@@ -2705,10 +4072,21 @@ bool
 MainWindow::
 validateSerialNumber(modbus_t * serialModbus)
 {
+	const bool isEEA = ui->radioButton->isChecked();
+	const device::Identity & family = isEEA ? device::Eea::identity : device::Razor::identity;
+
 	for (int pipe=0; pipe<3; pipe++)
 	{
 		if (PIPE[pipe].status == ENABLED)
 		{
+			/// validated earlier this session and nothing failed since
+			DeviceIdentity cached;
+			if (globalDevices->find(m_serialPort, PIPE[pipe].slave->text().toInt(), cached) && (cached.isEEA == isEEA) && (cached.mapVersion == family.mapVersion))
+			{
+   				PIPE[pipe].checkBox->setChecked(true);
+				continue;
+			}
+
 			uint8_t dest[1024];
     		uint16_t * dest16 = (uint16_t *) dest;
     		int ret = -1;
@@ -2718,13 +4096,16 @@ validateSerialNumber(modbus_t * serialModbus)
 
 			/// set slave
    			memset( dest, 0, 1024 );
-   			modbus_set_slave( serialModbus, PIPE[pipe].slave->text().toInt());
+   			modbus_set_extended_slave( serialModbus, PIPE[pipe].slave->text().toInt());
 
 			/// unlock FCT registers
    			modbus_write_register(serialModbus,999,1);
 
    			/// read pipe serial number
+			QElapsedTimer roundTrip;
+			roundTrip.start();
   			sendCalibrationRequest(FLOAT_R, serialModbus, FUNC_READ_INT, LOOP.ID_SN_PIPE, BYTE_READ_INT, ret, dest, dest16, is16Bit, writeAccess, funcType);
+			qint64 slowestUs = roundTrip.nsecsElapsed() / 1000;
 
 			/// verify if serial number matches with pipe
    			if (*dest16 != PIPE[pipe].slave->text().toInt()) 
@@ -2752,6 +4133,21 @@ validateSerialNumber(modbus_t * serialModbus)
 
 			/// lock FCT registers
    			modbus_write_register(serialModbus,999,0);
+
+			/// one poll of the pipe table proves the register map before it is trusted for the session
+			double values[device::PIPE_FIELDS];
+			roundTrip.restart();
+			if (LOOP.readPipeRegisters(serialModbus, PIPE[pipe].slave->text().toInt(), true, values))
+			{
+				slowestUs = qMax(slowestUs, roundTrip.nsecsElapsed() / 1000);
+
+				DeviceIdentity identity;
+				identity.serialNumber = *dest16;
+				identity.isEEA = isEEA;
+				identity.mapVersion = family.mapVersion;
+				identity.timeoutUs = int(qBound(qint64(DEVICE_MIN_TIMEOUT_US), DEVICE_TIMEOUT_FACTOR * slowestUs, qint64(DEVICE_MAX_TIMEOUT_US)));
+				globalDevices->insert(m_serialPort, PIPE[pipe].slave->text().toInt(), identity);
+			}
 		}
 		else
 		{
@@ -2813,6 +4209,10 @@ prepareCalibration()
 	/// set product & calibration mode & file extension
 	setProductAndCalibrationMode();
 
+	/// run files go to the spool, the server may have moved since the last run
+	initializeSpool();
+	initializeRunCatalog();
+
 	/// pipe specific vars
 	for (int pipe = 0; pipe < 3; pipe++)
 	{
@@ -2822,8 +4222,12 @@ prepareCalibration()
 
 		PIPE[pipe].tempStability = 0;
    		PIPE[pipe].freqStability = 0;
+		PIPE[pipe].tempDetector.reset();
+		PIPE[pipe].freqDetector.reset();
+		PIPE[pipe].tempSettling.reset();
+		PIPE[pipe].freqSettling.reset();
    		PIPE[pipe].etimer->restart();
-   		PIPE[pipe].mainDirPath = m_mainServer+LOOP.mode+QString::number(((int)(PIPE[pipe].slave->text().toInt()/100))*100).append("'s").append("\\")+LOOP.mode.split("\\").at(2)+PIPE[pipe].slave->text(); 
+   		PIPE[pipe].mainDirPath = m_spool.spoolRoot()+LOOP.mode+QString::number(((int)(PIPE[pipe].slave->text().toInt()/100))*100).append("'s").append("\\")+LOOP.mode.split("\\").at(2)+PIPE[pipe].slave->text(); 
 
 		/// set AMB_ filename
 		if (PIPE[pipe].status == ENABLED) prepareForNextFile(pipe, QString("AMB").append("_").append(QString::number(LOOP.minRefTemp)).append(LOOP.filExt));
@@ -2857,6 +4261,7 @@ onCalibrationButtonPressed()
     if (LOOP.isCal)
     {
 		LOOP.runMode = TEMP_RUN_MODE;
+		logPhaseChange();
 
 		for (int pipe = 0; pipe < 3; pipe++)
 		{
@@ -2864,28 +4269,38 @@ onCalibrationButtonPressed()
 			{
 				PIPE[pipe].isStartFreq = true;
       			QDir dir;
-       			int fileCounter = 2;
+				const QString sn = PIPE[pipe].slave->text();
+				const QString mode = LOOP.mode.split("\\").at(1);
 
-       			/// create file directory "g:/FULLCUT/FC" + "8756"
-       			if (!dir.exists(PIPE[pipe].mainDirPath)) dir.mkpath(PIPE[pipe].mainDirPath);
-       			else
-       			{
-           			while (1)
-           			{
-               			if (!dir.exists(PIPE[pipe].mainDirPath+"_"+QString::number(fileCounter))) 
-               			{
-                   			PIPE[pipe].mainDirPath += "_"+QString::number(fileCounter);
-                   			dir.mkpath(PIPE[pipe].mainDirPath);
-
-							if ((LOOP.mode == LOW) || !LOOP.isEEA)
-							{
-								prepareForNextFile(pipe, QString("AMB").append("_").append(QString::number(LOOP.minRefTemp)).append(LOOP.filExt));
-							}
-                   			break;
-               			}
-               			else fileCounter++;
-           			}
-       			}
+       			/// create file directory "g:/FULLCUT/FC" + "8756", "_2", "_3".. for reruns.
+				/// the catalog knows the last run, probing only covers runs it never saw
+				int runIndex = m_runCatalog.nextRunIndex(mode, sn);
+				while (isRunDirectoryTaken(runDirectory(PIPE[pipe].mainDirPath, runIndex))) runIndex++;
+
+				PIPE[pipe].mainDirPath = runDirectory(PIPE[pipe].mainDirPath, runIndex);
+				dir.mkpath(PIPE[pipe].mainDirPath);
+				if ((runIndex > 1) && ((LOOP.mode == LOW) || !LOOP.isEEA))
+				{
+					prepareForNextFile(pipe, QString("AMB").append("_").append(QString::number(LOOP.minRefTemp)).append(LOOP.filExt));
+				}
+
+				m_spool.addDirectory(PIPE[pipe].mainDirPath);
+
+				RunCatalog::Run run;
+				run.sn = sn;
+				run.mode = mode;
+				run.runIndex = runIndex;
+				run.product = LOOP.isEEA ? "EEA" : "RAZOR";
+				run.loop = LOOP.loopNumber;
+				run.pipe = pipe;
+				run.directory = m_spool.remotePath(PIPE[pipe].mainDirPath).isEmpty() ? PIPE[pipe].mainDirPath : m_spool.remotePath(PIPE[pipe].mainDirPath);
+				run.phase = phaseName();
+				PIPE[pipe].runId = m_runCatalog.beginRun(run);
+				PIPE[pipe].isRunning = true;
+
+				PIPE[pipe].watercutFit.setDegree(LOOP.fitCurveDegree);
+				PIPE[pipe].tempFit.setDegree(LOOP.fitTempDegree);
+				updateFitView(pipe);
 			}
     	}
 
@@ -2897,6 +4312,7 @@ onCalibrationButtonPressed()
 			else if (!LOOP.isCal) return;
 
 			delay(LOOP.xDelay);
+			applyLiveSettings();
 		}
 	}
 	else
@@ -2921,8 +4337,14 @@ stopCalibration()
     LOOP.isMaxRef = false;
     LOOP.isInjection = false;
 
+	/// the fits are complete with the last sample of the run
+	prepareFitUpload();
+
 	for (i=0;i<3;i++)
 	{
+		m_runCatalog.finishRun(PIPE[i].runId);
+		PIPE[i].runId = -1;
+		PIPE[i].isRunning = false;
 		PIPE[i].freqProgress->setValue(0);
 		PIPE[i].tempProgress->setValue(0);
 		PIPE[i].status = DISABLED;
@@ -2930,95 +4352,166 @@ stopCalibration()
 		PIPE[i].isStartFreq = true;
 		PIPE[i].tempStability = 0;
 		PIPE[i].freqtability = 0;
+		PIPE[i].tempDetector.reset();
+		PIPE[i].freqDetector.reset();
+		PIPE[i].tempSettling.reset();
+		PIPE[i].freqSettling.reset();
+		updateSettlingEta(T_BAR, i);
+		updateSettlingEta(F_BAR, i);
 	}
 
+	/// hand edits held back during the run
+	applyPendingSettings();
+
 	return;
 }
 
 
+StabilityCriteria
+MainWindow::
+stabilityCriteria(const bool isF) const
+{
+	/// limits left at 0 follow the loop wide Y/Z deltas
+	const double delta = isF ? LOOP.yFreq : LOOP.zTemp;
+	StabilityCriteria criteria = isF ? LOOP.freqCriteria[LOOP.stabilityPhase] : LOOP.tempCriteria[LOOP.stabilityPhase];
+
+	if (criteria.maxStdDev == 0) criteria.maxStdDev = delta;
+	if (criteria.maxSlope == 0) criteria.maxSlope = delta;
+	criteria.maxEwmaDelta = 2 * criteria.maxStdDev;
+	criteria.ewmaAlpha = LOOP.stabilityEwmaAlpha;
+
+	return criteria;
+}
+
+
+void
+MainWindow::
+updateSettlingEta(const bool isF, const int pipe)
+{
+	const SettlingPredictor & predictor = isF ? PIPE[pipe].freqSettling : PIPE[pipe].tempSettling;
+	QProgressBar * bar = isF ? PIPE[pipe].freqProgress : PIPE[pipe].tempProgress;
+	const double eta = predictor.timeToSettle(stabilityCriteria(isF).maxStdDev);
+
+	if (eta < 0)
+	{
+		bar->setFormat("%p%");
+		bar->setToolTip("");
+		return;
+	}
+
+	bar->setFormat(QString("%p%  ETA ").append(QTime(0,0).addSecs(qMin(eta, 86399.0)).toString("h:mm:ss")));
+	bar->setToolTip(QString("Settling at %1 (tau %2 s)").arg(predictor.asymptote(), 0, 'f', 3).arg(predictor.timeConstant(), 0, 'f', 0));
+}
+
+
 void
 MainWindow::
 readPipe(const int pipe, const bool isStability)
 {
-    uint8_t dest[1024];
-    uint16_t * dest16 = (uint16_t *) dest;
-    int ret = -1;
-    bool is16Bit = false;
-    bool writeAccess = false;
-    const QString funcType = descriptiveDataTypeName( FUNC_READ_FLOAT );
+    double values[device::PIPE_FIELDS];
 
-    /// reset connection
-    memset( dest, 0, 1024 );
-    modbus_set_slave( LOOP.serialModbus, PIPE[pipe].slave->text().toInt() );
- 
-    /// get temperature
-    PIPE[pipe].temperature = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_TEMPERATURE, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
+    /// a validated pipe gets its own timeout, a miss is noticed in a fraction of the default
+    DeviceIdentity identity;
+    uint32_t sec = 0, usec = 0;
+    const bool isCached = globalDevices->find(m_serialPort, PIPE[pipe].slave->text().toInt(), identity);
+    if (isCached)
+    {
+        modbus_get_response_timeout(LOOP.serialModbus, &sec, &usec);
+        modbus_set_response_timeout(LOOP.serialModbus, identity.timeoutUs / 1000000, identity.timeoutUs % 1000000);
+    }
+
+    /// one pass over the register map of the analyzer family
+    isModbusTransmissionFailed = !LOOP.readPipeRegisters(LOOP.serialModbus, PIPE[pipe].slave->text().toInt(), true, values);
+    if (isCached) modbus_set_response_timeout(LOOP.serialModbus, sec, usec);
+    if (!isModbusTransmissionFailed)
+    {
+        PIPE[pipe].temperature = values[device::PipeTemperature];
+        PIPE[pipe].frequency = values[device::PipeFrequency];
+        PIPE[pipe].oilrp = values[device::PipeOilRp];
+        PIPE[pipe].measai = values[device::PipeMeasuredAi];
+        PIPE[pipe].trimai = values[device::PipeTrimmedAi];
+        m_runCatalog.addSample(PIPE[pipe].runId, PIPE[pipe].temperature, PIPE[pipe].frequency);
+
+        /// fits of the run in progress, cataloged or not
+        if (LOOP.isCal && PIPE[pipe].isRunning)
+        {
+            if (LOOP.runMode == TEMP_RUN_MODE) PIPE[pipe].tempFit.addSample(PIPE[pipe].temperature, PIPE[pipe].frequency);
+            else if (LOOP.runMode == INJECTION_MODE) PIPE[pipe].watercutFit.addSample(PIPE[pipe].frequency, LOOP.watercut);
+            updateFitView(pipe);
+        }
+    }
+
+    /// temperature
+	if ((LOOP.runMode == TEMP_RUN_MODE) && !isModbusTransmissionFailed) PIPE[pipe].tempSettling.addSample(PIPE[pipe].etimer->elapsed()/1000.0, PIPE[pipe].temperature);
 
 	if (isStability)
 	{
 		/// check temp stability
-    	if (PIPE[pipe].tempStability < 5) 
+    	if (PIPE[pipe].tempStability < STABILITY_LEVELS) 
 		{
-			if (abs(PIPE[pipe].temperature - PIPE[pipe].temperature_prev) <= LOOP.zTemp) PIPE[pipe].tempStability++;
-			else PIPE[pipe].tempStability = 0;
+			PIPE[pipe].tempDetector.setCriteria(stabilityCriteria(T_BAR));
+			if (!isModbusTransmissionFailed) PIPE[pipe].tempDetector.addSample(PIPE[pipe].temperature);
+			PIPE[pipe].tempStability = PIPE[pipe].tempDetector.level(STABILITY_LEVELS);
+			if (LOOP.isPredictiveSettling && isSettled(PIPE[pipe].tempSettling, PIPE[pipe].tempDetector)) PIPE[pipe].tempStability = STABILITY_LEVELS;
 
 			PIPE[pipe].temperature_prev = PIPE[pipe].temperature;
 		}
-		else PIPE[pipe].tempStability = 5;
+		else PIPE[pipe].tempStability = STABILITY_LEVELS;
 
-    	if (!isModbusTransmissionFailed) updatePipeStability(T_BAR, pipe, PIPE[pipe].tempStability*20);
+    	if (!isModbusTransmissionFailed) updatePipeStability(T_BAR, pipe, PIPE[pipe].tempStability*100/STABILITY_LEVELS);
 	}
 	else
 	{
 	    PIPE[pipe].freqStability = 0;
    		PIPE[pipe].tempStability = 0;
+		PIPE[pipe].freqDetector.reset();
+		PIPE[pipe].tempDetector.reset();
 
 		updatePipeStability(F_BAR, pipe, 0);
 		updatePipeStability(T_BAR, pipe, 0);
 	}
 
-    /// get frequency
-    PIPE[pipe].frequency = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_FREQ, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
+    /// frequency
+	if ((LOOP.runMode == TEMP_RUN_MODE) && !isModbusTransmissionFailed) PIPE[pipe].freqSettling.addSample(PIPE[pipe].etimer->elapsed()/1000.0, PIPE[pipe].frequency);
 
 	if (isStability)
 	{
 		/// check freq stability
-		if (PIPE[pipe].freqStability < 5) 
+		if (PIPE[pipe].freqStability < STABILITY_LEVELS) 
 		{
-       		if (abs(PIPE[pipe].frequency - PIPE[pipe].frequency_prev) <= LOOP.yFreq) PIPE[pipe].freqStability++;
-			else PIPE[pipe].freqStability = 0;
+			PIPE[pipe].freqDetector.setCriteria(stabilityCriteria(F_BAR));
+			if (!isModbusTransmissionFailed) PIPE[pipe].freqDetector.addSample(PIPE[pipe].frequency);
+			PIPE[pipe].freqStability = PIPE[pipe].freqDetector.level(STABILITY_LEVELS);
+			if (LOOP.isPredictiveSettling && isSettled(PIPE[pipe].freqSettling, PIPE[pipe].freqDetector)) PIPE[pipe].freqStability = STABILITY_LEVELS;
 
        		PIPE[pipe].frequency_prev = PIPE[pipe].frequency;
 		}
-		else PIPE[pipe].freqStability = 5;
+		else PIPE[pipe].freqStability = STABILITY_LEVELS;
 
-    	if (!isModbusTransmissionFailed) updatePipeStability(F_BAR, pipe, PIPE[pipe].freqStability*20);
+    	if (!isModbusTransmissionFailed) updatePipeStability(F_BAR, pipe, PIPE[pipe].freqStability*100/STABILITY_LEVELS);
 	}
 	else
 	{
 	    PIPE[pipe].freqStability = 0;
    		PIPE[pipe].tempStability = 0;
+		PIPE[pipe].freqDetector.reset();
+		PIPE[pipe].tempDetector.reset();
 
 		updatePipeStability(F_BAR, pipe, 0);
 		updatePipeStability(T_BAR, pipe, 0);
 	}
 
-    /// get oil_rp 
-    PIPE[pipe].oilrp = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_OIL_RP, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-
-    /// get measured ai
-    PIPE[pipe].measai = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, RAZ_MEAS_AI, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-
-    /// get trimmed ai
-    PIPE[pipe].trimai = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, RAZ_TRIM_AI, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
+    /// settling estimate
+	if (LOOP.runMode == TEMP_RUN_MODE)
+	{
+		updateSettlingEta(T_BAR, pipe);
+		updateSettlingEta(F_BAR, pipe);
+	}
 
     /// update pipe reading
 	if (PIPE[pipe].status == ENABLED) updatePipeStatus(pipe, LOOP.watercut, PIPE[pipe].frequency_start, PIPE[pipe].frequency, PIPE[pipe].temperature, PIPE[pipe].oilrp);
+	if ((PIPE[pipe].status == ENABLED) && !isModbusTransmissionFailed) updateGauges(pipe);
+	publishMetrics();
 }
 
 
@@ -3026,81 +4519,34 @@ void
 MainWindow::
 readMasterPipe()
 {
-    uint8_t dest[1024];
-    uint16_t * dest16 = (uint16_t *) dest;
-    int ret = -1;
-    bool is16Bit = false;
-    bool writeAccess = false;
-    const QString funcType = descriptiveDataTypeName( FUNC_READ_FLOAT );
-	double val = 0;
-
-    /// reset connection
-    memset( dest, 0, 1024 );
-    modbus_set_slave( LOOP.serialModbus, CONTROLBOX_SLAVE);
- 
-    /// get watercut
-    val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_WATERCUT, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterWatercut = val;	
-		ui->lineEdit_20->setText(QString::number(val));
-	}
-
-	/// get salinity
-    val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_SALINITY, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterSalinity = val;
-		ui->lineEdit_22->setText(QString::number(val));
-	}
-
-	/// get oil adjust 
-    val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_OIL_ADJUST, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterOilAdj = val;
-		ui->lineEdit_21->setText(QString::number(val));
-	}
-   
-	/// master oil rp 
-	val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_OIL_RP, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterOilRp = val;
-	}
+	double values[device::MASTER_FIELDS];
 
-	/// master temp
-	val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_TEMPERATURE, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterTemp = val;
-		ui->lineEdit_29->setText(QString::number(val));
-	}
-
-	/// master freq
-	val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_FREQ, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
+	/// the master pipe is always an EEA
+	isModbusTransmissionFailed = !device::read<device::Eea::Master>(LOOP.serialModbus, CONTROLBOX_SLAVE, false, values);
+	if (isModbusTransmissionFailed) 
 	{
-		LOOP.masterFreq = val;
-		ui->lineEdit_30->setText(QString::number(val));
+		publishMetrics();
+		return;
 	}
 
-	/// master phase
-	val = sendCalibrationRequest(FLOAT_R, LOOP.serialModbus, FUNC_READ_FLOAT, LOOP.ID_MASTER_PHASE, BYTE_READ_FLOAT, ret, dest, dest16, is16Bit, writeAccess, funcType);
-	//delay(SLEEP_TIME);
-	if (!isModbusTransmissionFailed) 
-	{
-		LOOP.masterPhase = val;
-		if (LOOP.masterPhase == PHASE_OIL ) ui->lineEdit_31->setText("OIL PHASE");
-		else if (LOOP.masterPhase == PHASE_WATER) ui->lineEdit_31->setText("WATER PHASE");
-		else ui->lineEdit_31->setText("ERROR");
-	}
+	LOOP.masterWatercut = values[device::MasterWatercut];
+	LOOP.masterSalinity = values[device::MasterSalinity];
+	LOOP.masterOilAdj = values[device::MasterOilAdjust];
+	LOOP.masterOilRp = values[device::MasterOilRp];
+	LOOP.masterTemp = values[device::MasterTemperature];
+	LOOP.masterFreq = values[device::MasterFrequency];
+	LOOP.masterPhase = values[device::MasterPhase];
+
+	ui->lineEdit_20->setText(QString::number(LOOP.masterWatercut));
+	ui->lineEdit_22->setText(QString::number(LOOP.masterSalinity));
+	ui->lineEdit_21->setText(QString::number(LOOP.masterOilAdj));
+	ui->lineEdit_29->setText(QString::number(LOOP.masterTemp));
+	ui->lineEdit_30->setText(QString::number(LOOP.masterFreq));
+	if (LOOP.masterPhase == PHASE_OIL ) ui->lineEdit_31->setText("OIL PHASE");
+	else if (LOOP.masterPhase == PHASE_WATER) ui->lineEdit_31->setText("WATER PHASE");
+	else ui->lineEdit_31->setText("ERROR");
+
+	publishMetrics();
 }
 
 
@@ -3119,6 +4565,9 @@ runTempRun()
        		(QFileInfo(PIPE[1].file).fileName() == QString("AMB").append("_").append(QString::number(LOOP.minRefTemp)).append(LOOP.filExt)) ||
        		(QFileInfo(PIPE[2].file).fileName() == QString("AMB").append("_").append(QString::number(LOOP.minRefTemp)).append(LOOP.filExt)))
    		{
+			LOOP.stabilityPhase = STABILITY_AMB;
+			logPhaseChange();
+
 			if (LOOP.isAMB)
 			{
 				LOOP.isAMB = false;
@@ -3126,6 +4575,7 @@ runTempRun()
 
 				/// popup questions 
    				LOOP.operatorName = QInputDialog::getText(this, QString("LOOP ")+QString::number(LOOP.loopNumber)+QString(" "),tr(qPrintable("Enter Operator's Name.")), QLineEdit::Normal," ", &ok);
+				for (int pipe = 0; pipe < 3; pipe++) m_runCatalog.setOperator(PIPE[pipe].runId, LOOP.operatorName.trimmed());
    				LOOP.oilRunStart->setText(QInputDialog::getText(this, QString("LOOP ")+QString::number(LOOP.loopNumber)+QString(" "),tr(qPrintable("Enter Measured Initial Watercut.")), QLineEdit::Normal,"0.0", &ok));
 				LOOP.watercut = LOOP.oilRunStart->text().toDouble();
    				if (!isUserInputYes(QString("LOOP ")+QString::number(LOOP.loopNumber),"Fill The Water Container To The Mark."))
@@ -3183,7 +4633,7 @@ runTempRun()
 			for (int pipe = 0; pipe < 3; pipe++)
 			{
 	    		/// validate stability 
-           		if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != 5) || (PIPE[pipe].freqStability != 5)))
+           		if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != STABILITY_LEVELS) || (PIPE[pipe].freqStability != STABILITY_LEVELS)))
            		{
 					/// read data
 					if (abs(LOOP.minRefTemp - PIPE[pipe].temperature) < 2.0) readPipe(pipe, STABILITY_CHECK); 
@@ -3207,6 +4657,9 @@ runTempRun()
       			 (QFileInfo(PIPE[1].file).fileName() == QString::number(LOOP.minRefTemp).append("_").append(QString::number(LOOP.maxRefTemp)).append(LOOP.filExt)) ||
        			 (QFileInfo(PIPE[2].file).fileName() == QString::number(LOOP.minRefTemp).append("_").append(QString::number(LOOP.maxRefTemp)).append(LOOP.filExt)))
    	 	{
+			LOOP.stabilityPhase = STABILITY_MIN_REF;
+			logPhaseChange();
+
 			if (LOOP.isMinRef)
 			{
 				LOOP.isMinRef = false;
@@ -3230,7 +4683,7 @@ runTempRun()
 
 			for (int pipe = 0; pipe < 3; pipe++)
 			{
-           		if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != 5) || (PIPE[pipe].freqStability != 5)))
+           		if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != STABILITY_LEVELS) || (PIPE[pipe].freqStability != STABILITY_LEVELS)))
            		{
 					/// read data
 					(abs(LOOP.maxRefTemp - PIPE[pipe].temperature) < 2.0) ? readPipe(pipe, STABILITY_CHECK) : readPipe(pipe, NO_STABILITY_CHECK);
@@ -3254,6 +4707,9 @@ runTempRun()
        		 	(QFileInfo(PIPE[1].file).fileName() == QString::number(LOOP.maxRefTemp).append("_").append(QString::number(LOOP.injectionTemp)).append(LOOP.filExt)) ||
        		 	(QFileInfo(PIPE[2].file).fileName() == QString::number(LOOP.maxRefTemp).append("_").append(QString::number(LOOP.injectionTemp)).append(LOOP.filExt)))
        	{
+			LOOP.stabilityPhase = STABILITY_MAX_REF;
+			logPhaseChange();
+
 			if (LOOP.isMaxRef)
 			{
 				LOOP.isMaxRef = false;
@@ -3277,7 +4733,7 @@ runTempRun()
 
 			for (int pipe = 0; pipe < 3; pipe++)
 			{
-				if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != 5) || (PIPE[pipe].freqStability != 5)))
+				if ((PIPE[pipe].status == ENABLED) && PIPE[pipe].checkBox->isChecked() && ((PIPE[pipe].tempStability != STABILITY_LEVELS) || (PIPE[pipe].freqStability != STABILITY_LEVELS)))
        			{
 					/// read data
 					(abs(LOOP.injectionTemp - PIPE[pipe].temperature) < 2.0) ? readPipe(pipe, STABILITY_CHECK) : readPipe(pipe, NO_STABILITY_CHECK);
@@ -3302,6 +4758,7 @@ runTempRun()
 							if ((PIPE[0].status != ENABLED) && (PIPE[1].status != ENABLED) && (PIPE[2].status != ENABLED)) 
 							{
 								LOOP.runMode = INJECTION_MODE;
+								logPhaseChange();
 								return;
 							}
 						}
@@ -3378,8 +4835,8 @@ runInjection()
 				{
 					/// read data
 					readPipe(pipe, NO_STABILITY_CHECK);
-					if (LOOP.isMaster) data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.masterWatercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(0,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
-					else data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.watercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(0,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
+					if (LOOP.isMaster) data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.masterWatercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(totalInjectionTime,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
+					else data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.watercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(totalInjectionTime,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
 
 					/// write to calibration file
            			writeToCalFile(pipe, data_stream);
@@ -3398,13 +4855,19 @@ runInjection()
 			///////////////////////////////////////
 			if (LOOP.isMaster)
 			{
-				int masterInjectionStartTime = PIPE[0].etimer->elapsed()/1000;
+				double masterInjectionTime = 0;
 				
 				/// start injection	upon master pipe phase
 				if (LOOP.masterPhase == PHASE_OIL) 
 				{
-					inject(COIL_WATER_PUMP,true);
 					LOOP.oilPhaseInjectCounter = 0;
+					if (!injectToMasterWatercut(LOOP.watercut, masterInjectionTime, true))
+					{
+						/// what went in stays booked, the set point is not advanced
+						totalInjectionVolume += masterInjectionTime*LOOP.injectionWaterPumpRate/60;
+						totalInjectionTime += masterInjectionTime;
+						return;
+					}
 				}
 				else 
 				{
@@ -3418,30 +4881,8 @@ runInjection()
 					}
 				}
 
-				while (LOOP.masterWatercut < LOOP.watercut)
-				{
-					int masterInjectionTime = PIPE[0].etimer->elapsed()/1000;
-
-					/// validate injection time
-					if ((masterInjectionTime - masterInjectionStartTime) > LOOP.maxInjectionWater)
-					{
-						/// stop water injection?
-   						if (!isUserInputYes(QString("Injection Time ")+QString::number(masterInjectionTime - masterInjectionStartTime)+QString(" Is Greater Than Max Water Injection Time ")+QString::number(LOOP.maxInjectionWater), "Do You Want To Continue?"))
-						{
-							inject(COIL_WATER_PUMP,false);
-							onActionStop();
-							return;
-						}
-					}
-
-					readMasterPipe();
-				}
-
-				/// stop water injection
-				inject(COIL_WATER_PUMP,false);
-				int masterInjectionEndTime = PIPE[0].etimer->elapsed()/1000;
-				totalInjectionVolume += (masterInjectionEndTime-masterInjectionStartTime)*LOOP.injectionWaterPumpRate/60;
-				totalInjectionTime += masterInjectionEndTime-masterInjectionStartTime;
+				totalInjectionVolume += masterInjectionTime*LOOP.injectionWaterPumpRate/60;
+				totalInjectionTime += masterInjectionTime;
 
 				/// set next watercut
 				(LOOP.mode == LOW) ? LOOP.watercut += LOOP.intervalSmallPump : LOOP.watercut += LOOP.intervalBigPump; 
@@ -3454,9 +4895,6 @@ runInjection()
 				/// next injection time and update totalInjectionTime
 				double accumulatedInjectionTime = -(LOOP.loopVolume->text().toDouble()/(LOOP.injectionWaterPumpRate/60))*log((1-(LOOP.watercut - LOOP.oilRunStart->text().toDouble())/100));
 				injectionTime = accumulatedInjectionTime - accumulatedInjectionTime_prev;
-				totalInjectionTime += injectionTime;
-				totalInjectionVolume = totalInjectionTime*LOOP.injectionWaterPumpRate/60;
-				accumulatedInjectionTime_prev = accumulatedInjectionTime;
 
 				/// validate injection time
 				if (injectionTime > LOOP.maxInjectionWater)
@@ -3469,10 +4907,13 @@ runInjection()
 					}
 				}
 
-				/// inject water to the pipe for "injectionTime" seconds
-				inject(COIL_WATER_PUMP,true);
-				delay(injectionTime*1000);
-				inject(COIL_WATER_PUMP,false);
+				/// inject water to the pipe for "injectionTime" seconds and book what was
+				/// actually delivered, the next step makes up for any difference
+				injectionTime = (injectionTime > 0) ? injectFor(COIL_WATER_PUMP, injectionTime) : 0;
+				if (injectionTime < 0) return; /// the pump was not released, injectFor() stopped the run
+				totalInjectionTime += injectionTime;
+				totalInjectionVolume = totalInjectionTime*LOOP.injectionWaterPumpRate/60;
+				accumulatedInjectionTime_prev += injectionTime;
 
 				/// set next watercut
 				(LOOP.mode == LOW) ? LOOP.watercut += LOOP.intervalSmallPump : LOOP.watercut += LOOP.intervalBigPump; 
@@ -3637,7 +5078,7 @@ runInjection()
 				else PIPE[pipe].rolloverTracker = 0;
 					
 				/// read data
-				data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.watercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(0,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
+				data_stream = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11 %12 %13 %14 %15 %16 %17 %18 %19 %20").arg(PIPE[pipe].etimer->elapsed()/1000, 9, 'g', -1, ' ').arg(LOOP.watercut,7,'f',2,' ').arg(PIPE[pipe].osc, 4, 'g', -1, ' ').arg(" INT").arg(1, 7, 'g', -1, ' ').arg(PIPE[pipe].frequency,9,'f',3,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].oilrp,9,'f',2,' ').arg(PIPE[pipe].temperature,11,'f',2,' ').arg(0,8,'f',2,' ').arg(PIPE[pipe].measai,12,'f',2,' ').arg(PIPE[pipe].trimai,12,'f',2,' ').arg(totalInjectionTime,10,'f',2,' ').arg(LOOP.masterTemp, 11,'f',2,' ').arg(LOOP.masterOilAdj, 11,'f',2,' ').arg(LOOP.masterFreq, 11,'f',2,' ').arg(LOOP.masterWatercut, 11,'f',2,' ').arg(LOOP.masterOilRp, 11,'f',2,' ').arg(LOOP.masterPhase, 6,'f',1,' ').arg(0,8,'f',2,' ');
 
    				/// create a new file if needed
   				if (!QFileInfo(PIPE[pipe].file).exists()) 
@@ -3653,29 +5094,18 @@ runInjection()
 
 		if (LOOP.isMaster)
 		{
-			int masterInjectionStartTime = PIPE[0].etimer->elapsed()/1000;
+			double masterInjectionTime = 0;
 
-			while (LOOP.masterWatercut < LOOP.watercut)
+			/// the master crosses into water phase during the rollover, that is no reason to stop
+			if (!injectToMasterWatercut(LOOP.watercut, masterInjectionTime, false))
 			{
-				int masterInjectionTime = PIPE[0].etimer->elapsed()/1000;
-
-				inject(COIL_WATER_PUMP,true);
-
-				/// validate injection time
-				if ((masterInjectionTime - masterInjectionStartTime) > LOOP.maxInjectionWater)
-				{
-					/// stop water injection
-					if (!isUserInputYes(QString("Injection Time")+QString::number(masterInjectionTime - masterInjectionStartTime)+QString(" Is Greater Than Max Water Injection Time ")+QString::number(LOOP.maxInjectionWater), "Do You Want To Continue?"))
-					{
-						inject(COIL_WATER_PUMP,false);
-						onActionStop();
-						return;
-					}
-				}
+				/// what went in stays booked, the set point is not advanced
+				totalInjectionVolume += masterInjectionTime*LOOP.injectionWaterPumpRate/60;
+				totalInjectionTime += masterInjectionTime;
+				return;
 			}
-
-			/// stop water injection
-			inject(COIL_WATER_PUMP,false);
+			totalInjectionVolume += masterInjectionTime*LOOP.injectionWaterPumpRate/60;
+			totalInjectionTime += masterInjectionTime;
 
 			/// set next watercut
 			LOOP.watercut += LOOP.intervalBigPump;
@@ -3685,9 +5115,6 @@ runInjection()
 			/// next injection time and update totalInjectionTime
 			double accumulatedInjectionTime = -(LOOP.loopVolume->text().toDouble()/(LOOP.injectionWaterPumpRate/60))*log((1-(LOOP.watercut - LOOP.oilRunStart->text().toDouble())/100));
 			injectionTime = accumulatedInjectionTime - accumulatedInjectionTime_prev;
-			totalInjectionTime += injectionTime;
-			totalInjectionVolume = totalInjectionTime*LOOP.injectionWaterPumpRate/60;
-			accumulatedInjectionTime_prev = accumulatedInjectionTime;
 
 			/// validate injection time
 			if (injectionTime > LOOP.maxInjectionWater)
@@ -3699,10 +5126,13 @@ runInjection()
 				}
 			}
 
-			/// inject water to the pipe for "injectionTime" seconds
-			inject(COIL_WATER_PUMP,true);
-			delay(injectionTime*1000);
-			inject(COIL_WATER_PUMP,false);
+			/// inject water to the pipe for "injectionTime" seconds and book what was
+			/// actually delivered, the next step makes up for any difference
+			injectionTime = (injectionTime > 0) ? injectFor(COIL_WATER_PUMP, injectionTime) : 0;
+			if (injectionTime < 0) return; /// the pump was not released, injectFor() stopped the run
+			totalInjectionTime += injectionTime;
+			totalInjectionVolume = totalInjectionTime*LOOP.injectionWaterPumpRate/60;
+			accumulatedInjectionTime_prev += injectionTime;
 
 			/// set next watercut
 			LOOP.watercut += LOOP.intervalBigPump;
@@ -3731,6 +5161,7 @@ runInjection()
 
 		/// finish calibration
 		LOOP.runMode = STOP_MODE;
+		logPhaseChange();
       	informUser(QString("LOOP ")+QString::number(LOOP.loopNumber),QString("                                    "),"Calibration has finished successfully.");
 		onActionStop();
    }
@@ -3752,6 +5183,105 @@ inject(const int coil,const bool value)
 }
 
 
+double
+MainWindow::
+injectFor(const int coil, const double seconds)
+{
+	/// returns the delivered injection time, -1 when the pump could not be released
+	const bool failed = (LOOP.injector.run(LOOP.serialModbus, CONTROLBOX_SLAVE, coil-ADDR_OFFSET, seconds) < 0);
+
+	QVariantMap fields;
+	fields["coil"] = coil;
+	fields["requested_s"] = seconds;
+	fields["delivered_s"] = LOOP.injector.delivered();
+	fields["latency_ms"] = LOOP.injector.latency();
+	fields["failed"] = failed;
+	m_eventLog.post("injection", fields);
+
+	if (failed)
+	{
+		/// a pump that may still be running ends the run, both pumps are commanded off once more
+		inject(COIL_WATER_PUMP, false);
+		inject(COIL_OIL_PUMP, false);
+		setStatusError(QString("Coil ")+QString::number(coil)+QString(" could not be released during injection"));
+		onActionStop();
+		informUser(QString("LOOP ")+QString::number(LOOP.loopNumber), QString("Pump did not stop"), QString("Coil ")+QString::number(coil)+QString(" could not be switched off. The calibration was stopped, make sure the pump is off before restarting."));
+		return -1;
+	}
+
+	return LOOP.injector.delivered();
+}
+
+
+/// with isOilPhaseOnly the pump stops once the master leaves the oil phase
+bool
+MainWindow::
+injectToMasterWatercut(const double target, double & injected, const bool isOilPhaseOnly)
+{
+	int result;
+
+	LOOP.masterTracker.setRegisters(device::Eea::Master::registers[device::MasterWatercut].address-ADDR_OFFSET, device::Eea::Master::registers[device::MasterPhase].address-ADDR_OFFSET);
+	LOOP.masterTracker.setPollInterval(LOOP.masterPollInterval);
+	LOOP.masterTracker.setOilPhase(PHASE_OIL);
+	LOOP.masterTracker.setPhaseChecked(isOilPhaseOnly);
+	injected = 0;
+
+	do
+	{
+		result = LOOP.masterTracker.run(LOOP.serialModbus, CONTROLBOX_SLAVE, COIL_WATER_PUMP-ADDR_OFFSET, target, LOOP.maxInjectionWater);
+		injected += LOOP.masterTracker.injected();
+
+		QVariantMap fields;
+		fields["target"] = target;
+		fields["injected_s"] = injected;
+		fields["result"] = result;
+		m_eventLog.post("master_injection", fields);
+
+		/// the pump is already off while the operator decides
+		if (result == MASTER_TRACK_TIMEOUT)
+		{
+			if (!isUserInputYes(QString("Injection Time ")+QString::number(injected)+QString(" Is Greater Than Max Water Injection Time ")+QString::number(LOOP.maxInjectionWater), "Do You Want To Continue?"))
+			{
+				onActionStop();
+				return false;
+			}
+		}
+	} while (result == MASTER_TRACK_TIMEOUT);
+
+	/// the target was not reached, the set point stays where it is
+	if (result == MASTER_TRACK_PHASE)
+	{
+		setStatusError("Master pipe left the oil phase during injection");
+		return false;
+	}
+
+	if ((result == MASTER_TRACK_BUS_ERROR) || (result == MASTER_TRACK_PUMP_ERROR))
+	{
+		inject(COIL_WATER_PUMP, false);
+		setStatusError((result == MASTER_TRACK_PUMP_ERROR) ? "Water pump did not take the command" : "Master pipe is not responding");
+		onActionStop();
+		informUser(QString("LOOP ")+QString::number(LOOP.loopNumber), QString("Master pipe injection failed"), (result == MASTER_TRACK_PUMP_ERROR) ? QString("The water pump coil could not be written. The calibration was stopped, make sure the pump is off before restarting.") : QString("The master pipe stopped answering. The calibration was stopped."));
+		return false;
+	}
+
+	return true;
+}
+
+
+void
+MainWindow::
+onMasterPipeSampled(double watercut, double phase)
+{
+	LOOP.masterWatercut = watercut;
+	LOOP.masterPhase = phase;
+
+	ui->lineEdit_20->setText(QString::number(watercut));
+	if (LOOP.masterPhase == PHASE_OIL ) ui->lineEdit_31->setText("OIL PHASE");
+	else if (LOOP.masterPhase == PHASE_WATER) ui->lineEdit_31->setText("WATER PHASE");
+	else ui->lineEdit_31->setText("ERROR");
+}
+
+
 void
 MainWindow::
 prepareForNextFile(const int pipe, const QString nextFileId)
@@ -3759,9 +5289,15 @@ prepareForNextFile(const int pipe, const QString nextFileId)
     PIPE[pipe].file.setFileName(PIPE[pipe].mainDirPath+"\\"+nextFileId);
     PIPE[pipe].freqStability = 0;
     PIPE[pipe].tempStability = 0;
+    PIPE[pipe].freqDetector.reset();
+    PIPE[pipe].tempDetector.reset();
+    PIPE[pipe].freqSettling.reset();
+    PIPE[pipe].tempSettling.reset();
 
     updatePipeStability(F_BAR, pipe, 0);
     updatePipeStability(T_BAR, pipe, 0);
+    updateSettlingEta(F_BAR, pipe);
+    updateSettlingEta(T_BAR, pipe);
 }
 
 
@@ -3942,46 +5478,14 @@ void
 MainWindow::
 onUpdateRegisters(const bool isEEA)
 {
-    if (isEEA)
-    {
-        LOOP.ID_SN_PIPE = 1;
-        LOOP.ID_WATERCUT = 11;
-        LOOP.ID_SALINITY = 21;
-        LOOP.ID_OIL_ADJUST = 23;
-        LOOP.ID_TEMPERATURE = 15;
-        LOOP.ID_WATER_ADJUST = 25;
-        LOOP.ID_FREQ = 111;
-        LOOP.ID_OIL_RP = 115;
-    }
-    else
-    {
-        LOOP.ID_SN_PIPE = 201;
-        LOOP.ID_WATERCUT = 3;
-        LOOP.ID_TEMPERATURE = 33; /// REG_TEMP_USER
-        LOOP.ID_SALINITY = 9;
-        LOOP.ID_OIL_ADJUST = 15;
-        LOOP.ID_WATER_ADJUST = 17;
-        LOOP.ID_FREQ = 19;
-        LOOP.ID_OIL_RP = 61;
-    }
-
-	/// master pipe EEA
-	LOOP.ID_MASTER_WATERCUT = 29;
-	LOOP.ID_MASTER_TEMPERATURE = 15; 
-	LOOP.ID_MASTER_SALINITY = 21;
-	LOOP.ID_MASTER_OIL_ADJUST = 23;
-	LOOP.ID_MASTER_OIL_RP = 115; 
-	LOOP.ID_MASTER_FREQ = 111; 
-	LOOP.ID_MASTER_PHASE = 17; 
-/*
-	/// master pipe RAZOR
-	LOOP.ID_MASTER_WATERCUT = 3;
-	LOOP.ID_MASTER_TEMPERATURE = 33; 
-	LOOP.ID_MASTER_SALINITY = 9;
-	LOOP.ID_MASTER_OIL_ADJUST = 15;
-	LOOP.ID_MASTER_OIL_RP = 61; 
-	LOOP.ID_MASTER_FREQ = 19; 
-*/
+	const device::Identity & identity = isEEA ? device::Eea::identity : device::Razor::identity;
+
+	LOOP.ID_SN_PIPE = identity.serialNumber;
+	LOOP.ID_WATERCUT = identity.watercut;
+	LOOP.ID_SALINITY = identity.salinity;
+	LOOP.ID_OIL_ADJUST = identity.oilAdjust;
+	LOOP.ID_WATER_ADJUST = identity.waterAdjust;
+	LOOP.readPipeRegisters = isEEA ? device::read<device::Eea::Pipe> : device::read<device::Razor::Pipe>;
 }
 
 
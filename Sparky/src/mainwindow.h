@@ -4,6 +4,7 @@
 #include <QGroupBox>
 #include <QProgressBar>
 #include <QFuture>
+#include <QFutureWatcher>
 #include <QLineEdit>
 #include <QComboBox>
 #include <QLCDNumber>
@@ -19,10 +20,32 @@
 #include <QtCharts/QValueAxis>
 #include <QtCharts/QCategoryAxis>
 #include <QProgressDialog>
+#include <QTableWidget>
+#include <QLabel>
 #include "modbus.h"
 #include "ui_about.h"
 #include "modbus-rtu.h"
 #include "modbus.h"
+#include "stability.h"
+#include "settling.h"
+#include "curvefit.h"
+#include "injectioncontroller.h"
+#include "masterpipetracker.h"
+#include "qcgaugewidget.h"
+#include "busstatistics.h"
+#include "metricsserver.h"
+#include "eventlog.h"
+#include "spoolreplicator.h"
+#include "runcatalog.h"
+#include "legacyimporter.h"
+#include "batchfit.h"
+#include "busscanner.h"
+#include "linktuner.h"
+#include "transportmanager.h"
+#include "devicecache.h"
+#include "settings.h"
+#include "deviceprofile.h"
+#include "qextserialenumerator.h"
 
 #define RELEASE_VERSION             "0.0.8"
 #define RAZ                         0 
@@ -35,6 +58,9 @@
 #define PHASE_WATER					1
 #define PHASE_ERROR					2
 
+/// transport of the serial loop in the transport manager
+#define SERIAL_LOOP_TRANSPORT		0
+
 /// sub system	
 #define CONTROLBOX_SLAVE 	        100
 #define MODBUS_TIMER_SLAVE 			101
@@ -81,42 +107,10 @@
 #define EEA_INJECTION_FILE          "EEA INJECTION FILE"
 #define RAZ_INJECTION_FILE          "RAZOR INJECTION FILE"
 
-#define MAIN_SERVER                 "MainServer"
-#define LOCAL_SERVER                "LocalServer"
-
 #define TEMP_RUN_MODE				0
 #define INJECTION_MODE				1	
 #define STOP_MODE					-1	
 
-//////////////////////////
-/////// JSON KEYS ////////
-//////////////////////////
-
-#define LOOP_OIL_PUMP_RATE            "LOOP.OilPumpRate"
-#define LOOP_WATER_PUMP_RATE          "LOOP.WaterPumpRate"
-#define LOOP_SMALL_WATER_PUMP_RATE    "LOOP.SmallWaterPumpRate"
-#define LOOP_BUCKET                   "LOOP.Bucket"
-#define LOOP_MARK                     "LOOP.Mark"
-#define LOOP_METHOD                   "LOOP.Method"
-#define LOOP_PRESSURE                 "LOOP.PresssureSensorSlope"
-#define LOOP_MIN_TEMP                 "LOOP.MinRefTemp"
-#define LOOP_MAX_TEMP                 "LOOP.MaxRefTemp"
-#define LOOP_INJECTION_TEMP           "LOOP.InjectionTemp"
-#define LOOP_X_DELAY                  "LOOP.XDelay"
-#define LOOP_Y_FREQ                   "LOOP.YFreq"
-#define LOOP_Z_TEMP                   "LOOP.ZTemp"
-#define LOOP_INTERVAL_SMALL_PUMP      "LOOP.IntervalSmallPump"
-#define LOOP_INTERVAL_BIG_PUMP  	  "LOOP.IntervalBigPump"
-#define LOOP_INTERVAL_OIL_PUMP  	  "LOOP.IntervalOilPump"
-#define LOOP_NUMBER  	  			  "LOOP.LoopNumber"
-#define LOOP_MASTER_MIN  			  "LOOP.MasterMin"
-#define LOOP_MASTER_MAX  			  "LOOP.MasterMax"
-#define LOOP_MASTER_DELTA  			  "LOOP.MasterDelta"
-#define LOOP_MASTER_DELTA_FINAL		  "LOOP.MasterDeltaFinal"
-#define LOOP_MAX_INJECTION_WATER   	  "LOOP.MaxInjectionWater"
-#define LOOP_MAX_INJECTION_OIL   	  "LOOP.MaxInjectionOil"
-#define LOOP_PORT_INDEX    	          "LOOP.PortIndex"
-
 #define FILE_LIST                   "Filelist.LST"
 
 #define TIMER_DELAY         6000
@@ -145,26 +139,6 @@
 #define COIL_W              5
 #define ADDR_OFFSET         1
 
-#define RAZ_SN              201 
-#define RAZ_WATERCUT        3
-#define RAZ_TEMPERATURE     5
-#define RAZ_SALINITY        9
-#define RAZ_FREQUENCY       19
-#define RAZ_OIL_INDEX       37
-#define RAZ_OIL_RP          61
-#define RAZ_OIL_DENSITY     155
-#define RAZ_MEAS_AI         173
-#define RAZ_TRIM_AI         175
-
-#define EEA_WATERCUT        40006
-#define EEA_TEMPERATURE     40051 //REG_TEMPERATURE_EXTERNAL
-#define EEA_SALINITY        40011
-#define EEA_FREQUENCY       400
-#define EEA_OIL_INDEX       37
-#define EEA_OIL_RP          61
-#define EEA_OIL_DENSITY     155
-
-
 QT_CHARTS_USE_NAMESPACE
 
 class AboutDialog : public QDialog, public Ui::AboutDialog
@@ -189,6 +163,8 @@ typedef struct PIPE_OBJECT
 	QString calFile;
     QString mainDirPath;
     QString localDirPath;
+    qint64 runId;           /// row of the run catalog, -1 when not running or not cataloged
+    bool isRunning;         /// set up by the running calibration
     QString pipeId;
     QFile file;
     QFile fileCalibrate;
@@ -216,7 +192,14 @@ typedef struct PIPE_OBJECT
     double measai;
     double trimai;
 
-	PIPE_OBJECT() : isStartFreq(true), osc(0), tempStability(0), freqStability(0), status(ENABLED), rolloverTracker(0), calFile(""),  mainDirPath(""), localDirPath(""), pipeId(""), file(""), fileCalibrate("CALIBRATE"), fileAdjusted("ADJUSTED"), fileRollover("ROLLOVER"), slave(new QLineEdit), series(new QSplineSeries), etimer(new QElapsedTimer), lineView(new QCheckBox), checkBox(new QCheckBox), watercut(new QLineEdit), startFreq(new QLineEdit), freq(new QLineEdit), temp(new QLineEdit), reflectedPower(new QLineEdit), freqProgress(new QProgressBar), tempProgress(new QProgressBar),temperature(0), frequency(0), temperature_prev(0), frequency_prev(0), frequency_start(0), oilrp(0), measai(0), trimai(0) {}
+	StabilityDetector tempDetector;
+	StabilityDetector freqDetector;
+	SettlingPredictor tempSettling;
+	SettlingPredictor freqSettling;
+	CurveFit watercutFit;
+	CurveFit tempFit;
+
+	PIPE_OBJECT() : isStartFreq(true), osc(0), tempStability(0), freqStability(0), status(ENABLED), rolloverTracker(0), calFile(""),  mainDirPath(""), localDirPath(""), runId(-1), isRunning(false), pipeId(""), file(""), fileCalibrate("CALIBRATE"), fileAdjusted("ADJUSTED"), fileRollover("ROLLOVER"), slave(new QLineEdit), series(new QSplineSeries), etimer(new QElapsedTimer), lineView(new QCheckBox), checkBox(new QCheckBox), watercut(new QLineEdit), startFreq(new QLineEdit), freq(new QLineEdit), temp(new QLineEdit), reflectedPower(new QLineEdit), freqProgress(new QProgressBar), tempProgress(new QProgressBar),temperature(0), frequency(0), temperature_prev(0), frequency_prev(0), frequency_start(0), oilrp(0), measai(0), trimai(0) {}
 
     //This is the destructor.  Will delete the array of vertices, if present.
     ~PIPE_OBJECT()
@@ -270,8 +253,28 @@ typedef struct LOOP_OBJECT
 	int maxInjectionWater;
 	int maxInjectionOil;
 	int portIndex;
+	QString portSerial; /// serial number of the usb adapter the loop is on
+	QStringList lowLatencyPorts; /// adapter serials or device names, "=rs485" for kernel rs485 mode
+	int linkBaudRegister; /// holding register the analyzers take their baud rate in, in hundreds, 0 when they can not be switched
+	QStringList linkBauds; /// "port=baud" of every tuned loop, port is an adapter serial or device name
+	int metricsPort; /// localhost port of the metrics endpoint, 0 disables it
+	QString eventLog; /// structured event log, relative to the application, empty disables it
+	QString runCatalog; /// sqlite run catalog, relative to the application, empty disables it
+	QString captureDir; /// raw bus traffic of each connection is recorded here, empty disables it
+	QString replayFile; /// capture served in place of the serial port, empty for a real rig
+	bool isReplayFast; /// replay without the recorded response delays
+	int masterPollInterval; /// ms between master pipe polls while injecting
     double yFreq;
     double zTemp;
+	int stabilityPhase;
+	bool isPredictiveSettling; /// end a temp step once the fitted residual is in tolerance
+	double stabilityEwmaAlpha;
+	StabilityCriteria tempCriteria[STABILITY_PHASES]; /// 0 limits follow zTemp
+	StabilityCriteria freqCriteria[STABILITY_PHASES]; /// 0 limits follow yFreq
+	int fitCurveDegree; /// watercut over frequency, fitted per pipe while injecting
+	int fitTempDegree; /// frequency over temperature, fitted per pipe during temp runs
+	int fitCurveRegister; /// equation address the curve is uploaded to, 0 offers no upload
+	int fitTempRegister; /// same for the temperature fit
 	double intervalOilPump;
 	double intervalBigPump;
 	double intervalSmallPump;
@@ -285,19 +288,10 @@ typedef struct LOOP_OBJECT
 	/// register address for calibration
     int ID_SN_PIPE;
     int ID_WATERCUT;
-    int ID_TEMPERATURE;
     int ID_SALINITY;
     int ID_OIL_ADJUST;
     int ID_WATER_ADJUST;
-    int ID_FREQ;
-    int ID_OIL_RP;
-    int ID_MASTER_WATERCUT;
-    int ID_MASTER_SALINITY;
-    int ID_MASTER_OIL_ADJUST;
-    int ID_MASTER_OIL_RP;
-    int ID_MASTER_TEMPERATURE;
-    int ID_MASTER_FREQ;
-    int ID_MASTER_PHASE;
+    device::Reader readPipeRegisters;
 	
     QLineEdit * loopVolume;
 	QComboBox * saltStart;
@@ -317,13 +311,15 @@ typedef struct LOOP_OBJECT
 
 	modbus_t * modbus;
     modbus_t * serialModbus;
+	InjectionController injector;
+	MasterPipeTracker masterTracker;
     QChart * chart;
     QChartView * chartView;
     QValueAxis * axisX;
     QValueAxis * axisY;
     QValueAxis * axisY3;
 
-	LOOP_OBJECT() : isMaster(false), isCal(false), isEEA(0), isAMB(1), isMinRef(1), isMaxRef(1), isInjection(1), mode(""), masterMin(0), masterMax(0),masterDelta(0), masterDeltaFinal(0), watercut(0), injectionOilPumpRate(0), injectionWaterPumpRate(0), injectionSmallWaterPumpRate(0), injectionBucket(0), injectionMark(0), injectionMethod(0), pressureSensorSlope(0), minRefTemp(0), maxRefTemp(0), runMode(0), injectionTemp(0), oilPhaseInjectCounter(0), xDelay(0), loopNumber(0), maxInjectionWater(80), maxInjectionOil(200), portIndex(0), yFreq(0), zTemp(0), intervalOilPump(0.25), intervalBigPump(1), intervalSmallPump(0.25), filExt(""), calExt(""), adjExt(""), rolExt(""), operatorName(""), ID_SN_PIPE(0), ID_WATERCUT(0), ID_TEMPERATURE(0), ID_SALINITY(0), ID_OIL_ADJUST(0), ID_WATER_ADJUST(0), ID_FREQ(0), ID_OIL_RP(0), ID_MASTER_WATERCUT(15), ID_MASTER_SALINITY(21), ID_MASTER_OIL_ADJUST(23), ID_MASTER_OIL_RP(115), ID_MASTER_TEMPERATURE(5),ID_MASTER_FREQ(111),ID_MASTER_PHASE(17),   loopVolume(new QLineEdit), saltStart(new QComboBox), saltStop(new QComboBox), oilTemp(new QComboBox), waterRunStart(new QLineEdit), waterRunStop(new QLineEdit), oilRunStart(new QLineEdit), oilRunStop(new QLineEdit), masterWatercut(0), masterSalinity(0), masterOilAdj(0), masterOilRp(0), masterFreq(0), masterTemp(0), masterPhase(1), modbus(NULL), serialModbus(NULL), chart(new QChart), chartView(new QChartView), axisX(new QValueAxis), axisY(new QValueAxis), axisY3(new QValueAxis) {};
+	LOOP_OBJECT() : isMaster(false), isCal(false), isEEA(0), isAMB(1), isMinRef(1), isMaxRef(1), isInjection(1), mode(""), masterMin(0), masterMax(0),masterDelta(0), masterDeltaFinal(0), watercut(0), injectionOilPumpRate(0), injectionWaterPumpRate(0), injectionSmallWaterPumpRate(0), injectionBucket(0), injectionMark(0), injectionMethod(0), pressureSensorSlope(0), minRefTemp(0), maxRefTemp(0), runMode(0), injectionTemp(0), oilPhaseInjectCounter(0), xDelay(0), loopNumber(0), maxInjectionWater(80), maxInjectionOil(200), portIndex(0), linkBaudRegister(0), metricsPort(0), eventLog("events.jsonl"), runCatalog("runs.sqlite"), captureDir(""), replayFile(""), isReplayFast(false), masterPollInterval(500), yFreq(0), zTemp(0), stabilityPhase(STABILITY_AMB), isPredictiveSettling(false), stabilityEwmaAlpha(0.3), fitCurveDegree(3), fitTempDegree(2), fitCurveRegister(0), fitTempRegister(0), intervalOilPump(0.25), intervalBigPump(1), intervalSmallPump(0.25), filExt(""), calExt(""), adjExt(""), rolExt(""), operatorName(""), ID_SN_PIPE(0), ID_WATERCUT(0), ID_SALINITY(0), ID_OIL_ADJUST(0), ID_WATER_ADJUST(0), readPipeRegisters(device::read<device::Eea::Pipe>), loopVolume(new QLineEdit), saltStart(new QComboBox), saltStop(new QComboBox), oilTemp(new QComboBox), waterRunStart(new QLineEdit), waterRunStop(new QLineEdit), oilRunStart(new QLineEdit), oilRunStop(new QLineEdit), masterWatercut(0), masterSalinity(0), masterOilAdj(0), masterOilRp(0), masterFreq(0), masterTemp(0), masterPhase(1), modbus(NULL), serialModbus(NULL), chart(new QChart), chartView(new QChartView), axisX(new QValueAxis), axisY(new QValueAxis), axisY3(new QValueAxis) {};
 
 	~LOOP_OBJECT()
 	{
@@ -366,6 +362,7 @@ public:
     modbus_t*  modbus_6() { return LOOP.serialModbus; }
 
     int setupModbusPort();
+    int attachSerialPorts();
     int setupModbusPort_2();
     int setupModbusPort_3();
     int setupModbusPort_4();
@@ -376,7 +373,11 @@ public:
 	void readMasterPipe();
 	void updateLoopStatus(const double, const double, const double, const double);
 	void readPipe(const int, const bool);
+	StabilityCriteria stabilityCriteria(const bool) const;
+	void updateSettlingEta(const bool, const int);
 	void inject(const int, const bool);
+	double injectFor(const int, const double);
+	bool injectToMasterWatercut(const double, double &, const bool);
 	void setProductAndCalibrationMode();
     void masterPipe(int, QString, bool);
     void prepareForNextFile(const int, const QString);
@@ -384,6 +385,8 @@ public:
     void closeCalibrationFile(int, int, double);
     void changeModbusInterface(const QString &port, char parity);
     void releaseSerialModbus();
+    bool isBusBusy() const;
+    void lockBus(const bool);
 	void setValidators();
     void initializeGraph();
     void initializePipeObjects();
@@ -392,8 +395,8 @@ public:
     bool validateSerialNumber(modbus_t *);   
     void updatePipeStatus(const int, const double, const double, const double, const double, const double); 
     bool informUser(const QString, const QString, const QString);
-    void busMonitorAddItem( bool isRequest,uint16_t slave,uint8_t func,uint16_t addr,uint16_t nb,uint16_t expectedCRC,uint16_t actualCRC );
-    static void stBusMonitorAddItem( modbus_t * modbus,uint8_t isOut, uint16_t slave, uint8_t func, uint16_t addr,uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC );
+    void busMonitorAddItem( bool isRequest,uint32_t slave,uint8_t func,uint16_t addr,uint16_t nb,uint16_t expectedCRC,uint16_t actualCRC );
+    static void stBusMonitorAddItem( modbus_t * modbus,uint8_t isOut, uint32_t slave, uint8_t func, uint16_t addr,uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC );
     static void stBusMonitorRawData( modbus_t * modbus, uint8_t * data,uint8_t dataLen, uint8_t addNewline );
     void busMonitorRawData( uint8_t * data, uint8_t dataLen, bool addNewline );
     void connectSerialPort();
@@ -420,9 +423,51 @@ public:
     double sendCalibrationRequest(int, modbus_t *, int, int, int, int, uint8_t *, uint16_t *, bool, bool, QString);
     void updateChart(QGridLayout *, QChartView *, QChart *, QSplineSeries *, double, double, double, double, double, double, double, double);
     void updateLineView();
+    void initializeGauges();
+    QcGaugeWidget * createGauge(const QString &, const float, const float, QcNeedleItem *&);
+    void updateGauges(const int);
+    int lowLatencyMode(const QString &) const;
+    int linkBaud(const QextPortInfo &) const;
+    void startCapture();
+    void initializeDiagnostics();
+    void initializeMetrics();
+    void publishMetrics();
+    void initializeEventLog();
+    void logPhaseChange();
+    void initializeSpool();
+    bool isRunDirectoryTaken(const QString &);
+    void initializeRunCatalog();
+    QString runDirectory(const QString &, const int) const;
+    QString phaseName() const;
+    void updateFitView(const int);
+    void prepareFitUpload();
+    void addEquationRow(const QString &, const int, const QVector<double> &);
+    Settings currentSettings() const;
+    void applySettings(const Settings &);
+    void applyPendingSettings();
+    void applyLiveSettings();
+    static void stBusMonitorTransaction( modbus_t * modbus, const modbus_transaction_t * transaction );
 
 private slots:
 
+	void onMasterPipeSampled(double, double);
+	void onSettingsChanged(const Settings &);
+	void onSettingsRejected(const QString &);
+	void onSerialPortsEnumerated();
+	void onSerialPortDiscovered(const QextPortInfo &);
+	void onSerialPortRemoved(const QextPortInfo &);
+	void updateDiagnostics();
+	void onExportDiagnostics();
+	void onResetDiagnostics();
+	void onRunHistory();
+	void onImportLegacyFiles();
+	void onLegacyFilesImported();
+	void onRefitArchive();
+	void onArchiveRefitted();
+	void onDiscoverDevices();
+	void onDevicesDiscovered();
+	void onTuneLink();
+	void onLinkTuned();
 	void toggleLineView_P1(bool); 
     void toggleLineView_P2(bool); 
     void toggleLineView_P3(bool); 
@@ -520,6 +565,9 @@ private:
 
 	/// connection
     modbus_t * m_modbus_snipping;
+    QextSerialEnumerator * m_portEnumerator;
+    QList<QextPortInfo> m_ports;
+    QFutureWatcher< QList<QextPortInfo> > m_portScan;
     QIntValidator *serialNumberValidator;
     QWidget * m_statusInd;
     QLabel * m_statusText;
@@ -529,6 +577,65 @@ private:
     bool m_poll;
 	bool isModbusTransmissionFailed;
 
+	/// bus diagnostics
+	BusStatistics m_busStatistics;
+	QTableWidget * m_diagnosticsTable;
+	QLabel * m_dutyCycle;
+
+	/// metrics endpoint
+	MetricsServer * m_metricsServer;
+	QThread * m_metricsThread;
+	QElapsedTimer m_phaseClock;
+	int m_metricsPhase;
+
+	/// structured event log
+	EventLog m_eventLog;
+	int m_loggedRunMode;
+	int m_loggedStabilityPhase;
+
+	/// local spool of the run files, mirrored to m_mainServer
+	SpoolReplicator m_spool;
+
+	/// every run of this station
+	RunCatalog m_runCatalog;
+	QString m_runCatalogPath;
+
+	/// archives read back by the legacy importer, one summary per file
+	QFutureWatcher<LegacySummary> m_legacyImport;
+	QElapsedTimer m_legacyClock;
+
+	/// batch re-fit of an archive, results go to m_refitOutput
+	QFutureWatcher<BatchFit::Result> m_refit;
+	QElapsedTimer m_refitClock;
+	QString m_refitOutput;
+	int m_refitTerms;
+
+	/// device name of the open serial loop, the port of its cached identities
+	QString m_serialPort;
+
+	/// auto discovery of the analyzers on the serial loop
+	BusScanner m_busScanner;
+	QFutureWatcher< QList<BusDevice> > m_discovery;
+
+	/// adapters plugged (true) or pulled while a worker had the bus, in order
+	QList< QPair<bool, QextPortInfo> > m_deferredPorts;
+
+	/// baud rate negotiation of the serial loop
+	LinkTuner m_linkTuner;
+	QFutureWatcher<LinkResult> m_linkTuning;
+
+	/// sparky.json, hand edits wait here for the end of a cycle
+	SettingsFile * m_settingsFile;
+	Settings m_pendingSettings;
+	bool m_isSettingsPending;
+	bool m_isLivePending;       /// the keys safe during a run are not applied yet
+
+	/// process gauges
+	QcGaugeWidget * m_temperatureGauge;
+	QcNeedleItem * m_temperatureNeedle;
+	QcGaugeWidget * m_RPGauge;
+	QcNeedleItem * m_RPNeedle;
+
 	/// loop objects
 	LOOPS LOOP;
 
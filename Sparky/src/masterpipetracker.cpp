@@ -0,0 +1,196 @@
+#include "masterpipetracker.h"
+#include "deviceprofile.h"
+
+/// weight of older samples in the watercut ramp fit
+#define FORGETTING          0.8
+
+/// samples needed before the fit is trusted to schedule the stop
+#define MIN_FIT_SAMPLES     3
+
+/// consecutive failed polls before the injection is abandoned
+#define MAX_FAILURES        3
+
+/// attempts to release the pump coil
+#define OFF_RETRIES         3
+
+
+MasterPipeTracker::
+MasterPipeTracker(QObject * parent) :
+    QObject(parent),
+    m_ctx(NULL),
+    m_slave(0),
+    m_coil(0),
+    m_watercutReg(0),
+    m_phaseReg(0),
+    m_pollMs(500),
+    m_failures(0),
+    m_result(MASTER_TRACK_REACHED),
+    m_oilPhase(0),
+    m_isPhaseChecked(true),
+    m_target(0),
+    m_maxSeconds(0),
+    m_watercut(0),
+    m_phase(0),
+    m_injected(0),
+    m_samples(0),
+    m_sw(0),
+    m_st(0),
+    m_sy(0),
+    m_stt(0),
+    m_sty(0),
+    m_loop(NULL)
+{
+    m_pollTimer.setTimerType(Qt::PreciseTimer);
+    m_stopTimer.setTimerType(Qt::PreciseTimer);
+    m_stopTimer.setSingleShot(true);
+
+    connect(&m_pollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+    connect(&m_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
+}
+
+
+int
+MasterPipeTracker::
+run(modbus_t * ctx, const int slave, const int coil, const double target, const double maxSeconds)
+{
+    QEventLoop loop;
+
+    m_ctx = ctx;
+    m_slave = slave;
+    m_coil = coil;
+    m_target = target;
+    m_maxSeconds = maxSeconds;
+    m_failures = 0;
+    m_samples = 0;
+    m_injected = 0;
+    m_sw = m_st = m_sy = m_stt = m_sty = 0;
+    m_result = MASTER_TRACK_REACHED;
+    m_loop = &loop;
+
+    m_clock.start();
+    if (!setPump(true))
+    {
+        /// the request may still have reached the box
+        setPump(false);
+        m_loop = NULL;
+        m_result = MASTER_TRACK_PUMP_ERROR;
+        return m_result;
+    }
+
+    /// first sample right away, then at the poll rate
+    m_pollTimer.start(m_pollMs);
+    QTimer::singleShot(0, this, SLOT(poll()));
+    loop.exec();
+
+    return m_result;
+}
+
+
+bool
+MasterPipeTracker::
+readFloat(const int address, double & value)
+{
+    uint16_t reg[2];
+
+    modbus_set_slave(m_ctx, m_slave);
+    if (modbus_read_input_registers(m_ctx, address, 2, reg) != 2) return false;
+
+    /// high word first, as the control box sends it
+    value = device::Decoder<device::Float, device::HighWordFirst>::decode(reg);
+
+    return true;
+}
+
+
+bool
+MasterPipeTracker::
+setPump(const bool on)
+{
+    for (int i = 0; i < (on ? 1 : OFF_RETRIES); i++)
+    {
+        modbus_set_slave(m_ctx, m_slave);
+        if (modbus_write_bit(m_ctx, m_coil, on) != -1) return true;
+    }
+
+    return false;
+}
+
+
+double
+MasterPipeTracker::
+slope() const
+{
+    const double det = m_sw * m_stt - m_st * m_st;
+    if (qAbs(det) < 1e-12) return 0;
+
+    return (m_sw * m_sty - m_st * m_sy) / det;
+}
+
+
+void
+MasterPipeTracker::
+poll()
+{
+    double watercut, phase;
+
+    if (!m_loop) return;
+
+    if (!readFloat(m_watercutReg, watercut) || !readFloat(m_phaseReg, phase))
+    {
+        if (++m_failures >= MAX_FAILURES) finish(MASTER_TRACK_BUS_ERROR);
+        return;
+    }
+
+    const double t = m_clock.elapsed() / 1000.0;
+
+    m_failures = 0;
+    m_watercut = watercut;
+    m_phase = phase;
+    emit sampled(watercut, phase);
+
+    m_sw = FORGETTING * m_sw + 1;
+    m_st = FORGETTING * m_st + t;
+    m_sy = FORGETTING * m_sy + watercut;
+    m_stt = FORGETTING * m_stt + t * t;
+    m_sty = FORGETTING * m_sty + t * watercut;
+    m_samples++;
+
+    if (watercut >= m_target) finish(MASTER_TRACK_REACHED);
+    else if (m_isPhaseChecked && (phase != m_oilPhase)) finish(MASTER_TRACK_PHASE);
+    else if (t >= m_maxSeconds) finish(MASTER_TRACK_TIMEOUT);
+    else if ((m_samples >= MIN_FIT_SAMPLES) && !m_stopTimer.isActive())
+    {
+        /// the target falls before the next poll, stop on the predicted crossing
+        const double s = slope();
+        if (s > 0)
+        {
+            const double remaining = (m_target - watercut) / s;
+            if (remaining * 1000 < m_pollMs) m_stopTimer.start(qMax(0, int(remaining * 1000)));
+        }
+    }
+}
+
+
+void
+MasterPipeTracker::
+stop()
+{
+    finish(MASTER_TRACK_REACHED);
+}
+
+
+void
+MasterPipeTracker::
+finish(const int result)
+{
+    if (!m_loop) return;
+
+    m_pollTimer.stop();
+    m_stopTimer.stop();
+    const bool isOff = setPump(false);
+
+    m_injected = m_clock.elapsed() / 1000.0;
+    m_result = isOff ? result : MASTER_TRACK_PUMP_ERROR;
+    m_loop->quit();
+    m_loop = NULL;
+}
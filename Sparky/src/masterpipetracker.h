@@ -0,0 +1,82 @@
+#ifndef MASTERPIPETRACKER_H
+#define MASTERPIPETRACKER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include "modbus.h"
+
+/// outcome of MasterPipeTracker::run()
+#define MASTER_TRACK_REACHED        0
+#define MASTER_TRACK_TIMEOUT        1
+#define MASTER_TRACK_PHASE          2
+#define MASTER_TRACK_BUS_ERROR      3
+#define MASTER_TRACK_PUMP_ERROR     4   /// the pump coil did not take the write
+
+/// runs the water pump until the master pipe reports a target watercut.
+/// only the watercut and phase registers are polled, at a fixed rate from
+/// a timer, and a weighted fit of the watercut ramp schedules the stop
+/// for the predicted crossing instead of waiting for the next poll.
+class MasterPipeTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MasterPipeTracker(QObject * parent = 0);
+
+    void setRegisters(const int watercut, const int phase) { m_watercutReg = watercut; m_phaseReg = phase; }
+    void setPollInterval(const int ms) { m_pollMs = (ms > 0) ? ms : 500; }
+    void setOilPhase(const double phase) { m_oilPhase = phase; }
+    void setPhaseChecked(const bool isChecked) { m_isPhaseChecked = isChecked; }    /// off, leaving the oil phase does not stop the run
+
+    int run(modbus_t * ctx, const int slave, const int coil, const double target, const double maxSeconds);
+
+    double watercut() const { return m_watercut; }
+    double phase() const { return m_phase; }
+    double slope() const;
+    double injected() const { return m_injected; }
+
+signals:
+    void sampled(double watercut, double phase);
+
+private slots:
+    void poll();
+    void stop();
+
+private:
+    bool readFloat(const int address, double & value);
+    bool setPump(const bool on);
+    void finish(const int result);
+
+    modbus_t * m_ctx;
+    int m_slave;
+    int m_coil;
+    int m_watercutReg;
+    int m_phaseReg;
+    int m_pollMs;
+    int m_failures;
+    int m_result;
+    double m_oilPhase;
+    bool m_isPhaseChecked;
+    double m_target;
+    double m_maxSeconds;
+    double m_watercut;
+    double m_phase;
+    double m_injected;
+    int m_samples;
+
+    /// exponentially weighted sums of (t, watercut)
+    double m_sw;
+    double m_st;
+    double m_sy;
+    double m_stt;
+    double m_sty;
+
+    QElapsedTimer m_clock;
+    QTimer m_pollTimer;
+    QTimer m_stopTimer;
+    QEventLoop * m_loop;
+};
+
+#endif // MASTERPIPETRACKER_H
@@ -0,0 +1,145 @@
+#include "metricsserver.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QDebug>
+
+/// requests are tiny, anything larger is not a scrape
+#define MAX_REQUEST_BYTES       8192
+
+
+MetricsServer::
+MetricsServer(const quint16 port, QObject * parent) : QObject(parent), m_port(port), m_server(NULL)
+{
+}
+
+
+void
+MetricsServer::
+start()
+{
+    /// created here so that it belongs to the server thread
+    m_server = new QTcpServer(this);
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+
+    if (!m_server->listen(QHostAddress::LocalHost, m_port)) qWarning() << "metrics endpoint:" << m_server->errorString();
+}
+
+
+void
+MetricsServer::
+stop()
+{
+    if (m_server) m_server->close();
+}
+
+
+void
+MetricsServer::
+onNewConnection()
+{
+    while (m_server->hasPendingConnections())
+    {
+        QTcpSocket * socket = m_server->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+
+void
+MetricsServer::
+onReadyRead()
+{
+    QTcpSocket * socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) return;
+
+    /// wait for the end of the headers
+    const QByteArray request = socket->peek(MAX_REQUEST_BYTES);
+    if (!request.contains("\r\n\r\n"))
+    {
+        if (request.size() >= MAX_REQUEST_BYTES) socket->abort();
+        return;
+    }
+    socket->readAll();
+
+    const QList<QByteArray> line = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray status = "200 OK";
+    QByteArray body;
+
+    if ((line.size() < 2) || (line[0] != "GET")) status = "405 Method Not Allowed";
+    else if ((line[1] != "/metrics") && !line[1].startsWith("/metrics?")) status = "404 Not Found";
+    else body = render().toUtf8();
+
+    QByteArray reply = "HTTP/1.1 " + status + "\r\n";
+    reply += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    reply += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    reply += "Connection: close\r\n\r\n";
+    reply += body;
+
+    socket->write(reply);
+    socket->disconnectFromHost();
+}
+
+
+QString
+MetricsServer::
+render()
+{
+    const MetricsSnapshot & s = m_snapshots.read();
+    const QString loop = QString("loop=\"%1\"").arg(s.loop);
+    QString text;
+    QTextStream out(&text);
+
+    out << "# TYPE sparky_loop_calibrating gauge\n";
+    out << "sparky_loop_calibrating{" << loop << "} " << (s.isCalibrating ? 1 : 0) << "\n";
+    out << "# TYPE sparky_loop_run_mode gauge\n";
+    out << "sparky_loop_run_mode{" << loop << "} " << s.runMode << "\n";
+    out << "# TYPE sparky_loop_stability_phase gauge\n";
+    out << "sparky_loop_stability_phase{" << loop << "} " << s.stabilityPhase << "\n";
+    out << "# HELP sparky_loop_phase_seconds Time spent in the current run mode and stability phase.\n";
+    out << "# TYPE sparky_loop_phase_seconds gauge\n";
+    out << "sparky_loop_phase_seconds{" << loop << "} " << s.phaseSeconds << "\n";
+    out << "# TYPE sparky_loop_watercut gauge\n";
+    out << "sparky_loop_watercut{" << loop << "} " << s.watercut << "\n";
+    out << "# TYPE sparky_master_watercut gauge\n";
+    out << "sparky_master_watercut{" << loop << "} " << s.masterWatercut << "\n";
+    out << "# TYPE sparky_master_temperature gauge\n";
+    out << "sparky_master_temperature{" << loop << "} " << s.masterTemperature << "\n";
+    out << "# TYPE sparky_master_phase gauge\n";
+    out << "sparky_master_phase{" << loop << "} " << s.masterPhase << "\n";
+
+    const char * pipeMetrics[] = { "status", "frequency", "temperature", "oil_rp", "temp_stability", "freq_stability" };
+    for (int m = 0; m < 6; m++)
+    {
+        out << "# TYPE sparky_pipe_" << pipeMetrics[m] << " gauge\n";
+        for (int pipe = 0; pipe < 3; pipe++)
+        {
+            const MetricsPipe & p = s.pipes[pipe];
+            const double values[] = { double(p.status), p.frequency, p.temperature, p.oilRp, double(p.tempStability), double(p.freqStability) };
+            out << "sparky_pipe_" << pipeMetrics[m] << "{" << loop << ",pipe=\"" << pipe+1 << "\"} " << values[m] << "\n";
+        }
+    }
+
+    out << "# TYPE sparky_modbus_requests_total counter\n";
+    foreach (const MetricsBus & b, s.bus) out << "sparky_modbus_requests_total{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.requests << "\n";
+    out << "# TYPE sparky_modbus_timeouts_total counter\n";
+    foreach (const MetricsBus & b, s.bus) out << "sparky_modbus_timeouts_total{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.timeouts << "\n";
+    out << "# TYPE sparky_modbus_crc_errors_total counter\n";
+    foreach (const MetricsBus & b, s.bus) out << "sparky_modbus_crc_errors_total{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.crcErrors << "\n";
+    out << "# TYPE sparky_modbus_errors_total counter\n";
+    foreach (const MetricsBus & b, s.bus) out << "sparky_modbus_errors_total{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.otherErrors << "\n";
+    out << "# TYPE sparky_modbus_latency_seconds summary\n";
+    foreach (const MetricsBus & b, s.bus)
+    {
+        out << "sparky_modbus_latency_seconds{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\",quantile=\"0.5\"} " << b.p50 << "\n";
+        out << "sparky_modbus_latency_seconds{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\",quantile=\"0.99\"} " << b.p99 << "\n";
+        out << "sparky_modbus_latency_seconds_sum{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.sum << "\n";
+        out << "sparky_modbus_latency_seconds_count{" << loop << ",slave=\"" << b.slave << "\",function=\"" << b.function << "\"} " << b.count << "\n";
+    }
+    out << "# TYPE sparky_modbus_duty_cycle gauge\n";
+    out << "sparky_modbus_duty_cycle{" << loop << "} " << s.busDutyCycle << "\n";
+
+    out.flush();
+    return text;
+}
@@ -0,0 +1,86 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include "triplebuffer.h"
+
+class QTcpServer;
+
+struct MetricsPipe
+{
+    int status;
+    double frequency;
+    double temperature;
+    double oilRp;
+    int tempStability;
+    int freqStability;
+
+    MetricsPipe() : status(0), frequency(0), temperature(0), oilRp(0), tempStability(0), freqStability(0) {}
+};
+
+struct MetricsBus
+{
+    int slave;
+    int function;
+    quint64 requests;
+    quint64 timeouts;
+    quint64 crcErrors;
+    quint64 otherErrors;
+    double p50;     /// round trip, seconds
+    double p99;
+    double sum;     /// of all round trips, seconds
+    quint64 count;  /// round trips recorded
+};
+
+/// state of one loop as seen by a scrape
+struct MetricsSnapshot
+{
+    int loop;
+    bool isCalibrating;
+    int runMode;
+    int stabilityPhase;
+    double phaseSeconds;
+    double watercut;
+    double masterWatercut;
+    double masterTemperature;
+    double masterPhase;
+    MetricsPipe pipes[3];
+    QList<MetricsBus> bus;
+    double busDutyCycle;
+
+    MetricsSnapshot() : loop(0), isCalibrating(false), runMode(0), stabilityPhase(0), phaseSeconds(0), watercut(0), masterWatercut(0), masterTemperature(0), masterPhase(0), busDutyCycle(0) {}
+};
+
+/// plain text Prometheus endpoint on localhost. the server lives on its
+/// own thread and only reads the snapshot last published by the
+/// acquisition side, so a scrape never waits on the bus and vice versa.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(const quint16 port, QObject * parent = 0);
+
+    /// acquisition thread: fill the write slot, then publish it
+    MetricsSnapshot & snapshot() { return m_snapshots.writeBuffer(); }
+    void publish() { m_snapshots.publish(); }
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    QString render();
+
+    quint16 m_port;
+    QTcpServer * m_server;
+    TripleBuffer<MetricsSnapshot> m_snapshots;
+};
+
+#endif // METRICSSERVER_H
@@ -37,6 +37,9 @@
 QcGaugeWidget::QcGaugeWidget(QWidget *parent) :
     QWidget(parent)
 {
+    mFirstDynamic = 0;
+    mLastDynamic = -1;
+    mCacheValid = false;
     setMinimumSize(170,170);
 }
 
@@ -45,6 +48,7 @@ QcBackgroundItem *QcGaugeWidget::addBackground(float position)
     QcBackgroundItem * item = new QcBackgroundItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -54,6 +58,7 @@ QcDegreesItem *QcGaugeWidget::addDegrees(float position)
     item->setPosition(position);
 
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -63,6 +68,7 @@ QcValuesItem *QcGaugeWidget::addValues(float position)
     QcValuesItem * item = new QcValuesItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -71,6 +77,7 @@ QcArcItem *QcGaugeWidget::addArc(float position)
     QcArcItem * item = new QcArcItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -79,6 +86,7 @@ QcColorBand *QcGaugeWidget::addColorBand(float position)
     QcColorBand * item = new QcColorBand(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -87,6 +95,7 @@ QcNeedleItem *QcGaugeWidget::addNeedle(float position)
     QcNeedleItem * item = new QcNeedleItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -95,6 +104,7 @@ QcLabelItem *QcGaugeWidget::addLabel(float position)
     QcLabelItem * item = new QcLabelItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -103,6 +113,7 @@ QcGlassItem *QcGaugeWidget::addGlass(float position)
     QcGlassItem * item = new QcGlassItem(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -111,6 +122,7 @@ QcAttitudeMeter *QcGaugeWidget::addAttitudeMeter(float position)
     QcAttitudeMeter * item = new QcAttitudeMeter(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
     return item;
 }
 
@@ -120,10 +132,12 @@ void QcGaugeWidget::addItem(QcItem *item,float position)
     item->setParent(this);
     item->setPosition(position);
     mItems.append(item);
+    invalidateCache();
 }
 
 int QcGaugeWidget::removeItem(QcItem *item)
 {
+   invalidateCache();
    return mItems.removeAll(item);
 }
 
@@ -133,14 +147,68 @@ QList<QcItem *> QcGaugeWidget::items()
 }
 
 
+void QcGaugeWidget::invalidateCache()
+{
+    mCacheValid = false;
+    update();
+}
+
+void QcGaugeWidget::resizeEvent(QResizeEvent */*resizeEvt*/)
+{
+    mCacheValid = false;
+}
+
+QPixmap QcGaugeWidget::renderLayer(int from, int to)
+{
+    if(from>=to)
+        return QPixmap();
+
+    const qreal dpr = devicePixelRatioF();
+    QPixmap layer(size()*dpr);
+    layer.setDevicePixelRatio(dpr);
+    layer.fill(Qt::transparent);
+
+    QPainter painter(&layer);
+    painter.setRenderHint(QPainter::Antialiasing);
+    for(int i = from;i<to;i++)
+        mItems[i]->draw(&painter);
+
+    return layer;
+}
+
+void QcGaugeWidget::updateCache()
+{
+    mFirstDynamic = mItems.size();
+    mLastDynamic = -1;
+    for(int i = 0;i<mItems.size();i++){
+        if(mItems[i]->isDynamic()){
+            if(mFirstDynamic>i)
+                mFirstDynamic = i;
+            mLastDynamic = i;
+        }
+    }
+
+    // static items between two dynamic ones keep being painted per frame
+    mUnderlay = renderLayer(0,mFirstDynamic);
+    mOverlay = renderLayer(mLastDynamic+1,mItems.size());
+    mCacheValid = true;
+}
+
 void QcGaugeWidget::paintEvent(QPaintEvent */*paintEvt*/)
 {
+    if(!mCacheValid)
+        updateCache();
+
     QPainter painter(this);
+    if(!mUnderlay.isNull())
+        painter.drawPixmap(0,0,mUnderlay);
+
     painter.setRenderHint(QPainter::Antialiasing);
+    for(int i = mFirstDynamic;i<=mLastDynamic;i++)
+        mItems[i]->draw(&painter);
 
-    foreach (QcItem * item, mItems) {
-        item->draw(&painter);
-    }
+    if(!mOverlay.isNull())
+        painter.drawPixmap(0,0,mOverlay);
 }
 ///////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -159,9 +227,19 @@ int QcItem::type()
     return 50;
 }
 
+bool QcItem::isDynamic()
+{
+    return false;
+}
+
 void QcItem::update()
 {
-    parentWidget->update();
+    // a static item changed, its cached layer has to be redrawn
+    QcGaugeWidget * gauge = qobject_cast<QcGaugeWidget*>(parentWidget);
+    if(gauge && !isDynamic())
+        gauge->invalidateCache();
+    else if(parentWidget)
+        parentWidget->update();
 }
 
 float QcItem::position()
@@ -254,7 +332,7 @@ void QcScaleItem::setValueRange(float minValue, float maxValue)
         throw( InvalidValueRange);
     mMinValue = minValue;
     mMaxValue = maxValue;
-
+    update();
 }
 
 void QcScaleItem::setDgereeRange(float minDegree, float maxDegree)
@@ -263,6 +341,7 @@ void QcScaleItem::setDgereeRange(float minDegree, float maxDegree)
         throw( InvalidValueRange);
     mMinDegree = minDegree;
     mMaxDegree = maxDegree;
+    update();
 }
 
 float QcScaleItem::getDegFromValue(float v)
@@ -349,6 +428,7 @@ void QcBackgroundItem::addColor(float position, const QColor &color)
 void QcBackgroundItem::clearrColors()
 {
     mColors.clear();
+    update();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -395,6 +475,12 @@ QcLabelItem::QcLabelItem(QObject *parent) :
     mAngle = 270;
     mText = "%";
     mColor = Qt::black;
+    mIsStatic = false;
+}
+
+bool QcLabelItem::isDynamic()
+{
+    return !mIsStatic;
 }
 
 void QcLabelItem::draw(QPainter *painter)
@@ -450,6 +536,16 @@ QColor QcLabelItem::color()
     return mColor;
 }
 
+// a label that never changes, e.g. a title, is drawn into the cached background
+void QcLabelItem::setStatic(bool isStatic)
+{
+    mIsStatic = isStatic;
+    // the label moves between the cached layers and the dynamic ones
+    QcGaugeWidget * gauge = qobject_cast<QcGaugeWidget*>(parent());
+    if(gauge)
+        gauge->invalidateCache();
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -477,6 +573,7 @@ void QcArcItem::draw(QPainter *painter)
 void QcArcItem::setColor(const QColor &color)
 {
     mColor = color;
+    update();
 }
 ///////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -614,6 +711,11 @@ QcNeedleItem::QcNeedleItem(QObject *parent) :
     mNeedleType = FeatherNeedle;
 }
 
+bool QcNeedleItem::isDynamic()
+{
+    return true;
+}
+
 void QcNeedleItem::draw(QPainter *painter)
 {
     resetRect();
@@ -814,12 +916,14 @@ void QcValuesItem::draw(QPainter*painter)
 void QcValuesItem::setStep(float step)
 {
     mStep = step;
+    update();
 }
 
 
 void QcValuesItem::setColor(const QColor& color)
 {
     mColor = color;
+    update();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -876,6 +980,11 @@ float QcAttitudeMeter::getStartAngle(const QRectF& tmpRect)
     return getAngle(p,tmpRect);
 }
 
+bool QcAttitudeMeter::isDynamic()
+{
+    return true;
+}
+
 void QcAttitudeMeter::draw(QPainter *painter)
 {
     resetRect();
@@ -33,6 +33,7 @@
 #include <QPainter>
 #include <QObject>
 #include <QRectF>
+#include <QPixmap>
 #include <QtMath>
 
 
@@ -81,13 +82,25 @@ public:
     QList <QcItem*> items();
     QList <QcItem*> mItems;
 
+    // drops the cached static layers, they are redrawn on the next paint
+    void invalidateCache();
+
 
 signals:
 
 public slots:
 private:
     void paintEvent(QPaintEvent *);
-
+    void resizeEvent(QResizeEvent *);
+    void updateCache();
+    QPixmap renderLayer(int from, int to);
+
+    // static items below the first dynamic item and above the last one
+    QPixmap mUnderlay;
+    QPixmap mOverlay;
+    int mFirstDynamic;
+    int mLastDynamic;
+    bool mCacheValid;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -101,6 +114,8 @@ public:
     explicit QcItem(QObject *parent = 0);
     virtual void draw(QPainter *) = 0;
     virtual int type();
+    // dynamic items are painted on every frame, all others are cached
+    virtual bool isDynamic();
 
     void setPosition(float percentage);
     float position();
@@ -194,17 +209,20 @@ class QCGAUGE_DECL QcLabelItem : public QcItem
 public:
     explicit QcLabelItem(QObject *parent = 0);
     virtual void draw(QPainter *);
+    virtual bool isDynamic();
     void setAngle(float);
     float angle();
     void setText(const QString &text, bool repaint = true);
     QString text();
     void setColor(const QColor& color);
     QColor color();
+    void setStatic(bool isStatic);
 
 private:
     float mAngle;
     QString mText;
     QColor mColor;
+    bool mIsStatic;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -273,6 +291,7 @@ class QCGAUGE_DECL QcNeedleItem : public QcScaleItem
 public:
     explicit QcNeedleItem(QObject *parent = 0);
     void draw(QPainter*);
+    bool isDynamic();
     void setCurrentValue(float value);
     float currentValue();
     void setValueFormat(QString format);
@@ -327,6 +346,7 @@ public:
     explicit QcAttitudeMeter(QObject *parent = 0);
 
     void draw(QPainter *);
+    bool isDynamic();
     void setCurrentPitch(float pitch);
     void setCurrentRoll(float roll);
 private:
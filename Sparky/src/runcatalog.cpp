@@ -0,0 +1,370 @@
+#include "runcatalog.h"
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QtDebug>
+
+/// how long sample statistics may stay in memory only
+#define CATALOG_FLUSH_MS        10000
+
+static const char * schema[] = {
+    "PRAGMA journal_mode = WAL",
+    "PRAGMA synchronous = NORMAL",
+    "CREATE TABLE IF NOT EXISTS runs ("
+    " id INTEGER PRIMARY KEY,"
+    " sn TEXT NOT NULL,"
+    " mode TEXT NOT NULL,"
+    " run_index INTEGER NOT NULL,"
+    " product TEXT,"
+    " loop INTEGER,"
+    " pipe INTEGER,"
+    " operator TEXT,"
+    " directory TEXT,"
+    " phase TEXT,"
+    " started TEXT,"
+    " finished TEXT,"
+    " samples INTEGER DEFAULT 0,"
+    " min_temperature REAL,"
+    " max_temperature REAL,"
+    " min_frequency REAL,"
+    " max_frequency REAL,"
+    " UNIQUE (mode, sn, run_index))",
+    "CREATE INDEX IF NOT EXISTS runs_by_sn ON runs (sn, started)",
+    "CREATE TABLE IF NOT EXISTS run_files ("
+    " run_id INTEGER NOT NULL REFERENCES runs (id),"
+    " path TEXT NOT NULL,"
+    " added TEXT,"
+    " PRIMARY KEY (run_id, path))",
+};
+
+
+RunCatalog::
+RunCatalog(QObject * parent) : QObject(parent), m_connection(QString("runcatalog-%1").arg(quintptr(this), 0, 16))
+{
+    m_flushTimer.setInterval(CATALOG_FLUSH_MS);
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+
+RunCatalog::
+~RunCatalog()
+{
+    close();
+}
+
+
+bool
+RunCatalog::
+open(const QString & path)
+{
+    close();
+
+    m_db = QSqlDatabase::addDatabase("QSQLITE", m_connection);
+    m_db.setDatabaseName(path);
+    if (!m_db.open())
+    {
+        qWarning() << "run catalog:" << path << m_db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    for (size_t i = 0; i < sizeof(schema) / sizeof(schema[0]); i++)
+    {
+        if (!query.exec(schema[i]))
+        {
+            qWarning() << "run catalog:" << query.lastError().text();
+            m_db.close();
+            return false;
+        }
+    }
+
+    m_flushTimer.start();
+    return true;
+}
+
+
+void
+RunCatalog::
+close()
+{
+    if (!QSqlDatabase::contains(m_connection)) return;
+
+    flush();
+    m_flushTimer.stop();
+    m_active.clear();
+
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connection);
+}
+
+
+int
+RunCatalog::
+nextRunIndex(const QString & mode, const QString & sn)
+{
+    if (!m_db.isOpen()) return 1;
+
+    QSqlQuery query(m_db);
+    query.prepare("SELECT MAX(run_index) FROM runs WHERE mode = ? AND sn = ?");
+    query.addBindValue(mode);
+    query.addBindValue(sn);
+    if (!query.exec() || !query.next() || query.value(0).isNull()) return 1;
+
+    return query.value(0).toInt() + 1;
+}
+
+
+/// newest first, runs in progress included
+QList<RunCatalog::Run>
+RunCatalog::
+history(const QString & sn)
+{
+    QList<Run> runs;
+    if (!m_db.isOpen()) return runs;
+
+    flush();
+
+    QSqlQuery query(m_db);
+    query.prepare("SELECT id, sn, mode, product, loop, pipe, run_index, operator, directory, phase, started, finished, samples, "
+                  "min_temperature, max_temperature, min_frequency, max_frequency FROM runs WHERE sn = ? ORDER BY started DESC");
+    query.addBindValue(sn);
+    if (!query.exec()) return runs;
+
+    while (query.next())
+    {
+        Run run;
+        run.id = query.value(0).toLongLong();
+        run.sn = query.value(1).toString();
+        run.mode = query.value(2).toString();
+        run.product = query.value(3).toString();
+        run.loop = query.value(4).toInt();
+        run.pipe = query.value(5).toInt();
+        run.runIndex = query.value(6).toInt();
+        run.operatorName = query.value(7).toString();
+        run.directory = query.value(8).toString();
+        run.phase = query.value(9).toString();
+        run.started = QDateTime::fromString(query.value(10).toString(), Qt::ISODate);
+        run.finished = QDateTime::fromString(query.value(11).toString(), Qt::ISODate);
+        run.samples = query.value(12).toInt();
+        run.minTemperature = query.value(13).toDouble();
+        run.maxTemperature = query.value(14).toDouble();
+        run.minFrequency = query.value(15).toDouble();
+        run.maxFrequency = query.value(16).toDouble();
+        runs.append(run);
+    }
+
+    return runs;
+}
+
+
+/// the row goes in at once so its run index is taken
+qint64
+RunCatalog::
+beginRun(const Run & run)
+{
+    if (!m_db.isOpen()) return -1;
+
+    Run active = run;
+    active.started = QDateTime::currentDateTime();
+
+    QSqlQuery query(m_db);
+    query.prepare("INSERT INTO runs (sn, mode, run_index, product, loop, pipe, operator, directory, phase, started) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    query.addBindValue(active.sn);
+    query.addBindValue(active.mode);
+    query.addBindValue(active.runIndex);
+    query.addBindValue(active.product);
+    query.addBindValue(active.loop);
+    query.addBindValue(active.pipe);
+    query.addBindValue(active.operatorName);
+    query.addBindValue(active.directory);
+    query.addBindValue(active.phase);
+    query.addBindValue(active.started.toString(Qt::ISODate));
+    if (!query.exec())
+    {
+        qWarning() << "run catalog:" << query.lastError().text();
+        return -1;
+    }
+
+    active.id = query.lastInsertId().toLongLong();
+    m_active[active.id] = active;
+
+    return active.id;
+}
+
+
+void
+RunCatalog::
+setOperator(const qint64 id, const QString & name)
+{
+    if (!m_active.contains(id)) return;
+
+    m_active[id].operatorName = name;
+    m_dirty.insert(id);
+}
+
+
+void
+RunCatalog::
+setPhase(const qint64 id, const QString & phase)
+{
+    if (!m_active.contains(id) || (m_active[id].phase == phase)) return;
+
+    m_active[id].phase = phase;
+    m_dirty.insert(id);
+}
+
+
+void
+RunCatalog::
+addFile(const qint64 id, const QString & path)
+{
+    if (!m_active.contains(id)) return;
+
+    m_files.append(qMakePair(id, path));
+}
+
+
+void
+RunCatalog::
+addSample(const qint64 id, const double temperature, const double frequency)
+{
+    if (!m_active.contains(id)) return;
+
+    Run & run = m_active[id];
+    if (!run.samples)
+    {
+        run.minTemperature = run.maxTemperature = temperature;
+        run.minFrequency = run.maxFrequency = frequency;
+    }
+    else
+    {
+        run.minTemperature = qMin(run.minTemperature, temperature);
+        run.maxTemperature = qMax(run.maxTemperature, temperature);
+        run.minFrequency = qMin(run.minFrequency, frequency);
+        run.maxFrequency = qMax(run.maxFrequency, frequency);
+    }
+    run.samples++;
+    m_dirty.insert(id);
+}
+
+
+void
+RunCatalog::
+finishRun(const qint64 id)
+{
+    if (!m_active.contains(id)) return;
+
+    m_active[id].finished = QDateTime::currentDateTime();
+    m_dirty.insert(id);
+    flush();
+    m_active.remove(id);
+}
+
+
+bool
+RunCatalog::
+importRun(const Run & run, const QStringList & files)
+{
+    if (!m_db.isOpen()) return false;
+
+    m_db.transaction();
+
+    QSqlQuery query(m_db);
+    query.prepare("INSERT OR IGNORE INTO runs (sn, mode, run_index, product, loop, pipe, operator, directory, phase, started, finished, samples, "
+                  "min_temperature, max_temperature, min_frequency, max_frequency) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    query.addBindValue(run.sn);
+    query.addBindValue(run.mode);
+    query.addBindValue(run.runIndex);
+    query.addBindValue(run.product);
+    query.addBindValue(run.loop);
+    query.addBindValue(run.pipe);
+    query.addBindValue(run.operatorName);
+    query.addBindValue(run.directory);
+    query.addBindValue(run.phase);
+    query.addBindValue(run.started.toString(Qt::ISODate));
+    query.addBindValue(run.finished.toString(Qt::ISODate));
+    query.addBindValue(run.samples);
+    query.addBindValue(run.minTemperature);
+    query.addBindValue(run.maxTemperature);
+    query.addBindValue(run.minFrequency);
+    query.addBindValue(run.maxFrequency);
+    if (!query.exec() || (query.numRowsAffected() < 1))
+    {
+        m_db.rollback();
+        return false;
+    }
+
+    const qint64 id = query.lastInsertId().toLongLong();
+    QSqlQuery insert(m_db);
+    insert.prepare("INSERT OR IGNORE INTO run_files (run_id, path, added) VALUES (?, ?, ?)");
+    const QString now = QDateTime::currentDateTime().toString(Qt::ISODate);
+    foreach (const QString & path, files)
+    {
+        insert.addBindValue(id);
+        insert.addBindValue(path);
+        insert.addBindValue(now);
+        insert.exec();
+    }
+
+    if (!m_db.commit())
+    {
+        qWarning() << "run catalog:" << m_db.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+
+    return true;
+}
+
+
+/// everything that changed since the last flush, in one transaction
+void
+RunCatalog::
+flush()
+{
+    if (!m_db.isOpen() || (m_dirty.isEmpty() && m_files.isEmpty())) return;
+
+    m_db.transaction();
+
+    QSqlQuery update(m_db);
+    update.prepare("UPDATE runs SET operator = ?, phase = ?, finished = ?, samples = ?, "
+                   "min_temperature = ?, max_temperature = ?, min_frequency = ?, max_frequency = ? WHERE id = ?");
+    foreach (const qint64 id, m_dirty)
+    {
+        if (!m_active.contains(id)) continue;
+
+        const Run & run = m_active[id];
+        update.addBindValue(run.operatorName);
+        update.addBindValue(run.phase);
+        update.addBindValue(run.finished.isValid() ? QVariant(run.finished.toString(Qt::ISODate)) : QVariant());
+        update.addBindValue(run.samples);
+        update.addBindValue(run.minTemperature);
+        update.addBindValue(run.maxTemperature);
+        update.addBindValue(run.minFrequency);
+        update.addBindValue(run.maxFrequency);
+        update.addBindValue(id);
+        update.exec();
+    }
+
+    QSqlQuery insert(m_db);
+    insert.prepare("INSERT OR IGNORE INTO run_files (run_id, path, added) VALUES (?, ?, ?)");
+    const QString now = QDateTime::currentDateTime().toString(Qt::ISODate);
+    for (int i = 0; i < m_files.size(); i++)
+    {
+        insert.addBindValue(m_files[i].first);
+        insert.addBindValue(m_files[i].second);
+        insert.addBindValue(now);
+        insert.exec();
+    }
+
+    if (!m_db.commit())
+    {
+        qWarning() << "run catalog:" << m_db.lastError().text();
+        m_db.rollback();
+        return;
+    }
+
+    m_dirty.clear();
+    m_files.clear();
+}
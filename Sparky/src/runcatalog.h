@@ -0,0 +1,82 @@
+#ifndef RUNCATALOG_H
+#define RUNCATALOG_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QTimer>
+
+/// every calibration run started on this station, kept in SQLite next to
+/// the program. the run directory of a serial number and its history come
+/// from an index instead of probing the file server one stat at a time.
+/// a run row is written when the run starts, its samples only touch
+/// memory and reach the database in one transaction per flush.
+class RunCatalog : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Run
+    {
+        qint64 id;
+        QString sn;
+        QString mode;
+        QString product;
+        int loop;
+        int pipe;
+        int runIndex;           /// 1 for the plain directory, N for "_N"
+        QString operatorName;
+        QString directory;
+        QString phase;
+        QDateTime started;
+        QDateTime finished;
+        int samples;
+        double minTemperature;
+        double maxTemperature;
+        double minFrequency;
+        double maxFrequency;
+
+        Run() : id(-1), loop(0), pipe(0), runIndex(1), samples(0), minTemperature(0), maxTemperature(0), minFrequency(0), maxFrequency(0) {}
+    };
+
+    explicit RunCatalog(QObject * parent = 0);
+    ~RunCatalog();
+
+    bool open(const QString & path);
+    void close();
+    bool isOpen() const { return m_db.isOpen(); }
+
+    /// lookups, both served by an index
+    int nextRunIndex(const QString & mode, const QString & sn);
+    QList<Run> history(const QString & sn);
+
+    /// a run in progress
+    qint64 beginRun(const Run & run);
+    void setOperator(const qint64 id, const QString & name);
+    void setPhase(const qint64 id, const QString & phase);
+    void addFile(const qint64 id, const QString & path);
+    void addSample(const qint64 id, const double temperature, const double frequency);
+    void finishRun(const qint64 id);
+
+    /// a finished run from an archive, ignored when its index is taken
+    bool importRun(const Run & run, const QStringList & files);
+
+public slots:
+    void flush();
+
+private:
+    QString m_connection;
+    QSqlDatabase m_db;
+    QTimer m_flushTimer;
+
+    QHash<qint64, Run> m_active;
+    QSet<qint64> m_dirty;
+    QList< QPair<qint64, QString> > m_files;
+};
+
+#endif // RUNCATALOG_H
@@ -0,0 +1,407 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QVariantMap>
+#include "settings.h"
+
+static const char * stabilityKeys[STABILITY_PHASES] = { LOOP_STABILITY_AMB, LOOP_STABILITY_MIN_REF, LOOP_STABILITY_MAX_REF };
+
+
+Settings::
+Settings() : injectionOilPumpRate(0), injectionWaterPumpRate(0), injectionSmallWaterPumpRate(0), injectionBucket(0), injectionMark(0), injectionMethod(0), pressureSensorSlope(0), minRefTemp(0), maxRefTemp(0), injectionTemp(0), xDelay(0), yFreq(0), zTemp(0), intervalSmallPump(0.25), intervalBigPump(1), intervalOilPump(0.25), loopNumber(0), masterMin(0), masterMax(0), masterDelta(0), masterDeltaFinal(0), maxInjectionWater(80), maxInjectionOil(200), masterPollInterval(500), portIndex(0), linkBaudRegister(0), metricsPort(0), eventLog("events.jsonl"), runCatalog("runs.sqlite"), isReplayFast(false), stabilityEwmaAlpha(0.3), isPredictiveSettling(false), fitCurveDegree(3), fitTempDegree(2), fitCurveRegister(0), fitTempRegister(0)
+{
+    /// 0 limits follow zTemp and yFreq
+    for (int phase = 0; phase < STABILITY_PHASES; phase++)
+    {
+        tempCriteria[phase].maxStdDev = 0;
+        tempCriteria[phase].maxSlope = 0;
+        freqCriteria[phase].maxStdDev = 0;
+        freqCriteria[phase].maxSlope = 0;
+    }
+}
+
+
+/// overlay the keys present in data on the current values. values are
+/// stored as strings by older versions, QVariant converts both forms.
+bool
+Settings::
+parse(const QByteArray & data, QString & error)
+{
+    QJsonParseError status;
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &status);
+    if (status.error != QJsonParseError::NoError)
+    {
+        error = QString("%1 at offset %2").arg(status.errorString()).arg(status.offset);
+        return false;
+    }
+    if (!doc.isObject())
+    {
+        error = "top level is not an object";
+        return false;
+    }
+
+    const QVariantMap json = doc.object().toVariantMap();
+
+    /// file server
+    mainServer = json.value(MAIN_SERVER, mainServer).toString();
+    localServer = json.value(LOCAL_SERVER, localServer).toString();
+
+    /// calibration control variables
+    injectionOilPumpRate = json.value(LOOP_OIL_PUMP_RATE, injectionOilPumpRate).toDouble();
+    injectionWaterPumpRate = json.value(LOOP_WATER_PUMP_RATE, injectionWaterPumpRate).toDouble();
+    injectionSmallWaterPumpRate = json.value(LOOP_SMALL_WATER_PUMP_RATE, injectionSmallWaterPumpRate).toDouble();
+    injectionBucket = json.value(LOOP_BUCKET, injectionBucket).toDouble();
+    injectionMark = json.value(LOOP_MARK, injectionMark).toDouble();
+    injectionMethod = json.value(LOOP_METHOD, injectionMethod).toDouble();
+    pressureSensorSlope = json.value(LOOP_PRESSURE, pressureSensorSlope).toDouble();
+    minRefTemp = json.value(LOOP_MIN_TEMP, minRefTemp).toInt();
+    maxRefTemp = json.value(LOOP_MAX_TEMP, maxRefTemp).toInt();
+    injectionTemp = json.value(LOOP_INJECTION_TEMP, injectionTemp).toInt();
+    xDelay = json.value(LOOP_X_DELAY, xDelay).toInt();
+    yFreq = json.value(LOOP_Y_FREQ, yFreq).toDouble();
+    zTemp = json.value(LOOP_Z_TEMP, zTemp).toDouble();
+    intervalSmallPump = json.value(LOOP_INTERVAL_SMALL_PUMP, intervalSmallPump).toDouble();
+    intervalBigPump = json.value(LOOP_INTERVAL_BIG_PUMP, intervalBigPump).toDouble();
+    intervalOilPump = json.value(LOOP_INTERVAL_OIL_PUMP, intervalOilPump).toDouble();
+    loopNumber = json.value(LOOP_NUMBER, loopNumber).toInt();
+    masterMin = json.value(LOOP_MASTER_MIN, masterMin).toDouble();
+    masterMax = json.value(LOOP_MASTER_MAX, masterMax).toDouble();
+    masterDelta = json.value(LOOP_MASTER_DELTA, masterDelta).toDouble();
+    masterDeltaFinal = json.value(LOOP_MASTER_DELTA_FINAL, masterDeltaFinal).toDouble();
+    maxInjectionWater = json.value(LOOP_MAX_INJECTION_WATER, maxInjectionWater).toInt();
+    maxInjectionOil = json.value(LOOP_MAX_INJECTION_OIL, maxInjectionOil).toInt();
+    masterPollInterval = json.value(LOOP_MASTER_POLL_INTERVAL, masterPollInterval).toInt();
+
+    /// connection
+    portIndex = json.value(LOOP_PORT_INDEX, portIndex).toInt();
+    portSerial = json.value(LOOP_PORT_SERIAL, portSerial).toString();
+    lowLatencyPorts = json.value(LOOP_LOW_LATENCY_PORTS, lowLatencyPorts.join(',')).toString().split(',', QString::SkipEmptyParts);
+    linkBaudRegister = json.value(LOOP_LINK_BAUD_REGISTER, linkBaudRegister).toInt();
+    linkBauds = json.value(LOOP_LINK_BAUDS, linkBauds.join(',')).toString().split(',', QString::SkipEmptyParts);
+    metricsPort = json.value(LOOP_METRICS_PORT, metricsPort).toInt();
+    eventLog = json.value(LOOP_EVENT_LOG, eventLog).toString();
+    runCatalog = json.value(LOOP_RUN_CATALOG, runCatalog).toString();
+    captureDir = json.value(LOOP_CAPTURE_DIR, captureDir).toString();
+    replayFile = json.value(LOOP_REPLAY_FILE, replayFile).toString();
+    isReplayFast = json.value(LOOP_REPLAY_FAST, int(isReplayFast)).toInt();
+
+    /// stability criteria per temp run phase
+    stabilityEwmaAlpha = json.value(LOOP_STABILITY_EWMA_ALPHA, stabilityEwmaAlpha).toDouble();
+    isPredictiveSettling = json.value(LOOP_PREDICTIVE_SETTLING, int(isPredictiveSettling)).toInt();
+    for (int phase = 0; phase < STABILITY_PHASES; phase++)
+    {
+        const QString key = stabilityKeys[phase];
+        tempCriteria[phase].window = json.value(key + STABILITY_WINDOW, tempCriteria[phase].window).toInt();
+        tempCriteria[phase].maxStdDev = json.value(key + STABILITY_TEMP_STDDEV, tempCriteria[phase].maxStdDev).toDouble();
+        tempCriteria[phase].maxSlope = json.value(key + STABILITY_TEMP_SLOPE, tempCriteria[phase].maxSlope).toDouble();
+        freqCriteria[phase].window = tempCriteria[phase].window;
+        freqCriteria[phase].maxStdDev = json.value(key + STABILITY_FREQ_STDDEV, freqCriteria[phase].maxStdDev).toDouble();
+        freqCriteria[phase].maxSlope = json.value(key + STABILITY_FREQ_SLOPE, freqCriteria[phase].maxSlope).toDouble();
+    }
+
+    /// online calibration fits
+    fitCurveDegree = json.value(LOOP_FIT_CURVE_DEGREE, fitCurveDegree).toInt();
+    fitTempDegree = json.value(LOOP_FIT_TEMP_DEGREE, fitTempDegree).toInt();
+    fitCurveRegister = json.value(LOOP_FIT_CURVE_REGISTER, fitCurveRegister).toInt();
+    fitTempRegister = json.value(LOOP_FIT_TEMP_REGISTER, fitTempRegister).toInt();
+
+    return true;
+}
+
+
+/// reject values the calibration loop cannot run with
+bool
+Settings::
+validate(QString & error) const
+{
+    if (minRefTemp > maxRefTemp) error = QString("%1 is above %2").arg(LOOP_MIN_TEMP).arg(LOOP_MAX_TEMP);
+    else if (xDelay < 0) error = QString("%1 is negative").arg(LOOP_X_DELAY);
+    else if ((yFreq < 0) || (zTemp < 0)) error = QString("%1 and %2 must not be negative").arg(LOOP_Y_FREQ).arg(LOOP_Z_TEMP);
+    else if ((intervalSmallPump < 0) || (intervalBigPump < 0) || (intervalOilPump < 0)) error = "pump intervals must not be negative";
+    else if ((maxInjectionWater < 0) || (maxInjectionOil < 0)) error = "injection limits must not be negative";
+    else if (masterPollInterval <= 0) error = QString("%1 must be positive").arg(LOOP_MASTER_POLL_INTERVAL);
+    else if (linkBaudRegister < 0) error = QString("%1 must not be negative").arg(LOOP_LINK_BAUD_REGISTER);
+    else if ((metricsPort < 0) || (metricsPort > 65535)) error = QString("%1 is not a TCP port").arg(LOOP_METRICS_PORT);
+    else if ((stabilityEwmaAlpha <= 0) || (stabilityEwmaAlpha > 1)) error = QString("%1 must be in (0, 1]").arg(LOOP_STABILITY_EWMA_ALPHA);
+    else if ((fitCurveDegree < 1) || (fitCurveDegree > 3) || (fitTempDegree < 1) || (fitTempDegree > 3)) error = QString("%1 and %2 must be 1, 2 or 3").arg(LOOP_FIT_CURVE_DEGREE).arg(LOOP_FIT_TEMP_DEGREE);
+    else if ((fitCurveRegister < 0) || (fitTempRegister < 0)) error = QString("%1 and %2 must not be negative").arg(LOOP_FIT_CURVE_REGISTER).arg(LOOP_FIT_TEMP_REGISTER);
+    else
+    {
+        for (int phase = 0; phase < STABILITY_PHASES; phase++)
+        {
+            if (tempCriteria[phase].window < 2)
+            {
+                error = QString("%1%2 needs at least 2 samples").arg(stabilityKeys[phase]).arg(STABILITY_WINDOW);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/// take the keys of an edit that can change under a running calibration:
+/// timings, injection limits, stability criteria, fits and connection.
+/// the temperatures, the loop number, the pump rates and the master set
+/// points shape the run and its file names, they keep their values.
+void
+Settings::
+mergeLive(const Settings & edited)
+{
+    /// calibration control variables
+    xDelay = edited.xDelay;
+    yFreq = edited.yFreq;
+    zTemp = edited.zTemp;
+    intervalSmallPump = edited.intervalSmallPump;
+    intervalBigPump = edited.intervalBigPump;
+    intervalOilPump = edited.intervalOilPump;
+    maxInjectionWater = edited.maxInjectionWater;
+    maxInjectionOil = edited.maxInjectionOil;
+    masterPollInterval = edited.masterPollInterval;
+
+    /// connection, takes effect the next time the port is opened
+    portIndex = edited.portIndex;
+    portSerial = edited.portSerial;
+    lowLatencyPorts = edited.lowLatencyPorts;
+    linkBaudRegister = edited.linkBaudRegister;
+    linkBauds = edited.linkBauds;
+    metricsPort = edited.metricsPort;
+    eventLog = edited.eventLog;
+    runCatalog = edited.runCatalog;
+    captureDir = edited.captureDir;
+    replayFile = edited.replayFile;
+    isReplayFast = edited.isReplayFast;
+
+    /// stability criteria per temp run phase
+    stabilityEwmaAlpha = edited.stabilityEwmaAlpha;
+    isPredictiveSettling = edited.isPredictiveSettling;
+    for (int phase = 0; phase < STABILITY_PHASES; phase++)
+    {
+        tempCriteria[phase] = edited.tempCriteria[phase];
+        freqCriteria[phase] = edited.freqCriteria[phase];
+    }
+
+    /// online calibration fits
+    fitCurveDegree = edited.fitCurveDegree;
+    fitTempDegree = edited.fitTempDegree;
+    fitCurveRegister = edited.fitCurveRegister;
+    fitTempRegister = edited.fitTempRegister;
+}
+
+
+QByteArray
+Settings::
+toJson() const
+{
+    QJsonObject json;
+
+    /// file server
+    json[MAIN_SERVER] = mainServer;
+    json[LOCAL_SERVER] = localServer;
+
+    /// calibration control variables
+    json[LOOP_OIL_PUMP_RATE] = QString::number(injectionOilPumpRate);
+    json[LOOP_WATER_PUMP_RATE] = QString::number(injectionWaterPumpRate);
+    json[LOOP_SMALL_WATER_PUMP_RATE] = QString::number(injectionSmallWaterPumpRate);
+    json[LOOP_BUCKET] = QString::number(injectionBucket);
+    json[LOOP_MARK] = QString::number(injectionMark);
+    json[LOOP_METHOD] = QString::number(injectionMethod);
+    json[LOOP_PRESSURE] = QString::number(pressureSensorSlope);
+    json[LOOP_MIN_TEMP] = QString::number(minRefTemp);
+    json[LOOP_MAX_TEMP] = QString::number(maxRefTemp);
+    json[LOOP_INJECTION_TEMP] = QString::number(injectionTemp);
+    json[LOOP_X_DELAY] = QString::number(xDelay);
+    json[LOOP_Y_FREQ] = QString::number(yFreq);
+    json[LOOP_Z_TEMP] = QString::number(zTemp);
+    json[LOOP_INTERVAL_SMALL_PUMP] = QString::number(intervalSmallPump);
+    json[LOOP_INTERVAL_BIG_PUMP] = QString::number(intervalBigPump);
+    json[LOOP_INTERVAL_OIL_PUMP] = QString::number(intervalOilPump);
+    json[LOOP_NUMBER] = QString::number(loopNumber);
+    json[LOOP_MASTER_MIN] = QString::number(masterMin);
+    json[LOOP_MASTER_MAX] = QString::number(masterMax);
+    json[LOOP_MASTER_DELTA] = QString::number(masterDelta);
+    json[LOOP_MASTER_DELTA_FINAL] = QString::number(masterDeltaFinal);
+    json[LOOP_MAX_INJECTION_WATER] = QString::number(maxInjectionWater);
+    json[LOOP_MAX_INJECTION_OIL] = QString::number(maxInjectionOil);
+    json[LOOP_MASTER_POLL_INTERVAL] = QString::number(masterPollInterval);
+
+    /// connection
+    json[LOOP_PORT_INDEX] = QString::number(portIndex);
+    json[LOOP_PORT_SERIAL] = portSerial;
+    json[LOOP_LOW_LATENCY_PORTS] = lowLatencyPorts.join(',');
+    json[LOOP_LINK_BAUD_REGISTER] = QString::number(linkBaudRegister);
+    json[LOOP_LINK_BAUDS] = linkBauds.join(',');
+    json[LOOP_METRICS_PORT] = QString::number(metricsPort);
+    json[LOOP_EVENT_LOG] = eventLog;
+    json[LOOP_RUN_CATALOG] = runCatalog;
+    json[LOOP_CAPTURE_DIR] = captureDir;
+    json[LOOP_REPLAY_FILE] = replayFile;
+    json[LOOP_REPLAY_FAST] = QString::number(isReplayFast);
+
+    /// stability criteria per temp run phase
+    json[LOOP_STABILITY_EWMA_ALPHA] = QString::number(stabilityEwmaAlpha);
+    json[LOOP_PREDICTIVE_SETTLING] = QString::number(isPredictiveSettling);
+    for (int phase = 0; phase < STABILITY_PHASES; phase++)
+    {
+        const QString key = stabilityKeys[phase];
+        json[key + STABILITY_WINDOW] = QString::number(tempCriteria[phase].window);
+        json[key + STABILITY_TEMP_STDDEV] = QString::number(tempCriteria[phase].maxStdDev);
+        json[key + STABILITY_TEMP_SLOPE] = QString::number(tempCriteria[phase].maxSlope);
+        json[key + STABILITY_FREQ_STDDEV] = QString::number(freqCriteria[phase].maxStdDev);
+        json[key + STABILITY_FREQ_SLOPE] = QString::number(freqCriteria[phase].maxSlope);
+    }
+
+    /// online calibration fits
+    json[LOOP_FIT_CURVE_DEGREE] = QString::number(fitCurveDegree);
+    json[LOOP_FIT_TEMP_DEGREE] = QString::number(fitTempDegree);
+    json[LOOP_FIT_CURVE_REGISTER] = QString::number(fitCurveRegister);
+    json[LOOP_FIT_TEMP_REGISTER] = QString::number(fitTempRegister);
+
+    return QJsonDocument(json).toJson();
+}
+
+
+SettingsFile::
+SettingsFile(const QString & path, QObject * parent) : QObject(parent), m_path(path)
+{
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(SETTINGS_SAVE_DELAY);
+    connect(&m_saveTimer, SIGNAL(timeout()), this, SLOT(write()));
+
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(SETTINGS_RELOAD_DELAY);
+    connect(&m_reloadTimer, SIGNAL(timeout()), this, SLOT(reload()));
+
+    connect(&m_watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(onFileChanged()));
+    watch();
+}
+
+
+SettingsFile::
+~SettingsFile()
+{
+    flush();
+}
+
+
+/// overlay the file on settings, a missing file leaves them as they are.
+/// a file that does not parse or validate leaves them untouched too.
+/// pending saves go out first so we never read back stale values.
+bool
+SettingsFile::
+load(Settings & settings, QString & error)
+{
+    flush();
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        m_settings = settings;
+        return true;
+    }
+
+    m_onDisk = file.readAll();
+    Settings loaded = settings;
+    if (!loaded.parse(m_onDisk, error) || !loaded.validate(error))
+    {
+        error.prepend(m_path + ": ");
+        return false;
+    }
+
+    settings = m_settings = loaded;
+    return true;
+}
+
+
+void
+SettingsFile::
+save(const Settings & settings)
+{
+    m_settings = settings;
+    m_pending = settings.toJson();
+    m_saveTimer.start();
+}
+
+
+void
+SettingsFile::
+flush()
+{
+    if (!m_saveTimer.isActive()) return;
+
+    m_saveTimer.stop();
+    write();
+}
+
+
+/// the write goes to a temp file next to the config and is renamed over
+/// it on commit, readers see either the old or the new file
+void
+SettingsFile::
+write()
+{
+    if (m_pending.isEmpty() || (m_pending == m_onDisk)) return;
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) return;
+
+    file.write(m_pending);
+    if (!file.commit()) return;
+
+    m_onDisk = m_pending;
+    m_pending.clear();
+
+    /// the rename replaced the watched inode
+    watch();
+}
+
+
+void
+SettingsFile::
+onFileChanged()
+{
+    watch();
+    m_reloadTimer.start();
+}
+
+
+/// an edit from outside, keys it leaves out keep their last good value.
+/// a bad file is reported and ignored, the running configuration stays
+/// as it was.
+void
+SettingsFile::
+reload()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    /// an editor that saves by rename had removed the path when it was reported
+    watch();
+
+    const QByteArray data = file.readAll();
+    if (data == m_onDisk) return;
+    m_onDisk = data;
+
+    Settings settings = m_settings;
+    QString error;
+    if (!settings.parse(data, error) || !settings.validate(error))
+    {
+        emit rejected(m_path + ": " + error);
+        return;
+    }
+
+    m_settings = settings;
+    emit changed(settings);
+}
+
+
+void
+SettingsFile::
+watch()
+{
+    if (QFile::exists(m_path) && !m_watcher.files().contains(m_path)) m_watcher.addPath(m_path);
+}
@@ -0,0 +1,189 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include "stability.h"
+
+#define MAIN_SERVER                 "MainServer"
+#define LOCAL_SERVER                "LocalServer"
+
+/// stability phases
+#define STABILITY_AMB				0
+#define STABILITY_MIN_REF			1
+#define STABILITY_MAX_REF			2
+#define STABILITY_PHASES			3
+#define STABILITY_LEVELS			5
+
+//////////////////////////
+/////// JSON KEYS ////////
+//////////////////////////
+
+#define LOOP_OIL_PUMP_RATE            "LOOP.OilPumpRate"
+#define LOOP_WATER_PUMP_RATE          "LOOP.WaterPumpRate"
+#define LOOP_SMALL_WATER_PUMP_RATE    "LOOP.SmallWaterPumpRate"
+#define LOOP_BUCKET                   "LOOP.Bucket"
+#define LOOP_MARK                     "LOOP.Mark"
+#define LOOP_METHOD                   "LOOP.Method"
+#define LOOP_PRESSURE                 "LOOP.PresssureSensorSlope"
+#define LOOP_MIN_TEMP                 "LOOP.MinRefTemp"
+#define LOOP_MAX_TEMP                 "LOOP.MaxRefTemp"
+#define LOOP_INJECTION_TEMP           "LOOP.InjectionTemp"
+#define LOOP_X_DELAY                  "LOOP.XDelay"
+#define LOOP_Y_FREQ                   "LOOP.YFreq"
+#define LOOP_Z_TEMP                   "LOOP.ZTemp"
+#define LOOP_INTERVAL_SMALL_PUMP      "LOOP.IntervalSmallPump"
+#define LOOP_INTERVAL_BIG_PUMP  	  "LOOP.IntervalBigPump"
+#define LOOP_INTERVAL_OIL_PUMP  	  "LOOP.IntervalOilPump"
+#define LOOP_NUMBER  	  			  "LOOP.LoopNumber"
+#define LOOP_MASTER_MIN  			  "LOOP.MasterMin"
+#define LOOP_MASTER_MAX  			  "LOOP.MasterMax"
+#define LOOP_MASTER_DELTA  			  "LOOP.MasterDelta"
+#define LOOP_MASTER_DELTA_FINAL		  "LOOP.MasterDeltaFinal"
+#define LOOP_MAX_INJECTION_WATER   	  "LOOP.MaxInjectionWater"
+#define LOOP_MAX_INJECTION_OIL   	  "LOOP.MaxInjectionOil"
+#define LOOP_MASTER_POLL_INTERVAL     "LOOP.MasterPollInterval"
+#define LOOP_PORT_INDEX    	          "LOOP.PortIndex"
+#define LOOP_PORT_SERIAL    	          "LOOP.PortSerial"
+#define LOOP_LOW_LATENCY_PORTS        "LOOP.LowLatencyPorts"
+#define LOOP_LINK_BAUD_REGISTER       "LOOP.Link.BaudRegister"
+#define LOOP_LINK_BAUDS               "LOOP.Link.Bauds"
+#define LOOP_METRICS_PORT             "LOOP.MetricsPort"
+#define LOOP_EVENT_LOG                "LOOP.EventLog"
+#define LOOP_RUN_CATALOG              "LOOP.RunCatalog"
+#define LOOP_CAPTURE_DIR              "LOOP.CaptureDir"
+#define LOOP_REPLAY_FILE              "LOOP.ReplayFile"
+#define LOOP_REPLAY_FAST              "LOOP.ReplayFast"
+#define LOOP_STABILITY_AMB            "LOOP.Stability.AMB"
+#define LOOP_STABILITY_MIN_REF        "LOOP.Stability.MinRef"
+#define LOOP_STABILITY_MAX_REF        "LOOP.Stability.MaxRef"
+#define LOOP_STABILITY_EWMA_ALPHA     "LOOP.Stability.EwmaAlpha"
+#define LOOP_PREDICTIVE_SETTLING      "LOOP.PredictiveSettling"
+#define LOOP_FIT_CURVE_DEGREE         "LOOP.Fit.CurveDegree"
+#define LOOP_FIT_TEMP_DEGREE          "LOOP.Fit.TempDegree"
+#define LOOP_FIT_CURVE_REGISTER       "LOOP.Fit.CurveRegister"
+#define LOOP_FIT_TEMP_REGISTER        "LOOP.Fit.TempRegister"
+
+/// per phase stability keys, appended to LOOP_STABILITY_*
+#define STABILITY_WINDOW              ".Window"
+#define STABILITY_TEMP_STDDEV         ".TempStdDev"
+#define STABILITY_TEMP_SLOPE          ".TempSlope"
+#define STABILITY_FREQ_STDDEV         ".FreqStdDev"
+#define STABILITY_FREQ_SLOPE          ".FreqSlope"
+
+#define SETTINGS_FILE                 "sparky.json"
+#define SETTINGS_SAVE_DELAY           500     /// ms of quiet before a save hits the disk
+#define SETTINGS_RELOAD_DELAY         200     /// ms to let an editor finish writing
+
+/// everything sparky.json holds, typed. parsed and validated in one place
+/// so the rest of the program never touches a QVariantMap. missing keys
+/// keep the defaults below, which match a fresh LOOP_OBJECT.
+struct Settings
+{
+    /// file server
+    QString mainServer;
+    QString localServer;
+
+    /// calibration control variables
+    double injectionOilPumpRate;
+    double injectionWaterPumpRate;
+    double injectionSmallWaterPumpRate;
+    double injectionBucket;
+    double injectionMark;
+    double injectionMethod;
+    double pressureSensorSlope;
+    int minRefTemp;
+    int maxRefTemp;
+    int injectionTemp;
+    int xDelay;
+    double yFreq;
+    double zTemp;
+    double intervalSmallPump;
+    double intervalBigPump;
+    double intervalOilPump;
+    int loopNumber;
+    double masterMin;
+    double masterMax;
+    double masterDelta;
+    double masterDeltaFinal;
+    int maxInjectionWater;
+    int maxInjectionOil;
+    int masterPollInterval;
+
+    /// connection
+    int portIndex;
+    QString portSerial;
+    QStringList lowLatencyPorts;
+    int linkBaudRegister;
+    QStringList linkBauds;
+    int metricsPort;
+    QString eventLog;
+    QString runCatalog;
+    QString captureDir;
+    QString replayFile;
+    bool isReplayFast;
+
+    /// stability criteria per temp run phase
+    double stabilityEwmaAlpha;
+    bool isPredictiveSettling;
+    StabilityCriteria tempCriteria[STABILITY_PHASES];
+    StabilityCriteria freqCriteria[STABILITY_PHASES];
+
+    /// online calibration fits
+    int fitCurveDegree;
+    int fitTempDegree;
+    int fitCurveRegister;
+    int fitTempRegister;
+
+    Settings();
+
+    bool parse(const QByteArray & data, QString & error);
+    bool validate(QString & error) const;
+    void mergeLive(const Settings & edited);
+    QByteArray toJson() const;
+};
+
+/// sparky.json on disk. save() is debounced and goes through a temp file
+/// that is renamed over the old one, so a burst of menu edits costs one
+/// write and a crash never leaves a half written config. edits made by
+/// hand are picked up by the watcher, overlaid on the last good
+/// configuration and reported through changed(), our own writes are
+/// recognised by content and not reported back.
+class SettingsFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SettingsFile(const QString & path, QObject * parent = 0);
+    ~SettingsFile();
+
+    bool load(Settings & settings, QString & error);
+    void save(const Settings & settings);
+    void flush();
+
+signals:
+    void changed(const Settings & settings);
+    void rejected(const QString & error);
+
+private slots:
+    void onFileChanged();
+    void reload();
+    void write();
+
+private:
+    void watch();
+
+    QString m_path;
+    QFileSystemWatcher m_watcher;
+    QTimer m_saveTimer;
+    QTimer m_reloadTimer;
+    QByteArray m_pending;       /// waiting for the save timer
+    QByteArray m_onDisk;        /// what the file held when we last read or wrote it
+    Settings m_settings;        /// last good configuration, keys missing from an edit keep these
+};
+
+#endif // SETTINGS_H
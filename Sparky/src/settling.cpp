@@ -0,0 +1,119 @@
+#include "settling.h"
+#include <QtMath>
+
+
+SettlingPredictor::
+SettlingPredictor() : m_lambda(0.95), m_minSamples(6)
+{
+    reset();
+}
+
+
+void
+SettlingPredictor::
+reset()
+{
+    m_samples = 0;
+    m_hasPrev = false;
+    m_prevT = 0;
+    m_prevX = 0;
+    m_sw = 0;
+    m_sx = 0;
+    m_sy = 0;
+    m_sxx = 0;
+    m_sxy = 0;
+    m_last = 0;
+    m_asymptote = 0;
+    m_tau = 0;
+}
+
+
+void
+SettlingPredictor::
+addSample(const double seconds, const double value)
+{
+    m_last = value;
+
+    if (m_hasPrev && (seconds > m_prevT))
+    {
+        /// regress the slope of each interval against the value at its middle;
+        /// values are taken relative to the previous sample to keep the sums small
+        const double x = (value + m_prevX) / 2 - m_prevX;
+        const double y = (value - m_prevX) / (seconds - m_prevT);
+
+        m_sw = m_lambda * m_sw + 1;
+        m_sx = m_lambda * m_sx + x;
+        m_sy = m_lambda * m_sy + y;
+        m_sxx = m_lambda * m_sxx + x * x;
+        m_sxy = m_lambda * m_sxy + x * y;
+
+        /// re-centre the x sums on the new sample
+        const double shift = value - m_prevX;
+        m_sxx -= 2 * shift * m_sx - shift * shift * m_sw;
+        m_sxy -= shift * m_sy;
+        m_sx -= shift * m_sw;
+
+        m_samples++;
+        solve();
+    }
+
+    m_prevT = seconds;
+    m_prevX = value;
+    m_hasPrev = true;
+}
+
+
+void
+SettlingPredictor::
+solve()
+{
+    /// dx/dt = c + b * x with x relative to the newest sample, b = -1/tau, A = x - c/b
+    const double det = m_sw * m_sxx - m_sx * m_sx;
+    if (qAbs(det) < 1e-12)
+    {
+        m_tau = 0;
+        return;
+    }
+
+    const double b = (m_sw * m_sxy - m_sx * m_sy) / det;
+    const double c = (m_sy - b * m_sx) / m_sw;
+
+    if (b >= 0)
+    {
+        /// not converging (yet)
+        m_tau = 0;
+        return;
+    }
+
+    m_tau = -1 / b;
+    m_asymptote = m_last - c / b;
+}
+
+
+bool
+SettlingPredictor::
+isValid() const
+{
+    return (m_samples >= m_minSamples) && (m_tau > 0) && qIsFinite(m_asymptote);
+}
+
+
+double
+SettlingPredictor::
+residual() const
+{
+    return isValid() ? qAbs(m_last - m_asymptote) : -1;
+}
+
+
+double
+SettlingPredictor::
+timeToSettle(const double tolerance) const
+{
+    if (!isValid()) return -1;
+
+    const double remaining = qAbs(m_last - m_asymptote);
+    if ((remaining <= tolerance) || (tolerance <= 0)) return 0;
+
+    return m_tau * qLn(remaining / tolerance);
+}
@@ -0,0 +1,44 @@
+#ifndef SETTLING_H
+#define SETTLING_H
+
+/// online first order fit x(t) = A + (x0 - A) * exp(-t / tau) of a channel
+/// converging on a set point.  the derivative of such a response is linear
+/// in the value, dx/dt = (A - x) / tau, so every new sample only updates a
+/// few exponentially weighted regression sums.
+class SettlingPredictor
+{
+public:
+    SettlingPredictor();
+
+    void setForgetting(const double lambda) { m_lambda = lambda; }
+    void setMinSamples(const int samples) { m_minSamples = samples; }
+
+    void reset();
+    void addSample(const double seconds, const double value);
+
+    bool isValid() const;
+    double asymptote() const { return m_asymptote; }
+    double timeConstant() const { return m_tau; }
+    double residual() const;
+    double timeToSettle(const double tolerance) const;
+
+private:
+    void solve();
+
+    double m_lambda;
+    int m_minSamples;
+    int m_samples;
+    bool m_hasPrev;
+    double m_prevT;
+    double m_prevX;
+    double m_sw;
+    double m_sx;
+    double m_sy;
+    double m_sxx;
+    double m_sxy;
+    double m_last;
+    double m_asymptote;
+    double m_tau;
+};
+
+#endif // SETTLING_H
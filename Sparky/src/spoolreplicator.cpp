@@ -0,0 +1,322 @@
+#include "spoolreplicator.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+
+/// time between two passes, and the longest back-off after failures
+#define SPOOL_INTERVAL_MS       5000
+#define SPOOL_MAX_BACKOFF_MS    120000
+
+/// what has been mirrored, kept at the top of the spool
+#define SPOOL_INDEX             ".replicated"
+
+
+static QString normalized(const QString & path)
+{
+    QString result = QDir::cleanPath(QDir::fromNativeSeparators(path));
+    while (result.endsWith('/') && (result.length() > 1)) result.chop(1);
+    return result;
+}
+
+
+static QByteArray md5(const QByteArray & data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+
+SpoolReplicator::
+SpoolReplicator() : m_log(NULL), m_isIndexDirty(false), m_isStalled(false), m_pending(0), m_running(0)
+{
+}
+
+
+SpoolReplicator::
+~SpoolReplicator()
+{
+    close();
+}
+
+
+/// files already in the spool that the index does not know as mirrored
+/// are picked up by the first pass, whichever session wrote them
+bool
+SpoolReplicator::
+open(const QString & spoolRoot, const QString & remoteRoot, EventLog * log)
+{
+    close();
+
+    m_spoolRoot = normalized(spoolRoot);
+    m_remoteRoot = remoteRoot.isEmpty() ? QString() : normalized(remoteRoot);
+    m_log = log;
+    m_directories.clear();
+    m_isStalled = false;
+
+    if (!QDir().mkpath(m_spoolRoot)) return false;
+    if (m_remoteRoot.isEmpty()) return true;
+
+    loadIndex();
+
+    QDirIterator it(m_spoolRoot, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        const QString path = it.next();
+        const QString rel = relativePath(path);
+        if (rel == SPOOL_INDEX) continue;
+        if (!m_files.contains(rel) || (m_files[rel].size != it.fileInfo().size())) m_directories.insert(it.fileInfo().path());
+    }
+
+    m_running.store(1);
+    start(QThread::LowPriority);
+
+    return true;
+}
+
+
+/// a last pass unless the share is known to be away, so closing never
+/// waits on a network timeout
+void
+SpoolReplicator::
+close()
+{
+    if (!m_running.load()) return;
+
+    m_lock.lock();
+    m_running.store(0);
+    m_wake.wakeAll();
+    m_lock.unlock();
+    wait();
+
+    if (!m_isStalled) pass();
+    if (m_isIndexDirty) saveIndex();
+}
+
+
+QString
+SpoolReplicator::
+remotePath(const QString & spoolPath) const
+{
+    if (m_remoteRoot.isEmpty()) return QString();
+
+    return m_remoteRoot + "/" + relativePath(spoolPath);
+}
+
+
+void
+SpoolReplicator::
+addDirectory(const QString & spoolDir)
+{
+    QMutexLocker locker(&m_lock);
+    m_directories.insert(normalized(spoolDir));
+}
+
+
+void
+SpoolReplicator::
+run()
+{
+    int interval = SPOOL_INTERVAL_MS;
+
+    while (m_running.load())
+    {
+        interval = pass() ? SPOOL_INTERVAL_MS : qMin(interval * 2, SPOOL_MAX_BACKOFF_MS);
+
+        m_lock.lock();
+        if (m_running.load()) m_wake.wait(&m_lock, interval);
+        m_lock.unlock();
+    }
+}
+
+
+/// one batch over every active run directory
+bool
+SpoolReplicator::
+pass()
+{
+    m_lock.lock();
+    const QList<QString> directories = m_directories.toList();
+    m_lock.unlock();
+
+    int pending = 0;
+    QString firstError;
+
+    foreach (const QString & directory, directories)
+    {
+        QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+        {
+            const QString path = it.next();
+            if (relativePath(path) == SPOOL_INDEX) continue;
+
+            QString error;
+            if (!replicate(path, error))
+            {
+                pending++;
+                if (firstError.isEmpty()) firstError = error;
+            }
+        }
+    }
+
+    m_pending.store(pending);
+    if (m_isIndexDirty) saveIndex();
+
+    if (pending && !m_isStalled && m_log)
+    {
+        QVariantMap fields;
+        fields["pending"] = pending;
+        fields["error"] = firstError;
+        m_log->post("spool_stalled", fields);
+    }
+    else if (!pending && m_isStalled && m_log) m_log->post("spool_resumed");
+    m_isStalled = (pending > 0);
+
+    return !pending;
+}
+
+
+bool
+SpoolReplicator::
+replicate(const QString & path, QString & error)
+{
+    const QString rel = relativePath(path);
+    const QFileInfo info(path);
+    FileState & state = m_files[rel];
+
+    if ((info.size() == state.size) && (info.lastModified() == state.modified)) return true;
+
+    QFile local(path);
+    if (!local.open(QIODevice::ReadOnly))
+    {
+        error = path + ": " + local.errorString();
+        return false;
+    }
+    const QByteArray data = local.readAll();
+    local.close();
+
+    const QString remote = m_remoteRoot + "/" + rel;
+    if (!QDir().mkpath(QFileInfo(remote).path()))
+    {
+        error = QFileInfo(remote).path() + ": can not be created";
+        return false;
+    }
+
+    /// the remote copy is still the prefix we sent last time
+    const bool isAppend = (state.size > 0) && (data.size() >= state.size) &&
+                          (QFileInfo(remote).size() == state.size) && (md5(data.left(state.size)) == state.hash);
+
+    if (isAppend ? !append(remote, data.mid(state.size), state.size, error) : !copy(remote, data, error)) return false;
+
+    state.size = data.size();
+    state.hash = md5(data);
+    state.modified = info.lastModified();
+    m_isIndexDirty = true;
+
+    return true;
+}
+
+
+bool
+SpoolReplicator::
+append(const QString & remote, const QByteArray & data, const qint64 offset, QString & error)
+{
+    if (data.isEmpty()) return true;
+
+    QFile file(remote);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || (file.write(data) != data.size()))
+    {
+        error = remote + ": " + file.errorString();
+        return false;
+    }
+    file.close();
+
+    /// read the new tail back
+    if (!file.open(QIODevice::ReadOnly) || (file.size() != offset + data.size()) || !file.seek(offset) || (file.read(data.size()) != data))
+    {
+        error = remote + ": appended data does not read back";
+        return false;
+    }
+
+    return true;
+}
+
+
+bool
+SpoolReplicator::
+copy(const QString & remote, const QByteArray & data, QString & error)
+{
+    QSaveFile file(remote);
+    if (!file.open(QIODevice::WriteOnly) || (file.write(data) != data.size()) || !file.commit())
+    {
+        error = remote + ": " + file.errorString();
+        return false;
+    }
+
+    QFile check(remote);
+    if (!check.open(QIODevice::ReadOnly) || (check.readAll() != data))
+    {
+        error = remote + ": copy does not read back";
+        return false;
+    }
+
+    return true;
+}
+
+
+QString
+SpoolReplicator::
+relativePath(const QString & spoolPath) const
+{
+    const QString path = normalized(spoolPath);
+    if (path.startsWith(m_spoolRoot + "/")) return path.mid(m_spoolRoot.length() + 1);
+
+    return path;
+}
+
+
+/// one line per file: size, modification time, md5, relative path
+void
+SpoolReplicator::
+loadIndex()
+{
+    m_files.clear();
+    m_isIndexDirty = false;
+
+    QFile file(m_spoolRoot + "/" + SPOOL_INDEX);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return;
+
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        const QStringList fields = in.readLine().split('\t');
+        if (fields.size() != 4) continue;
+
+        FileState state;
+        state.size = fields[0].toLongLong();
+        state.modified = QDateTime::fromMSecsSinceEpoch(fields[1].toLongLong());
+        state.hash = QByteArray::fromHex(fields[2].toLatin1());
+        m_files[fields[3]] = state;
+    }
+}
+
+
+void
+SpoolReplicator::
+saveIndex()
+{
+    QSaveFile file(m_spoolRoot + "/" + SPOOL_INDEX);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return;
+
+    QTextStream out(&file);
+    for (QHash<QString, FileState>::const_iterator it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+    {
+        if (it.value().hash.isEmpty()) continue;
+        out << it.value().size << '\t' << it.value().modified.toMSecsSinceEpoch() << '\t' << it.value().hash.toHex() << '\t' << it.key() << '\n';
+    }
+    out.flush();
+
+    if (file.commit()) m_isIndexDirty = false;
+}
@@ -0,0 +1,80 @@
+#ifndef SPOOLREPLICATOR_H
+#define SPOOLREPLICATOR_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QWaitCondition>
+#include "eventlog.h"
+
+/// calibration files are written to a local spool and mirrored to the
+/// main file server from here, so a slow or missing share never holds up
+/// a sample. every pass ships what changed since the last one: bytes
+/// appended locally are appended remotely, anything else is copied whole
+/// through a temp file. a transfer only counts once it has been read back
+/// and compared, failed passes are retried with a growing back-off.
+/// what has been mirrored is kept in an index inside the spool, so a
+/// restart resumes where the last session stopped.
+class SpoolReplicator : public QThread
+{
+public:
+    SpoolReplicator();
+    ~SpoolReplicator();
+
+    bool open(const QString & spoolRoot, const QString & remoteRoot, EventLog * log);
+    void close();
+
+    bool isOpen() const { return m_running.load(); }
+    const QString & spoolRoot() const { return m_spoolRoot; }
+    const QString & remoteRoot() const { return m_remoteRoot; }
+
+    /// the same file below the main server, empty without one
+    QString remotePath(const QString & spoolPath) const;
+
+    /// a run directory that is being written to
+    void addDirectory(const QString & spoolDir);
+
+    int pending() const { return m_pending.load(); }
+
+protected:
+    void run();
+
+private:
+    struct FileState
+    {
+        qint64 size;
+        QByteArray hash;        /// md5 of the first size bytes
+        QDateTime modified;
+
+        FileState() : size(0) {}
+    };
+
+    bool pass();
+    bool replicate(const QString & path, QString & error);
+    bool append(const QString & remote, const QByteArray & data, const qint64 offset, QString & error);
+    bool copy(const QString & remote, const QByteArray & data, QString & error);
+    QString relativePath(const QString & spoolPath) const;
+    void loadIndex();
+    void saveIndex();
+
+    QString m_spoolRoot;
+    QString m_remoteRoot;
+    EventLog * m_log;
+
+    QMutex m_lock;              /// guards m_directories and the wake up
+    QWaitCondition m_wake;
+    QSet<QString> m_directories;
+
+    QHash<QString, FileState> m_files;  /// worker thread only, keyed by relative path
+    bool m_isIndexDirty;
+    bool m_isStalled;
+
+    QAtomicInt m_pending;
+    QAtomicInt m_running;
+};
+
+#endif // SPOOLREPLICATOR_H
@@ -0,0 +1,180 @@
+#include "stability.h"
+#include <QtMath>
+
+/// the window sums drift slightly with every removal, so they are
+/// rebuilt from the ring after this many windows worth of samples.
+#define RECOMPUTE_WINDOWS   16
+
+
+StabilityDetector::
+StabilityDetector()
+{
+    setCriteria(StabilityCriteria());
+}
+
+
+void
+StabilityDetector::
+setCriteria(const StabilityCriteria & criteria)
+{
+    StabilityCriteria clamped = criteria;
+    if (clamped.window < 2) clamped.window = 2;
+    if ((clamped.ewmaAlpha <= 0) || (clamped.ewmaAlpha > 1)) clamped.ewmaAlpha = 1;
+
+    /// compared after the clamp, a window below 2 would resize on every call
+    const bool isResized = (clamped.window != m_criteria.window) || m_ring.isEmpty();
+    m_criteria = clamped;
+
+    if (isResized)
+    {
+        m_ring.fill(0, m_criteria.window);
+        reset();
+    }
+}
+
+
+void
+StabilityDetector::
+reset()
+{
+    m_head = 0;
+    m_count = 0;
+    m_sinceRecompute = 0;
+    m_ref = 0;
+    m_sum = 0;
+    m_sumSq = 0;
+    m_sumXY = 0;
+    m_last = 0;
+    m_ewma = 0;
+}
+
+
+void
+StabilityDetector::
+addSample(const double value)
+{
+    const int n = m_ring.size();
+
+    /// samples are stored relative to the first one so that the sums of
+    /// squares of e.g. a 500 MHz frequency do not swallow its noise floor
+    if (m_count == 0)
+    {
+        m_ref = value;
+        m_ewma = value;
+    }
+    else m_ewma += m_criteria.ewmaAlpha * (value - m_ewma);
+
+    m_last = value;
+    const double y = value - m_ref;
+
+    if (m_count < n)
+    {
+        m_ring[(m_head + m_count) % n] = y;
+        m_sumXY += m_count * y;
+        m_count++;
+    }
+    else
+    {
+        /// drop the oldest (x = 0), shift the rest down by one, append at x = n-1
+        const double oldest = m_ring[m_head];
+        m_sum -= oldest;
+        m_sumSq -= oldest * oldest;
+        m_sumXY -= m_sum;
+        m_sumXY += (n - 1) * y;
+        m_ring[m_head] = y;
+        m_head = (m_head + 1) % n;
+    }
+
+    m_sum += y;
+    m_sumSq += y * y;
+
+    if (++m_sinceRecompute >= n * RECOMPUTE_WINDOWS) recompute();
+}
+
+
+void
+StabilityDetector::
+recompute()
+{
+    const int n = m_ring.size();
+
+    m_sum = 0;
+    m_sumSq = 0;
+    m_sumXY = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        const double y = m_ring[(m_head + i) % n];
+        m_sum += y;
+        m_sumSq += y * y;
+        m_sumXY += i * y;
+    }
+
+    m_sinceRecompute = 0;
+}
+
+
+double
+StabilityDetector::
+mean() const
+{
+    return (m_count > 0) ? (m_ref + m_sum / m_count) : 0;
+}
+
+
+double
+StabilityDetector::
+variance() const
+{
+    if (m_count < 2) return 0;
+
+    const double v = (m_sumSq - m_sum * m_sum / m_count) / (m_count - 1);
+    return (v > 0) ? v : 0;
+}
+
+
+double
+StabilityDetector::
+stdDev() const
+{
+    return qSqrt(variance());
+}
+
+
+double
+StabilityDetector::
+slope() const
+{
+    if (m_count < 2) return 0;
+
+    /// x runs 0..n-1 over the window, so its sums are closed form
+    const double n = m_count;
+    const double sumX = n * (n - 1) / 2;
+    const double sumXX = (n - 1) * n * (2 * n - 1) / 6;
+
+    return (n * m_sumXY - sumX * m_sum) / (n * sumXX - sumX * sumX);
+}
+
+
+bool
+StabilityDetector::
+isStable() const
+{
+    if (m_count < m_criteria.window) return false;
+    if ((m_criteria.maxStdDev >= 0) && (stdDev() > m_criteria.maxStdDev)) return false;
+    if ((m_criteria.maxSlope >= 0) && (qAbs(slope()) > m_criteria.maxSlope)) return false;
+    if ((m_criteria.maxEwmaDelta >= 0) && (qAbs(m_last - m_ewma) > m_criteria.maxEwmaDelta)) return false;
+
+    return true;
+}
+
+
+int
+StabilityDetector::
+level(const int levels) const
+{
+    /// the window filling up accounts for all but the last level,
+    /// which is only reached once every criterion holds
+    if (isStable()) return levels;
+
+    return qMin(levels - 1, m_count * (levels - 1) / m_criteria.window);
+}
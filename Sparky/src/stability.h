@@ -0,0 +1,60 @@
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#include <QVector>
+
+/// limits a channel must satisfy over its window to be called stable.
+/// a negative limit disables that particular test.
+struct StabilityCriteria
+{
+    int window;             /// number of samples in the rolling window
+    double maxStdDev;       /// standard deviation over the window
+    double maxSlope;        /// least-squares slope, units per sample
+    double maxEwmaDelta;    /// distance of the newest sample from the EWMA
+    double ewmaAlpha;       /// EWMA smoothing factor, 0 < alpha <= 1
+
+    StabilityCriteria() : window(5), maxStdDev(-1), maxSlope(-1), maxEwmaDelta(-1), ewmaAlpha(0.3) {}
+};
+
+/// rolling statistics for one channel (temperature or frequency of a pipe).
+/// every sample is O(1): the window sums are updated in place and the
+/// regression slope is derived from them instead of being refit.
+class StabilityDetector
+{
+public:
+    StabilityDetector();
+
+    void setCriteria(const StabilityCriteria & criteria);
+    const StabilityCriteria & criteria() const { return m_criteria; }
+
+    void reset();
+    void addSample(const double value);
+
+    int count() const { return m_count; }
+    double last() const { return m_last; }
+    double mean() const;
+    double variance() const;
+    double stdDev() const;
+    double slope() const;
+    double ewma() const { return m_ewma; }
+
+    bool isStable() const;
+    int level(const int levels) const;
+
+private:
+    void recompute();
+
+    StabilityCriteria m_criteria;
+    QVector<double> m_ring;
+    int m_head;
+    int m_count;
+    int m_sinceRecompute;
+    double m_ref;
+    double m_sum;
+    double m_sumSq;
+    double m_sumXY;
+    double m_last;
+    double m_ewma;
+};
+
+#endif // STABILITY_H
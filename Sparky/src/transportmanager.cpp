@@ -0,0 +1,72 @@
+#include "transportmanager.h"
+
+
+TransportManager::
+TransportManager() : m_hasPorts(false)
+{
+}
+
+
+TransportManager::
+~TransportManager()
+{
+    foreach (const int loop, m_transports.keys()) release(loop);
+}
+
+
+modbus_t *
+TransportManager::
+acquire(const int loop, const TransportSettings & settings, bool & isReused)
+{
+    isReused = false;
+
+    if (m_transports.contains(loop))
+    {
+        if (m_transports[loop].settings == settings)
+        {
+            isReused = true;
+            return m_transports[loop].ctx;
+        }
+
+        release(loop);
+    }
+
+    modbus_t * ctx;
+    if (settings.isReplay) ctx = modbus_new_replay(settings.port.toLocal8Bit().constData(), settings.isReplayFast ? MODBUS_REPLAY_FAST : MODBUS_REPLAY_TIMED);
+    else ctx = modbus_new_rtu(settings.port.toLatin1().constData(), settings.baud, settings.parity, settings.dataBits, settings.stopBits);
+    if (!ctx) return NULL;
+
+    if (modbus_connect(ctx) == -1)
+    {
+        modbus_free(ctx);
+        return NULL;
+    }
+
+    Transport transport;
+    transport.settings = settings;
+    transport.ctx = ctx;
+    m_transports[loop] = transport;
+
+    return ctx;
+}
+
+
+void
+TransportManager::
+release(const int loop)
+{
+    if (!m_transports.contains(loop)) return;
+
+    modbus_t * ctx = m_transports.take(loop).ctx;
+    modbus_close(ctx);
+    modbus_free(ctx);
+}
+
+
+void
+TransportManager::
+setPorts(const QList<QextPortInfo> & ports)
+{
+    m_ports = ports;
+    m_hasPorts = true;
+}
@@ -0,0 +1,63 @@
+#ifndef TRANSPORTMANAGER_H
+#define TRANSPORTMANAGER_H
+
+#include <QList>
+#include <QMap>
+#include <QString>
+#include "modbus.h"
+#include "qextserialenumerator.h"
+
+/// how a bus is opened, two equal settings can share one context
+struct TransportSettings
+{
+    QString port;       /// device name, or the capture file of a replay
+    int baud;
+    char parity;
+    int dataBits;
+    int stopBits;
+    bool isReplay;
+    bool isReplayFast;
+
+    TransportSettings() : baud(0), parity('N'), dataBits(8), stopBits(1), isReplay(false), isReplayFast(false) {}
+
+    bool operator==(const TransportSettings & o) const
+    {
+        return (port == o.port) && (baud == o.baud) && (parity == o.parity) && (dataBits == o.dataBits) &&
+               (stopBits == o.stopBits) && (isReplay == o.isReplay) && (isReplayFast == o.isReplayFast);
+    }
+    bool operator!=(const TransportSettings & o) const { return !(*this == o); }
+};
+
+/// owns the open modbus contexts and the last port enumeration for the
+/// whole process. main() keeps it across RESTART_CODE, so a new window
+/// gets its loop back already connected and configured instead of
+/// enumerating and reopening every port.
+class TransportManager
+{
+public:
+    TransportManager();
+    ~TransportManager();
+
+    /// the context of a loop, reused when the settings did not change
+    modbus_t * acquire(const int loop, const TransportSettings & settings, bool & isReused);
+    void release(const int loop);
+
+    bool hasPorts() const { return m_hasPorts; }
+    const QList<QextPortInfo> & ports() const { return m_ports; }
+    void setPorts(const QList<QextPortInfo> & ports);
+
+private:
+    struct Transport
+    {
+        TransportSettings settings;
+        modbus_t * ctx;
+    };
+
+    QMap<int, Transport> m_transports;
+    QList<QextPortInfo> m_ports;
+    bool m_hasPorts;
+};
+
+extern TransportManager * globalTransports;
+
+#endif // TRANSPORTMANAGER_H
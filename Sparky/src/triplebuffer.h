@@ -0,0 +1,37 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <QAtomicInt>
+
+/// single producer, single consumer hand-over of the latest value.
+/// the producer fills its own slot and swaps it with the middle one, the
+/// consumer swaps the middle slot with its own when it holds something
+/// new. neither side ever waits for the other and a slot is only ever
+/// touched by one thread at a time.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : m_write(0), m_middle(1), m_read(2) {}
+
+    /// producer side
+    T & writeBuffer() { return m_buffers[m_write]; }
+    void publish() { m_write = m_middle.fetchAndStoreOrdered(m_write | DIRTY) & INDEX; }
+
+    /// consumer side, the newest published value or the previous one
+    const T & read()
+    {
+        if (m_middle.loadAcquire() & DIRTY) m_read = m_middle.fetchAndStoreOrdered(m_read) & INDEX;
+        return m_buffers[m_read];
+    }
+
+private:
+    enum { INDEX = 0x3, DIRTY = 0x4 };
+
+    T m_buffers[3];
+    int m_write;
+    QAtomicInt m_middle;
+    int m_read;
+};
+
+#endif // TRIPLEBUFFER_H